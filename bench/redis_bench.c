@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "redis_client.h"
+
+
+/**
+ * Request handler of the benchmark: three dependent round trips,
+ * SET bench:<n>, GET it back, INCRBY bench:counter 1
+ */
+#define BENCH_KEY_LEN       64
+#define BENCH_INDEX         0
+
+
+struct bench_ctx
+{
+    redis_client       *client;
+    redis_sched        *sched;
+    int                 first;                  /* First request of this worker */
+    int                 count;                  /* Requests of this worker */
+    int                 local;                  /* Thread-local handle instead of shared client */
+    int                 failed;
+};
+
+
+static double bench_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+/**
+ * Thread per request: blocking redis_client calls
+ */
+static void *bench_thread_routine(void *arg)
+{
+    int i = 0, n = 0;
+    char key[BENCH_KEY_LEN], value[BENCH_KEY_LEN], buf[BENCH_KEY_LEN];
+    struct bench_ctx *ctx = (struct bench_ctx *)arg;
+    redis_client *c = ctx->local ? redis_client_local(ctx->client) : ctx->client;
+
+    for (i = ctx->first; i < ctx->first + ctx->count; ++i)
+    {
+        snprintf(key, sizeof(key), "bench:%d", i);
+        n = snprintf(value, sizeof(value), "value-%d", i);
+
+        if (c->String.SET(c, BENCH_INDEX, key, value, n, 0, 0) <= 0
+            || c->String.GET(c, BENCH_INDEX, key, buf, sizeof(buf)) != n
+            || REDIS_OK != c->String.INCRBY(c, BENCH_INDEX, "bench:counter", 1, NULL))
+        {
+            ctx->failed++;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Coroutine per request: the same code, each wait yields
+ */
+static void bench_coroutine(redis_sched *sched, void *arg)
+{
+    int i = 0, n = 0;
+    char key[BENCH_KEY_LEN], value[BENCH_KEY_LEN], buf[BENCH_KEY_LEN];
+    struct bench_ctx *ctx = (struct bench_ctx *)arg;
+    redis_future *f = NULL;
+
+    for (i = ctx->first; i < ctx->first + ctx->count; ++i)
+    {
+        snprintf(key, sizeof(key), "bench:%d", i);
+        n = snprintf(value, sizeof(value), "value-%d", i);
+
+        f = sched->command(sched, BENCH_INDEX, "SET %s %s", key, value);
+        if (REDIS_OK != redis_future_status(f))
+        {
+            ctx->failed++;
+        }
+        redis_future_free(f);
+
+        f = sched->command(sched, BENCH_INDEX, "GET %s", key);
+        if (redis_future_string(f, buf, sizeof(buf)) != n)
+        {
+            ctx->failed++;
+        }
+        redis_future_free(f);
+
+        f = sched->command(sched, BENCH_INDEX, "INCRBY bench:counter 1");
+        if (redis_future_int(f) < 0)
+        {
+            ctx->failed++;
+        }
+        redis_future_free(f);
+    }
+}
+
+static void bench_split(struct bench_ctx *ctxs, int workers, int requests)
+{
+    int i = 0, first = 0;
+
+    for (i = 0; i < workers; ++i)
+    {
+        ctxs[i].first = first;
+        ctxs[i].count = requests / workers + (i < requests % workers ? 1 : 0);
+        first += ctxs[i].count;
+    }
+}
+
+static int bench_threads(redis_client *client, int requests, int workers, int local)
+{
+    int i = 0, failed = 0;
+    pthread_t *threads = NULL;
+    struct bench_ctx *ctxs = NULL;
+
+    threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+    ctxs = (struct bench_ctx *)calloc(workers, sizeof(struct bench_ctx));
+    if (!threads || !ctxs)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    bench_split(ctxs, workers, requests);
+
+    for (i = 0; i < workers; ++i)
+    {
+        ctxs[i].client = client;
+        ctxs[i].local = local;
+        if (0 != pthread_create(&threads[i], NULL, bench_thread_routine, &ctxs[i]))
+        {
+            fprintf(stderr, "pthread_create failed at thread %d\n", i);
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < workers; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        failed += ctxs[i].failed;
+    }
+
+    free(threads);
+    free(ctxs);
+
+    return failed;
+}
+
+static int bench_coroutines(redis_client *client, int requests, int workers)
+{
+    int i = 0, failed = 0;
+    redis_sched *sched = NULL;
+    struct bench_ctx *ctxs = NULL;
+
+    sched = redis_sched_create(client, 0);
+    ctxs = (struct bench_ctx *)calloc(workers, sizeof(struct bench_ctx));
+    if (!sched || !ctxs)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    bench_split(ctxs, workers, requests);
+
+    for (i = 0; i < workers; ++i)
+    {
+        ctxs[i].sched = sched;
+        sched->spawn(sched, bench_coroutine, &ctxs[i]);
+    }
+
+    sched->run(sched);
+
+    for (i = 0; i < workers; ++i)
+    {
+        failed += ctxs[i].failed;
+    }
+
+    redis_sched_destroy(sched);
+    free(ctxs);
+
+    return failed;
+}
+
+static void bench_report(const char *model, int requests, int workers, double ms, int failed)
+{
+    fprintf(stderr, "%-24s %6d workers %8d requests %10.0f ms %10.0f req/s %6d failed\n",
+            model, workers, requests, ms, requests * 1000.0 / (ms > 0 ? ms : 1), failed);
+}
+
+/**
+ * usage: redis_bench [ip] [port] [requests] [concurrency]
+ *
+ * Results go to stderr, run with >/dev/null to drop client logs.
+ */
+int main(int argc, char **argv)
+{
+    int port = 6379, requests = 100000, workers = 100, failed = 0;
+    const char *ip = "127.0.0.1";
+    double start = 0;
+    redis_client *client = NULL;
+
+    if (argc > 1)
+    {
+        ip = argv[1];
+    }
+    if (argc > 2)
+    {
+        port = atoi(argv[2]);
+    }
+    if (argc > 3)
+    {
+        requests = atoi(argv[3]);
+    }
+    if (argc > 4)
+    {
+        workers = atoi(argv[4]);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    client = redis_client_create(ip, port);
+    if (!client)
+    {
+        fprintf(stderr, "redis_client_create failed\n");
+        return 1;
+    }
+
+    start = bench_now();
+    failed = bench_threads(client, requests, workers, REDIS_FALSE);
+    bench_report("threads, shared client", requests, workers, bench_now() - start, failed);
+
+    start = bench_now();
+    failed = bench_threads(client, requests, workers, REDIS_TRUE);
+    bench_report("threads, local handles", requests, workers, bench_now() - start, failed);
+
+    start = bench_now();
+    failed = bench_coroutines(client, requests, workers);
+    bench_report("coroutines, one thread", requests, workers, bench_now() - start, failed);
+
+    redis_client_destroy(client);
+
+    return 0;
+}
+
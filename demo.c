@@ -16,7 +16,12 @@ int main(int argc, char **argv)
     int i = 0, rc = 0;
     redis_client *redis_db = NULL;
     redis_member *members = NULL;
+    redis_scan *scan = NULL;
     redis_account account = {0};
+    char value[64] = {0}, values[3][64];
+    const char *keys[3] = {"session", "counter", "missing"};
+    int lens[3];
+    long long counter = 0;
 
     if (3 != argc)
     {
@@ -41,8 +46,24 @@ int main(int argc, char **argv)
 
 
     EMI_LOG("===============TEST STRING=============\n");
-    rc = redis_db->String.NOP(redis_db, 0);
-    EMI_LOG("%s: String.NOP %s\n", __FUNCTION__, rc == REDIS_OK ? "success" : "failed");
+    redis_db->String.SET(redis_db, 0, "session", "halberdholder", -1, 10, REDIS_STRING_EX);
+    rc = redis_db->String.SET(redis_db, 0, "session", "other", -1, 0, REDIS_STRING_NX);
+    EMI_LOG("%s: String.SET NX %s\n", __FUNCTION__, rc > 0 ? "set" : "not set");
+    redis_db->String.APPEND(redis_db, 0, "session", ":online", -1);
+    rc = redis_db->String.GET(redis_db, 0, "session", value, sizeof(value));
+    EMI_LOG("String.GET\n");
+    EMI_LOG("\t%s\n", rc >= 0 ? value : "(nil)");
+    redis_db->String.INCRBY(redis_db, 0, "counter", 5, &counter);
+    EMI_LOG("String.INCRBY\n");
+    EMI_LOG("\t%lld\n", counter);
+    rc = redis_db->String.MGET(redis_db, 0, keys, 3, values, sizeof(values[0]), lens);
+    EMI_LOG("String.MGET\n");
+    for (i = 0; i < 3; ++i)
+    {
+        EMI_LOG("\t%s: %s\n", keys[i], lens[i] >= 0 ? values[i] : "(nil)");
+    }
+    redis_db->Key.DEL(redis_db, 0, "session");
+    redis_db->Key.DEL(redis_db, 0, "counter");
     EMI_LOG("\n");
 
 
@@ -59,14 +80,25 @@ int main(int argc, char **argv)
     }
     free(members);
     members = NULL;
-    rc = redis_db->Set.SSCAN(redis_db, 0, "set", "member*", INT_MAX, &members);
+    scan = redis_scan_create(redis_db, 0, REDIS_SCAN_SET, "set", "member*", 1, REDIS_FALSE);
     EMI_LOG("Set.SSCAN\n");
-    for (i = 0; i < rc; ++i)
+    if (scan)
     {
-        EMI_LOG("\t%s\n", members[i].member);
+        while ((rc = scan->next(scan, &members)) > 0)
+        {
+            for (i = 0; i < rc; ++i)
+            {
+                EMI_LOG("\t%s\n", members[i].member);
+            }
+            free(members);
+            members = NULL;
+        }
+        redis_scan_destroy(scan);
+    }
+    else
+    {
+        EMI_LOG("%s: create set scan failed\n", __FUNCTION__);
     }
-    free(members);
-    members = NULL;
     redis_db->Set.SREM(redis_db, 0, "set", "member1");
     redis_db->Set.SREM(redis_db, 0, "set", "member2");
     EMI_LOG("\n");
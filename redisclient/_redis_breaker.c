@@ -0,0 +1,145 @@
+#include <time.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+
+
+static long long _redis_breaker_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void _redis_breaker_trip(redis_client *c, long long now)
+{
+    EMI_LOG("%s: server[%s:%d%s] unhealthy, %d of %d calls failed, circuit open for %d ms\n", __FUNCTION__,
+             c->ip, c->port, c->path, c->breaker_failures, c->breaker_calls, c->breaker_open_ms);
+
+    __sync_lock_test_and_set(&c->breaker_state, REDIS_BREAKER_OPEN);
+    c->breaker_since = now;
+}
+
+static void _redis_breaker_reset(redis_client *c, long long now)
+{
+    c->breaker_since = now;
+    c->breaker_calls = 0;
+    c->breaker_failures = 0;
+}
+
+/**
+ * Called under c->lock before a command reaches the connection
+ *
+ * @return REDIS_TRUE if the command may go, REDIS_FALSE if it must fail at once
+ */
+int _redis_breaker_allow(redis_client *c)
+{
+    long long now = 0;
+
+    if (c->breaker_error_rate <= 0 || REDIS_BREAKER_CLOSED == c->breaker_state)
+    {
+        return REDIS_TRUE;
+    }
+
+    now = _redis_breaker_now();
+
+    if (REDIS_BREAKER_OPEN == c->breaker_state)
+    {
+        if (now - c->breaker_since < c->breaker_open_ms)
+        {
+            return REDIS_FALSE;
+        }
+
+        /* let probes through, their outcome closes or reopens the circuit */
+        __sync_lock_test_and_set(&c->breaker_state, REDIS_BREAKER_HALF_OPEN);
+        _redis_breaker_reset(c, now);
+    }
+
+    return REDIS_TRUE;
+}
+
+/**
+ * @return start time to pass to _redis_breaker_end
+ */
+long long _redis_breaker_begin(redis_client *c)
+{
+    return c->breaker_error_rate > 0 ? _redis_breaker_now() : 0;
+}
+
+/**
+ * Record outcome of a call, replies of any type are a success, as they prove the
+ * server healthy. Calls slower than breaker_slow_ms count as failures.
+ */
+void _redis_breaker_end(redis_client *c, long long start, int ok)
+{
+    long long now = 0;
+
+    if (c->breaker_error_rate <= 0)
+    {
+        return;
+    }
+
+    now = _redis_breaker_now();
+
+    if (ok && c->breaker_slow_ms > 0 && now - start > c->breaker_slow_ms)
+    {
+        ok = REDIS_FALSE;
+    }
+
+    switch (c->breaker_state)
+    {
+        case REDIS_BREAKER_HALF_OPEN:
+            if (!ok)
+            {
+                c->breaker_calls++;
+                c->breaker_failures++;
+                _redis_breaker_trip(c, now);
+            }
+            else if (++c->breaker_calls >= c->breaker_probes)
+            {
+                EMI_LOG("%s: server[%s:%d%s] healthy again, circuit closed\n", __FUNCTION__,
+                         c->ip, c->port, c->path);
+
+                __sync_lock_test_and_set(&c->breaker_state, REDIS_BREAKER_CLOSED);
+                _redis_breaker_reset(c, now);
+            }
+            break;
+
+        case REDIS_BREAKER_CLOSED:
+            if (now - c->breaker_since > REDIS_BREAKER_WINDOW)
+            {
+                _redis_breaker_reset(c, now);
+            }
+
+            c->breaker_calls++;
+            if (!ok)
+            {
+                c->breaker_failures++;
+            }
+
+            if (c->breaker_calls >= c->breaker_min_calls
+                && c->breaker_failures * 100 >= c->breaker_calls * c->breaker_error_rate)
+            {
+                _redis_breaker_trip(c, now);
+            }
+            break;
+
+        default:
+            /* a call admitted before the circuit opened */
+            break;
+    }
+}
+
+
+/**
+ * For threads that don't hold c->lock, e.g. picking a replica
+ *
+ * @return REDIS_TRUE if the circuit of c is open
+ */
+int _redis_breaker_open(redis_client *c)
+{
+    return REDIS_BREAKER_OPEN == __sync_fetch_and_add(&c->breaker_state, 0);
+}
@@ -1,8 +1,11 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/time.h>
+#include <poll.h>
 #include <hiredis.h>
 
 #include "redis_client.h"
@@ -10,36 +13,306 @@
 
 
 /**
- * When lost connection to server, 
- * the default interval to conenct to server is 1(sec)
+ * Retry interval(sec) of blocking commands when server is up but connecting failed
  */
 #define REDIS_TRY_CONNECT_INTERVAL  1
 
 
+/**
+ * New connection to server at ip:port or path, with the connect and command
+ * timeouts of rds_client
+ *
+ * @return NULL on failure
+ */
+static redisContext *__redis_open_at(redis_client *rds_client, const char *ip, int port, const char *path)
+{
+    redisContext *redis = NULL;
+    struct timeval tv;
+
+    tv.tv_sec = rds_client->connect_timeout / 1000;
+    tv.tv_usec = (rds_client->connect_timeout % 1000) * 1000;
+
+    if ('\0' != path[0])
+    {
+        redis = rds_client->connect_timeout > 0 ? redisConnectUnixWithTimeout(path, tv)
+                                                : redisConnectUnix(path);
+    }
+    else
+    {
+        redis = rds_client->connect_timeout > 0 ? redisConnectWithTimeout(ip, port, tv)
+                                                : redisConnect(ip, port);
+    }
+
+    if (!redis)
+    {
+        EMI_LOG("%s: failed on redisConnect[%s:%d%s]\n", __FUNCTION__, ip, port, path);
+
+        return NULL;
+    }
+    else if (0 != redis->err)
+    {
+        EMI_LOG("%s: failed on redisConnect[%s:%d%s]: %s\n", __FUNCTION__, ip, port, path, redis->errstr);
+        redisFree(redis);
+        return NULL;
+    }
+
+    /* the connect timeout stays on the socket unless replaced */
+    tv.tv_sec = rds_client->command_timeout / 1000;
+    tv.tv_usec = (rds_client->command_timeout % 1000) * 1000;
+
+    if (REDIS_OK != redisSetTimeout(redis, tv))
+    {
+        EMI_LOG("%s: failed on redisSetTimeout[%d ms]\n", __FUNCTION__, rds_client->command_timeout);
+        redisFree(redis);
+        return NULL;
+    }
+
+    return redis;
+}
+
+/**
+ * New connection to current endpoint of rds_client, it may be moved by Sentinel
+ */
+static redisContext *__redis_open(redis_client *rds_client)
+{
+    int port = 0;
+    char ip[sizeof(rds_client->ip)];
+    char path[sizeof(rds_client->path)];
+
+    pthread_mutex_lock(&rds_client->reconnect_lock);
+
+    memcpy(ip, rds_client->ip, sizeof(ip));
+    port = rds_client->port;
+    memcpy(path, rds_client->path, sizeof(path));
+
+    pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+    return __redis_open_at(rds_client, ip, port, path);
+}
+
+static void *__redis_reconnect_routine(void *arg)
+{
+    redis_client *rds_client = (redis_client *)arg;
+    redisContext *redis = NULL;
+    struct timeval now;
+    struct timespec deadline;
+    unsigned int seed = 0;
+    int delay = REDIS_RECONNECT_MIN, wait = 0;
+
+    gettimeofday(&now, NULL);
+    seed = (unsigned int)(now.tv_usec ^ (uintptr_t)rds_client);
+
+    pthread_mutex_lock(&rds_client->reconnect_lock);
+
+    while (rds_client->reconnecting)
+    {
+        /* full jitter in [delay/2, delay], clients of one server don't retry in step */
+        wait = delay / 2 + rand_r(&seed) % (delay / 2 + 1);
+
+        gettimeofday(&now, NULL);
+        deadline.tv_sec = now.tv_sec + wait / 1000;
+        deadline.tv_nsec = now.tv_usec * 1000 + (long)(wait % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        while (rds_client->reconnecting)
+        {
+            if (ETIMEDOUT == pthread_cond_timedwait(&rds_client->reconnect_cond, &rds_client->reconnect_lock, &deadline))
+            {
+                break;
+            }
+        }
+
+        if (!rds_client->reconnecting)
+        {
+            break;
+        }
+
+        pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+        redis = __redis_open(rds_client);
+
+        pthread_mutex_lock(&rds_client->reconnect_lock);
+
+        /* stopped, or endpoint moved while probing the old one */
+        if (!rds_client->reconnecting)
+        {
+            if (redis)
+            {
+                redisFree(redis);
+            }
+            break;
+        }
+
+        if (redis)
+        {
+            EMI_LOG("%s: server[%s:%d%s] is up again\n", __FUNCTION__, 
+                     rds_client->ip, rds_client->port, rds_client->path);
+
+            rds_client->standby = redis;
+            rds_client->down = 0;
+            rds_client->reconnecting = 0;
+            pthread_cond_broadcast(&rds_client->reconnect_cond);
+            break;
+        }
+
+        delay = delay * 2 > REDIS_RECONNECT_MAX ? REDIS_RECONNECT_MAX : delay * 2;
+    }
+
+    pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+    return NULL;
+}
+
+/**
+ * Take server as down and start reconnect thread if not running yet
+ */
+static void __redis_mark_down(redis_client *rds_client)
+{
+    pthread_mutex_lock(&rds_client->reconnect_lock);
+
+    rds_client->down = 1;
+
+    if (!rds_client->reconnecting)
+    {
+        /* previous one is done, it cleared reconnecting on its way out */
+        if (rds_client->reconnector_started)
+        {
+            pthread_join(rds_client->reconnector, NULL);
+            rds_client->reconnector_started = 0;
+        }
+
+        rds_client->reconnecting = 1;
+
+        if (0 != pthread_create(&rds_client->reconnector, NULL, __redis_reconnect_routine, rds_client))
+        {
+            EMI_LOG("%s: pthread_create failed, next command reconnects\n", __FUNCTION__);
+            rds_client->reconnecting = 0;
+            rds_client->down = 0;
+        }
+        else
+        {
+            rds_client->reconnector_started = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&rds_client->reconnect_lock);
+}
+
 /**
  * when rds_client->redis == NULL call this function
  */
 static int __redis_connect(redis_client *rds_client)
 {
-    rds_client->redis = redisConnect(rds_client->ip, rds_client->port);
-    if (!rds_client->redis)
+    long long start = 0;
+
+    pthread_mutex_lock(&rds_client->reconnect_lock);
+
+    if (rds_client->standby)
+    {
+        rds_client->redis = rds_client->standby;
+        rds_client->standby = NULL;
+    }
+    else if (rds_client->down)
     {
-        EMI_LOG("%s: failed on redisConnect[%s:%d]\n", __FUNCTION__, rds_client->ip, rds_client->port);
+        pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+        EMI_LOG("%s: server[%s:%d%s] is down, reconnecting in background\n", __FUNCTION__, 
+                 rds_client->ip, rds_client->port, rds_client->path);
 
         return REDIS_ERR;
     }
-    else if (0 != rds_client->redis->err)
+
+    pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+    rds_client->stale = 0;
+
+    if (!rds_client->redis)
     {
-        EMI_LOG("%s: failed on redisConnect[%s:%d]: %s\n", __FUNCTION__, 
-                       rds_client->ip, rds_client->port, rds_client->redis->errstr);
-        redisFree(rds_client->redis);
-        rds_client->redis = NULL;
-        return REDIS_ERR;
+        start = _redis_breaker_begin(rds_client);
+        rds_client->redis = __redis_open(rds_client);
+        _redis_breaker_end(rds_client, start, NULL != rds_client->redis);
+        if (!rds_client->redis)
+        {
+            __redis_mark_down(rds_client);
+            return REDIS_ERR;
+        }
     }
 
     return REDIS_OK;
 }
 
+/**
+ * Point rds_client at a new primary, commands drop the old connection and go on
+ * with a connection made here, or a new one if it failed
+ */
+void _redis_endpoint_switch(redis_client *rds_client, const char *ip, int port)
+{
+    redisContext *redis = NULL;
+
+    redis = __redis_open_at(rds_client, ip, port, "");
+
+    pthread_mutex_lock(&rds_client->reconnect_lock);
+
+    snprintf(rds_client->ip, sizeof(rds_client->ip), "%s", ip);
+    rds_client->port = port;
+    rds_client->path[0] = '\0';
+
+    if (rds_client->standby)
+    {
+        redisFree(rds_client->standby);
+    }
+
+    rds_client->standby = redis;
+    rds_client->switched = 1;
+
+    /* backoff against the old primary is over */
+    rds_client->down = 0;
+    rds_client->reconnecting = 0;
+    pthread_cond_broadcast(&rds_client->reconnect_cond);
+
+    pthread_mutex_unlock(&rds_client->reconnect_lock);
+}
+
+/**
+ * For threads that don't hold rds_client->lock, e.g. picking a replica
+ */
+int _redis_server_down(redis_client *rds_client)
+{
+    int down = 0;
+
+    pthread_mutex_lock(&rds_client->reconnect_lock);
+    down = rds_client->down;
+    pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+    return down;
+}
+
+void _redis_reconnect_stop(redis_client *rds_client)
+{
+    pthread_mutex_lock(&rds_client->reconnect_lock);
+
+    rds_client->reconnecting = 0;
+    pthread_cond_broadcast(&rds_client->reconnect_cond);
+
+    pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+    if (rds_client->reconnector_started)
+    {
+        pthread_join(rds_client->reconnector, NULL);
+        rds_client->reconnector_started = 0;
+    }
+
+    if (rds_client->standby)
+    {
+        redisFree(rds_client->standby);
+        rds_client->standby = NULL;
+    }
+}
+
 /**
  * when rds_client->redis == NULL or rds_client->db_idx != index call this function 
  */
@@ -80,6 +353,21 @@ static int __redis_select(redis_client *rds_client, int index)
     return REDIS_OK;
 }
 
+/**
+ * redisCommand, with its outcome recorded by the circuit breaker
+ */
+static redisReply *__redis_command(redis_client *c, const char *cmd)
+{
+    long long start = 0;
+    redisReply *reply = NULL;
+
+    start = _redis_breaker_begin(c);
+    reply = (redisReply *)redisCommand(c->redis, cmd);
+    _redis_breaker_end(c, start, NULL != reply);
+
+    return reply;
+}
+
 static int __redis_parse_reply(redisReply *reply, redis_member **o_members)
 {
     int i = 0;
@@ -171,6 +459,62 @@ static int __redis_parse_reply(redisReply *reply, redis_member **o_members)
 
 int _redis_try_connect_nonblock(redis_client *rds_client, int index)
 {
+    redisReply *reply = NULL;
+    struct pollfd pfd;
+
+    /* only routed reads look at it */
+    index &= ~REDIS_READ_PRIMARY;
+
+    if (rds_client->switched)
+    {
+        pthread_mutex_lock(&rds_client->reconnect_lock);
+        rds_client->switched = 0;
+        pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+        if (rds_client->redis)
+        {
+            EMI_LOG("%s: primary moved to [%s:%d], dropping old connection\n", __FUNCTION__, 
+                     rds_client->ip, rds_client->port);
+
+            redisFree(rds_client->redis);
+            rds_client->redis = NULL;
+            rds_client->db_index = -1;
+        }
+    }
+
+    /* replies of hedged reads answered first elsewhere, a slow one isn't waited for */
+    while (rds_client->stale > 0 && rds_client->redis)
+    {
+        reply = NULL;
+        pfd.fd = rds_client->redis->fd;
+        pfd.events = POLLIN;
+
+        if (REDIS_OK != redisGetReplyFromReader(rds_client->redis, (void **)&reply)
+            || (!reply && (1 != poll(&pfd, 1, 0) || REDIS_OK != redisBufferRead(rds_client->redis))))
+        {
+            EMI_LOG("%s: dropping connection with %d replies of lost hedges pending\n", __FUNCTION__, 
+                     rds_client->stale);
+
+            redisFree(rds_client->redis);
+            rds_client->redis = NULL;
+            rds_client->db_index = -1;
+            break;
+        }
+
+        if (reply)
+        {
+            freeReplyObject(reply);
+            rds_client->stale--;
+        }
+    }
+
+    if (!_redis_breaker_allow(rds_client))
+    {
+        EMI_LOG("%s: circuit of server[%s:%d%s] is open, fail fast\n", __FUNCTION__, 
+                 rds_client->ip, rds_client->port, rds_client->path);
+        return REDIS_ERR;
+    }
+
     if (!rds_client->redis)
     {
         if (REDIS_OK != __redis_connect(rds_client))
@@ -178,6 +522,9 @@ int _redis_try_connect_nonblock(redis_client *rds_client, int index)
             return REDIS_ERR;
         }
 
+        /* a new server may not have our scripts cached */
+        _redis_script_reload(rds_client);
+
         if (REDIS_OK != __redis_select(rds_client, index))
         {
             return REDIS_ERR;
@@ -195,11 +542,68 @@ int _redis_try_connect_nonblock(redis_client *rds_client, int index)
     return REDIS_OK;
 }
 
+/**
+ * Release every level of REDIS_LOCK the caller holds, @return the depth to restore
+ */
+static int _redis_lock_release(redis_client *rds_client)
+{
+    int depth = 0;
+
+    if (rds_client->origin)
+    {
+        return 0;
+    }
+
+    depth = rds_client->lock_depth;
+    while (rds_client->lock_depth > 0)
+    {
+        REDIS_UNLOCK(rds_client);
+    }
+
+    return depth;
+}
+
+static void _redis_lock_restore(redis_client *rds_client, int depth)
+{
+    while (depth-- > 0)
+    {
+        REDIS_LOCK(rds_client);
+    }
+}
+
+/**
+ * REDIS_LOCK is dropped, however deeply the caller nested it, while waiting for the
+ * server so other threads fail fast on the client instead of queueing behind us
+ * for the whole outage
+ */
 void _redis_try_connect_block(redis_client *rds_client, int index)
 {
+    int depth = 0;
+
     while (REDIS_OK != _redis_try_connect_nonblock(rds_client, index))
     {
-        sleep(REDIS_TRY_CONNECT_INTERVAL);
+        depth = _redis_lock_release(rds_client);
+
+        pthread_mutex_lock(&rds_client->reconnect_lock);
+
+        if (!rds_client->down || !rds_client->reconnecting)
+        {
+            /* server is up but refused us, e.g. SELECT failed */
+            pthread_mutex_unlock(&rds_client->reconnect_lock);
+            sleep(REDIS_TRY_CONNECT_INTERVAL);
+            _redis_lock_restore(rds_client, depth);
+            continue;
+        }
+
+        /* reconnect thread wakes us when server is up again */
+        while (rds_client->down && rds_client->reconnecting)
+        {
+            pthread_cond_wait(&rds_client->reconnect_cond, &rds_client->reconnect_lock);
+        }
+
+        pthread_mutex_unlock(&rds_client->reconnect_lock);
+
+        _redis_lock_restore(rds_client, depth);
     }
 }
 
@@ -214,7 +618,7 @@ int _redis_command_status(redis_client *c, const char *cmd)
 
     EMI_LOG("%s: cmd[%s]\n", __FUNCTION__, cmd);
 
-    reply = (redisReply *)redisCommand(c->redis, cmd);
+    reply = __redis_command(c, cmd);
     if (!reply)
     {
         EMI_LOG("%s: redisCommand error: %s\n", __FUNCTION__, 
@@ -256,7 +660,7 @@ int _redis_command_int(redis_client *c, const char *cmd)
 
     EMI_LOG("%s: cmd[%s]\n", __FUNCTION__, cmd);
 
-    reply = (redisReply *)redisCommand(c->redis, cmd);
+    reply = __redis_command(c, cmd);
     if (!reply)
     {
         EMI_LOG("%s: redisCommand error: %s\n", __FUNCTION__, 
@@ -306,7 +710,7 @@ char *_redis_command_string(redis_client *c, const char *cmd)
 
     EMI_LOG("%s: cmd[%s]\n", __FUNCTION__, cmd);
 
-    reply = (redisReply *)redisCommand(c->redis, cmd);
+    reply = __redis_command(c, cmd);
     if (!reply)
     {
         EMI_LOG("%s: redisCommand error: %s\n", __FUNCTION__, 
@@ -329,6 +733,8 @@ char *_redis_command_string(redis_client *c, const char *cmd)
         return NULL;
     }
 
+    _redis_reply_inflate(c, reply);
+
     EMI_LOG("%s: redisCommand success\n", __FUNCTION__);
 
     if (REDIS_REPLY_STRING != reply->type)
@@ -359,6 +765,16 @@ on_ret:
     return str;
 }
 
+/**
+ * Parse an array or single reply to strings, for callers that own the reply
+ *
+ * @return counts of strings, < 0 on failure
+ */
+int _redis_reply_members(redisReply *reply, redis_member **o_members)
+{
+    return __redis_parse_reply(reply, o_members);
+}
+
 /**
  * @return a few strings and the counts
  * -  <= 0: no data or command failed
@@ -374,7 +790,7 @@ int _redis_command_strings(redis_client *c, const char *cmd, int scan_flag, redi
 
     EMI_LOG("%s: cmd[%s]\n", __FUNCTION__, cmd);
 
-    reply = (redisReply *)redisCommand(c->redis, cmd);
+    reply = __redis_command(c, cmd);
     if (!reply)
     {
         EMI_LOG("%s: redisCommand error: %s\n", __FUNCTION__, 
@@ -399,6 +815,8 @@ int _redis_command_strings(redis_client *c, const char *cmd, int scan_flag, redi
 
     EMI_LOG("%s: redisCommand success\n", __FUNCTION__);
 
+    _redis_reply_inflate(c, reply);
+
     if (REDIS_FALSE == scan_flag)
     {
         count = __redis_parse_reply(reply, o_members);
@@ -446,7 +864,7 @@ int _redis_command_score_strings(redis_client *c, const char *cmd, int scan_flag
 
     EMI_LOG("%s: cmd[%s]\n", __FUNCTION__, cmd);
 
-    reply = (redisReply *)redisCommand(c->redis, cmd);
+    reply = __redis_command(c, cmd);
     if (!reply)
     {
         EMI_LOG("%s: redisCommand error: %s\n", __FUNCTION__, 
@@ -471,6 +889,8 @@ int _redis_command_score_strings(redis_client *c, const char *cmd, int scan_flag
 
     EMI_LOG("%s: redisCommand success\n", __FUNCTION__);
 
+    _redis_reply_inflate(c, reply);
+
     if (REDIS_FALSE == scan_flag)
     {
         count = __redis_parse_reply(reply, &members);
@@ -538,3 +958,510 @@ on_ret:
 
 
 
+
+/**
+ * Binary safe variant of the command helpers, every argument is sent as is.
+ *
+ * @return reply object, caller must freeReplyObject it
+ * -  NULL: command failed or server replied an error
+ *
+ * @param
+ * argvlen: length of each argument, NULL if all arguments are C strings
+ */
+redisReply *_redis_command_argv(redis_client *c, int argc, const char **argv, const size_t *argvlen)
+{
+    long long start = 0;
+    redisReply *reply = NULL;
+
+    EMI_LOG("%s: cmd[%s %s ...], argc[%d]\n", __FUNCTION__, argv[0], argc > 1 ? argv[1] : "", argc);
+
+    start = _redis_breaker_begin(c);
+    reply = (redisReply *)redisCommandArgv(c->redis, argc, argv, argvlen);
+    _redis_breaker_end(c, start, NULL != reply);
+    if (!reply)
+    {
+        EMI_LOG("%s: redisCommandArgv error: %s\n", __FUNCTION__, 
+                 REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr);
+
+        redisFree(c->redis);
+        c->redis = NULL;
+        c->db_index = -1;
+
+        return NULL;
+    }
+
+    if (REDIS_REPLY_ERROR == reply->type)
+    {
+        EMI_LOG("%s: redisCommandArgv reply error: %s\n", 
+                   __FUNCTION__, reply->str ? reply->str : NULL);
+
+        freeReplyObject(reply);
+
+        return NULL;
+    }
+
+    _redis_reply_inflate(c, reply);
+
+    EMI_LOG("%s: redisCommandArgv success\n", __FUNCTION__);
+
+    return reply;
+}
+
+/**
+ * Append a command to pipeline, the first command of pipeline selects database
+ */
+int _redis_command_argv_p(redis_client *this, int index, int argc, const char **argv, const size_t *argvlen)
+{
+    int rc = REDIS_OK;
+
+    if (0 == this->pipeline)
+    {
+        rc = _redis_try_connect_nonblock(this, index);
+        if (REDIS_OK != rc)
+        {
+            EMI_LOG("%s: pipeline mode, _redis_try_connect_nonblock failed\n", __FUNCTION__);
+            return rc;
+        }
+    }
+    else if (this->db_index != index)
+    {
+        EMI_LOG("%s: pipeline mode, can't change database index from %d to %d\n",
+                 __FUNCTION__, this->db_index, index);
+        return REDIS_ERR;
+    }
+
+    rc = redisAppendCommandArgv(this->redis, argc, argv, argvlen);
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: pipeline mode, redisAppendCommandArgv error: %s\n", __FUNCTION__,
+                 REDIS_ERR_IO == this->redis->err ? strerror(errno) : this->redis->errstr);
+        return rc;
+    }
+
+    this->pipeline++;
+
+    return rc;
+}
+
+/**
+ * Send a variadic command "head... args..." split into chunks of at most 
+ * c->chunk_args arguments, chunk size is a multiple of `group' so pairs like
+ * score/member are never split. In single mode all chunks are pipelined and
+ * sent in one round trip, in pipeline mode they are appended to pipeline.
+ *
+ * @return sum of integer replies, 0 in pipeline mode, < 0 on failure
+ */
+int _redis_command_chunked(redis_client *c, int index, const char **head, int nhead,
+                               const char **args, int nargs, int group)
+{
+    int i = 0, n = 0, chunk = 0, nchunks = 0, rc = 0;
+    const char **argv = NULL;
+    redisReply *reply = NULL;
+
+    chunk = c->chunk_args - c->chunk_args % group;
+    if (chunk < group)
+    {
+        chunk = group;
+    }
+
+    argv = (const char **)malloc(sizeof(char *) * (nhead + chunk));
+    if (!argv)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return -1;
+    }
+
+    memcpy(argv, head, sizeof(char *) * nhead);
+
+    if (c->pipeline < 0 && REDIS_OK != _redis_try_connect_nonblock(c, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        free(argv);
+        return -1;
+    }
+
+    for (i = 0; i < nargs; i += n)
+    {
+        n = nargs - i < chunk ? nargs - i : chunk;
+        memcpy(argv + nhead, args + i, sizeof(char *) * n);
+
+        if (c->pipeline >= 0)
+        {
+            if (REDIS_OK != _redis_command_argv_p(c, index, nhead + n, argv, NULL))
+            {
+                rc = -1;
+                break;
+            }
+        }
+        else
+        {
+            if (REDIS_OK != redisAppendCommandArgv(c->redis, nhead + n, argv, NULL))
+            {
+                /* chunks appended so far would answer later commands, drop them with the connection */
+                EMI_LOG("%s: redisAppendCommandArgv failed at chunk %d\n", __FUNCTION__, nchunks);
+
+                redisFree(c->redis);
+                c->redis = NULL;
+                c->db_index = -1;
+
+                free(argv);
+                return -1;
+            }
+            nchunks++;
+        }
+    }
+
+    free(argv);
+
+    EMI_LOG("%s: cmd[%s %s ...], args[%d], chunks[%d]\n", __FUNCTION__, head[0], head[1], nargs, nchunks);
+
+    for (i = 0; i < nchunks; ++i)
+    {
+        if (REDIS_OK != redisGetReply(c->redis, (void **)&reply))
+        {
+            EMI_LOG("%s: redisGetReply error: %s\n", __FUNCTION__, 
+                     REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr);
+
+            redisFree(c->redis);
+            c->redis = NULL;
+            c->db_index = -1;
+
+            return -1;
+        }
+
+        if (REDIS_REPLY_INTEGER == reply->type)
+        {
+            if (rc >= 0)
+            {
+                rc += reply->integer;
+            }
+        }
+        else
+        {
+            EMI_LOG("%s: chunk %d reply error: %s\n", __FUNCTION__, i, 
+                     REDIS_REPLY_ERROR == reply->type ? reply->str : "not integer");
+            rc = -1;
+        }
+
+        freeReplyObject(reply);
+    }
+
+    return rc;
+}
+
+/**
+ * @return count
+ * -  >= 0 : count
+ * -  <  0 : command failed
+ */
+int _redis_command_argv_int(redis_client *c, int argc, const char **argv, const size_t *argvlen)
+{
+    int rc = -1;
+    redisReply *reply = NULL;
+
+    reply = _redis_command_argv(c, argc, argv, argvlen);
+    if (!reply)
+    {
+        return -1;
+    }
+
+    if (REDIS_REPLY_INTEGER == reply->type)
+    {
+        rc = reply->integer;
+    }
+
+    freeReplyObject(reply);
+
+    return rc;
+}
+
+/**
+ * @return a string
+ * -  NULL: nil reply or command failed
+ */
+char *_redis_command_argv_string(redis_client *c, int argc, const char **argv, const size_t *argvlen)
+{
+    char *str = NULL;
+    redisReply *reply = NULL;
+
+    reply = _redis_command_argv(c, argc, argv, argvlen);
+    if (!reply)
+    {
+        return NULL;
+    }
+
+    if (REDIS_REPLY_STRING != reply->type)
+    {
+        EMI_LOG("%s: redisCommandArgv reply type: %d\n", __FUNCTION__, reply->type);
+        goto on_ret;
+    }
+
+    str = malloc(reply->len + 1);
+    if (!str)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    memcpy(str, reply->str, reply->len);
+    str[reply->len] = '\0';
+
+on_ret:
+    freeReplyObject(reply);
+
+    return str;
+}
+
+
+/**
+ * A read in flight, see _redis_flight_begin
+ */
+struct __redis_flight
+{
+    struct __redis_flight *next;
+    int          index;
+    const char  *cmd;
+    const void  *tag;               /* Tells apart reads whose results decode differently */
+    char        *key;
+    int          refs;              /* Leader and waiters */
+    int          done;
+    int          rc;
+    void        *result;
+    size_t       size;
+};
+
+static void __redis_flight_release(redis_client *c, redis_flight *f)
+{
+    if (0 == --f->refs)
+    {
+        free(f->result);
+        free(f->key);
+        free(f);
+    }
+}
+
+/**
+ * Join the read of (index, cmd, key, tag) in flight, or start one.
+ *
+ * Leader runs the read itself and must call _redis_flight_end, others call 
+ * _redis_flight_wait to get a copy of its result instead of a round trip of their own.
+ * Must not be called while holding c->lock, the leader may be waiting for it.
+ *
+ * @return NULL if out of memory, caller just runs the read
+ */
+redis_flight *_redis_flight_begin(redis_client *c, int index, const char *cmd, const char *key, const void *tag, int *o_leader)
+{
+    redis_flight *f = NULL;
+
+    /* thread-local handles share the flights of their client */
+    c = c->origin ? c->origin : c;
+
+    pthread_mutex_lock(&c->flight_lock);
+
+    for (f = c->flights; f; f = f->next)
+    {
+        if (f->index == index && f->tag == tag && 0 == strcmp(f->cmd, cmd) && 0 == strcmp(f->key, key))
+        {
+            f->refs++;
+            *o_leader = REDIS_FALSE;
+            goto on_ret;
+        }
+    }
+
+    f = (redis_flight *)calloc(1, sizeof(redis_flight));
+    if (!f || !(f->key = strdup(key)))
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        free(f);
+        f = NULL;
+        goto on_ret;
+    }
+
+    f->index = index;
+    f->cmd = cmd;
+    f->tag = tag;
+    f->refs = 1;
+    f->next = c->flights;
+    c->flights = f;
+
+    *o_leader = REDIS_TRUE;
+
+on_ret:
+    pthread_mutex_unlock(&c->flight_lock);
+
+    return f;
+}
+
+/**
+ * Leader publishes result of the read, `size' bytes of `result' are copied for waiters.
+ * Called before the leader releases the connection lock, so a write that took the lock
+ * after the read never finds the flight.
+ */
+void _redis_flight_end(redis_client *c, redis_flight *f, int rc, const void *result, size_t size)
+{
+    redis_flight **pf = NULL;
+
+    c = c->origin ? c->origin : c;
+
+    pthread_mutex_lock(&c->flight_lock);
+
+    /* later reads start a new flight, they may be issued after a write */
+    for (pf = &c->flights; *pf != f; pf = &(*pf)->next)
+    {
+        ;
+    }
+    *pf = f->next;
+
+    f->rc = rc;
+    if (result && size > 0 && f->refs > 1)
+    {
+        f->result = malloc(size);
+        if (f->result)
+        {
+            memcpy(f->result, result, size);
+            f->size = size;
+        }
+        else
+        {
+            EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+            f->rc = -1;
+        }
+    }
+
+    f->done = REDIS_TRUE;
+    pthread_cond_broadcast(&c->flight_cond);
+
+    __redis_flight_release(c, f);
+
+    pthread_mutex_unlock(&c->flight_lock);
+}
+
+/**
+ * Wait for leader of flight, *o_result is a copy of its result, caller must free it
+ *
+ * @return rc of the leader
+ */
+int _redis_flight_wait(redis_client *c, redis_flight *f, void **o_result, size_t *o_size)
+{
+    int rc = -1;
+
+    c = c->origin ? c->origin : c;
+
+    *o_result = NULL;
+    *o_size = 0;
+
+    pthread_mutex_lock(&c->flight_lock);
+
+    while (!f->done)
+    {
+        pthread_cond_wait(&c->flight_cond, &c->flight_lock);
+    }
+
+    rc = f->rc;
+    if (f->size > 0)
+    {
+        *o_result = malloc(f->size);
+        if (*o_result)
+        {
+            memcpy(*o_result, f->result, f->size);
+            *o_size = f->size;
+        }
+        else
+        {
+            EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+            rc = -1;
+        }
+    }
+
+    __redis_flight_release(c, f);
+
+    pthread_mutex_unlock(&c->flight_lock);
+
+    return rc;
+}
+
+/**
+ * Field name of member on the wire, its short code once the table is compact
+ */
+const char *_redis_member_wire(const redis_hash_member *m)
+{
+    return '\0' != m->code[0] ? m->code : m->member;
+}
+
+/**
+ * @return descriptor of member named `name' on the wire, NULL if not found
+ *
+ * @param
+ * len: length of name, name need not be '\0' terminated
+ */
+redis_hash_member *_redis_member_find(redis_hash_member *hdesc_tbls, const char *name, int len)
+{
+    int i = 0;
+    const char *wire = NULL;
+
+    for (i = 0; hdesc_tbls[i].member; ++i)
+    {
+        wire = _redis_member_wire(&hdesc_tbls[i]);
+        if (0 == strncmp(wire, name, len) && '\0' == wire[len])
+        {
+            return &hdesc_tbls[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Value of member as a command argument, strings are referenced in place.
+ *
+ * @return length of argument
+ * -  <  0: empty string, member should be skipped
+ *
+ * @param
+ * buf  : storage of formatted integer
+ * o_arg: out argument, points to buf or into data
+ */
+int _redis_member_encode(const redis_hash_member *m, const void *data, char *buf, int size, const char **o_arg)
+{
+    const char *str = NULL;
+
+    if (REDIS_INT == m->data_type)
+    {
+        *o_arg = buf;
+        return snprintf(buf, size, "%d", *(int *)(data + m->offset));
+    }
+
+    str = (const char *)(data + m->offset);
+    if ('\0' == str[0])
+    {
+        return -1;
+    }
+
+    *o_arg = str;
+
+    return strnlen(str, m->data_size);
+}
+
+/**
+ * Store a reply value into member, value must be '\0' terminated like hiredis strings
+ */
+void _redis_member_decode(const redis_hash_member *m, void *data, const char *value, int len)
+{
+    char *str = NULL;
+
+    if (REDIS_INT == m->data_type)
+    {
+        *(int *)(data + m->offset) = atoi(value);
+        return;
+    }
+
+    if (m->data_size <= 0)
+    {
+        return;
+    }
+
+    str = (char *)(data + m->offset);
+    len = len < m->data_size - 1 ? len : m->data_size - 1;
+    memcpy(str, value, len);
+    str[len] = '\0';
+}
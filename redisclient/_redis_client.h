@@ -3,19 +3,126 @@
 #define ____REDIS_CLIENT_H
 
 
+#include <stdarg.h>
+#include <pthread.h>
+#include <hiredis.h>
+
 #include "redis_types.h"
+#include "redis_hash_desc.h"
+#include "redis_future.h"
+
+
+/**
+ * Lock of a client around its connection, thread-local handles (see redis_client_local)
+ * are used by their thread only and take none
+ */
+#define REDIS_LOCK(c)       do { if (!(c)->origin) { pthread_mutex_lock(&(c)->lock); (c)->lock_depth++; } } while (0)
+#define REDIS_UNLOCK(c)     do { if (!(c)->origin) { (c)->lock_depth--; pthread_mutex_unlock(&(c)->lock); } } while (0)
+
 
+redis_client *_redis_client_clone(redis_client *this);
 
 int _redis_try_connect_nonblock(redis_client *rds_client, int index);
 void _redis_try_connect_block(redis_client *rds_client, int index);
+void _redis_reconnect_stop(redis_client *rds_client);
+int _redis_server_down(redis_client *rds_client);
+void _redis_endpoint_switch(redis_client *rds_client, const char *ip, int port);
+
+int _redis_sentinel_start(redis_client *c, const char *name, const char **ips, const int *ports, int n);
+void _redis_sentinel_follow(redis_client *c, redis_client *follower);
+void _redis_sentinel_stop(redis_client *c);
+
+redis_client *_redis_replica_pick(redis_client *this, int *index, long long *o_start);
+void _redis_replica_done(redis_client *this, redis_client *conn, long long start);
+int _redis_replica_strings(redis_client *this, redis_client *conn, int index, const char *cmd, redis_member **o_members);
+
+int _redis_breaker_allow(redis_client *c);
+long long _redis_breaker_begin(redis_client *c);
+void _redis_breaker_end(redis_client *c, long long start, int ok);
+int _redis_breaker_open(redis_client *c);
+void _redis_script_reload(redis_client *c);
+void _redis_script_copy(redis_client *dst, redis_client *src);
+void _redis_hash_cache_invalidate(redis_client *this, int index, const char *key);
+int _redis_hash_cache_flush(redis_client *this);
+
+int _redis_compress(redis_client *c, const char *value, size_t len, char **o_buf, size_t *o_len);
+void _redis_compress_argv(redis_client *c, int argc, const char **argv, size_t *argvlen, int first, int step, char **bufs);
+void _redis_compress_release(int argc, char **bufs);
+void _redis_reply_inflate(redis_client *c, redisReply *reply);
 
 
 int _redis_command_status(redis_client *c, const char *cmd);
 int _redis_command_int(redis_client *c, const char *cmd);
 char *_redis_command_string(redis_client *c, const char *cmd);
+int _redis_reply_members(redisReply *reply, redis_member **o_members);
 int _redis_command_strings(redis_client *c, const char *cmd, int scan_flag, redis_member **o_members);
 int _redis_command_score_strings(redis_client *c, const char *cmd, int scan_flag, redis_score_member **o_members);
 
+redisReply *_redis_command_argv(redis_client *c, int argc, const char **argv, const size_t *argvlen);
+int _redis_command_argv_p(redis_client *c, int index, int argc, const char **argv, const size_t *argvlen);
+int _redis_command_chunked(redis_client *c, int index, const char **head, int nhead,
+                               const char **args, int nargs, int group);
+int _redis_command_argv_int(redis_client *c, int argc, const char **argv, const size_t *argvlen);
+char *_redis_command_argv_string(redis_client *c, int argc, const char **argv, const size_t *argvlen);
+
+struct __redis_flight;
+typedef struct __redis_flight redis_flight;
+redis_flight *_redis_flight_begin(redis_client *c, int index, const char *cmd, const char *key, const void *tag, int *o_leader);
+void _redis_flight_end(redis_client *c, redis_flight *f, int rc, const void *result, size_t size);
+int _redis_flight_wait(redis_client *c, redis_flight *f, void **o_result, size_t *o_size);
+
+/**
+ * Thread in redis_future_wait_any, woken by any of the futures it waits on
+ */
+struct __redis_future_waiter
+{
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    int                 fired;
+};
+
+struct __redis_future_link
+{
+    struct __redis_future_link *next;
+    struct __redis_future_waiter *waiter;
+};
+
+/**
+ * Command submitted to run in the background, see redis_submit
+ */
+struct __redis_future
+{
+    redis_future       *next;                   /* Submission stack, then in-flight list */
+    char               *cmd;                    /* Formatted by submitter, freed once appended */
+    int                 len;
+    int                 index;
+    int                 skip;                   /* Replies that come before its own, SELECT */
+
+    pthread_mutex_t     lock;                   /* Guards all below */
+    pthread_cond_t      cond;
+    int                 refs;                   /* Caller and I/O thread */
+    int                 done;
+    redisReply         *reply;
+    redis_future_callback callback;
+    void               *callback_arg;
+    struct __redis_future_link *waiters;
+    redis_submit       *owner;                  /* Submitter it was pushed to */
+    void              (*wake)(void *arg);       /* Resumes the coroutine waiting on it */
+    void               *wake_arg;
+};
+redis_future *_redis_future_create(char *cmd, int len, int index);
+void _redis_future_complete(redis_future *f, redisReply *reply);
+void _redis_future_release(redis_future *f);
+
+redis_future *_redis_submit_vcommand(redis_submit *this, int index, const char *format, va_list ap);
+void _redis_submit_timeout(redis_submit *this);
+int _redis_coroutine_await(redis_future *f);
+
+const char *_redis_member_wire(const redis_hash_member *m);
+redis_hash_member *_redis_member_find(redis_hash_member *hdesc_tbls, const char *name, int len);
+int _redis_member_encode(const redis_hash_member *m, const void *data, char *buf, int size, const char **o_arg);
+void _redis_member_decode(const redis_hash_member *m, void *data, const char *value, int len);
+
 
 #endif
 
@@ -0,0 +1,416 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+
+
+/**
+ * Compressed value: 4 magic bytes, original length and FNV-1a checksum of the original,
+ * both 4 bytes little endian, then the LZ4 block. A plain value is only misread if it
+ * starts with the magic, carries a plausible length, decodes to exactly that length and
+ * the checksum matches, which is why reads are inflated on opted-in clients only.
+ */
+#define REDIS_COMPRESS_MAGIC        "\xffRLZ"
+#define REDIS_COMPRESS_MAGIC_LEN    4
+#define REDIS_COMPRESS_HEADER_LEN   12
+
+/**
+ * Shorter values never pay off the header
+ */
+#define REDIS_COMPRESS_MIN_LEN      32
+
+#define REDIS_LZ_HASH_LOG           12
+#define REDIS_LZ_MIN_MATCH          4
+#define REDIS_LZ_MF_LIMIT           12          /* Last match starts at least this far from end */
+#define REDIS_LZ_LAST_LITERALS      5           /* Last bytes are always literals */
+#define REDIS_LZ_MAX_OFFSET         65535
+
+
+static uint32_t _redis_lz_read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static uint32_t _redis_lz_checksum(const unsigned char *p, size_t len)
+{
+    size_t i = 0;
+    uint32_t h = 2166136261u;
+
+    for (i = 0; i < len; ++i)
+    {
+        h = (h ^ p[i]) * 16777619u;
+    }
+
+    return h;
+}
+
+static void _redis_lz_write32(unsigned char *p, uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t _redis_lz_read32_le(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int _redis_lz_put_length(unsigned char *op, int len)
+{
+    int n = 0;
+
+    while (len >= 255)
+    {
+        op[n++] = 255;
+        len -= 255;
+    }
+
+    op[n++] = (unsigned char)len;
+
+    return n;
+}
+
+/**
+ * LZ4 block format, greedy single probe hash, like LZ4 level 1
+ *
+ * @return bytes written to dst, < 0 if it doesn't fit in cap
+ */
+static int _redis_lz_compress(const unsigned char *src, int n, unsigned char *dst, int cap)
+{
+    int ip = 0, op = 0, anchor = 0, ref = 0, lit = 0, mlen = 0, token = 0;
+    uint32_t seq = 0, h = 0;
+    int table[1 << REDIS_LZ_HASH_LOG];
+
+    memset(table, 0xff, sizeof(table));
+
+    while (ip + REDIS_LZ_MF_LIMIT < n)
+    {
+        seq = _redis_lz_read32(src + ip);
+        h = (seq * 2654435761u) >> (32 - REDIS_LZ_HASH_LOG);
+        ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > REDIS_LZ_MAX_OFFSET || _redis_lz_read32(src + ref) != seq)
+        {
+            ip++;
+            continue;
+        }
+
+        mlen = REDIS_LZ_MIN_MATCH;
+        while (ip + mlen < n - REDIS_LZ_LAST_LITERALS && src[ref + mlen] == src[ip + mlen])
+        {
+            mlen++;
+        }
+
+        lit = ip - anchor;
+        if (op + 1 + lit / 255 + 1 + lit + 2 + (mlen - REDIS_LZ_MIN_MATCH) / 255 + 1 > cap)
+        {
+            return -1;
+        }
+
+        token = op++;
+
+        if (lit >= 15)
+        {
+            dst[token] = 15 << 4;
+            op += _redis_lz_put_length(dst + op, lit - 15);
+        }
+        else
+        {
+            dst[token] = lit << 4;
+        }
+
+        memcpy(dst + op, src + anchor, lit);
+        op += lit;
+
+        dst[op++] = (ip - ref) & 0xff;
+        dst[op++] = (ip - ref) >> 8;
+
+        if (mlen - REDIS_LZ_MIN_MATCH >= 15)
+        {
+            dst[token] |= 15;
+            op += _redis_lz_put_length(dst + op, mlen - REDIS_LZ_MIN_MATCH - 15);
+        }
+        else
+        {
+            dst[token] |= mlen - REDIS_LZ_MIN_MATCH;
+        }
+
+        ip += mlen;
+        anchor = ip;
+    }
+
+    lit = n - anchor;
+    if (op + 1 + lit / 255 + 1 + lit > cap)
+    {
+        return -1;
+    }
+
+    token = op++;
+
+    if (lit >= 15)
+    {
+        dst[token] = 15 << 4;
+        op += _redis_lz_put_length(dst + op, lit - 15);
+    }
+    else
+    {
+        dst[token] = lit << 4;
+    }
+
+    memcpy(dst + op, src + anchor, lit);
+    op += lit;
+
+    return op;
+}
+
+/**
+ * @return bytes written to dst, < 0 if block is corrupt or larger than size
+ */
+static int _redis_lz_decompress(const unsigned char *src, int n, unsigned char *dst, int size)
+{
+    int ip = 0, op = 0, lit = 0, mlen = 0, offset = 0, b = 0;
+    unsigned char token = 0;
+
+    while (ip < n)
+    {
+        token = src[ip++];
+
+        lit = token >> 4;
+        if (15 == lit)
+        {
+            do
+            {
+                if (ip >= n)
+                {
+                    return -1;
+                }
+                b = src[ip++];
+                lit += b;
+            } while (255 == b);
+        }
+
+        if (lit > n - ip || lit > size - op)
+        {
+            return -1;
+        }
+
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+
+        /* last sequence has literals only */
+        if (ip == n)
+        {
+            break;
+        }
+
+        if (n - ip < 2)
+        {
+            return -1;
+        }
+
+        offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+
+        if (0 == offset || offset > op)
+        {
+            return -1;
+        }
+
+        mlen = token & 15;
+        if (15 == mlen)
+        {
+            do
+            {
+                if (ip >= n)
+                {
+                    return -1;
+                }
+                b = src[ip++];
+                mlen += b;
+            } while (255 == b);
+        }
+
+        mlen += REDIS_LZ_MIN_MATCH;
+        if (mlen > size - op)
+        {
+            return -1;
+        }
+
+        /* match may overlap its own output */
+        for (; mlen > 0; --mlen, ++op)
+        {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return op;
+}
+
+
+/**
+ * Compress value when c->compress_min enables it and it saves space
+ *
+ * @return REDIS_TRUE with malloc'd *o_buf of *o_len bytes, outputs untouched otherwise
+ */
+int _redis_compress(redis_client *c, const char *value, size_t len, char **o_buf, size_t *o_len)
+{
+    int n = 0;
+    size_t cap = 0;
+    unsigned char *buf = NULL;
+
+    if (c->compress_min <= 0 || len < (size_t)c->compress_min || len < REDIS_COMPRESS_MIN_LEN || len > INT32_MAX)
+    {
+        return REDIS_FALSE;
+    }
+
+    /* not worth it unless it saves something */
+    cap = len - 1;
+
+    buf = (unsigned char *)malloc(cap);
+    if (!buf)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return REDIS_FALSE;
+    }
+
+    n = _redis_lz_compress((const unsigned char *)value, (int)len, buf + REDIS_COMPRESS_HEADER_LEN,
+                           (int)(cap - REDIS_COMPRESS_HEADER_LEN));
+    if (n < 0)
+    {
+        free(buf);
+        return REDIS_FALSE;
+    }
+
+    memcpy(buf, REDIS_COMPRESS_MAGIC, REDIS_COMPRESS_MAGIC_LEN);
+    _redis_lz_write32(buf + 4, (uint32_t)len);
+    _redis_lz_write32(buf + 8, _redis_lz_checksum((const unsigned char *)value, len));
+
+    *o_buf = (char *)buf;
+    *o_len = n + REDIS_COMPRESS_HEADER_LEN;
+
+    return REDIS_TRUE;
+}
+
+/**
+ * Compress argv[first], argv[first + step], ... in place, bufs of argc slots keeps
+ * the compressed buffers until _redis_compress_release
+ */
+void _redis_compress_argv(redis_client *c, int argc, const char **argv, size_t *argvlen, int first, int step, char **bufs)
+{
+    int i = 0;
+    size_t len = 0;
+
+    memset(bufs, 0, sizeof(char *) * argc);
+
+    if (c->compress_min <= 0)
+    {
+        return;
+    }
+
+    for (i = first; i < argc; i += step)
+    {
+        if (_redis_compress(c, argv[i], argvlen[i], &bufs[i], &len))
+        {
+            argv[i] = bufs[i];
+            argvlen[i] = len;
+        }
+    }
+}
+
+void _redis_compress_release(int argc, char **bufs)
+{
+    int i = 0;
+
+    for (i = 0; i < argc; ++i)
+    {
+        free(bufs[i]);
+    }
+}
+
+/**
+ * @return malloc'd '\0' terminated original value, NULL if value is not compressed
+ */
+static char *_redis_decompress(const char *value, size_t len, size_t *o_len)
+{
+    int n = 0;
+    size_t size = 0;
+    char *buf = NULL;
+    const unsigned char *p = (const unsigned char *)value;
+
+    if (len <= REDIS_COMPRESS_HEADER_LEN || 0 != memcmp(p, REDIS_COMPRESS_MAGIC, REDIS_COMPRESS_MAGIC_LEN))
+    {
+        return NULL;
+    }
+
+    size = _redis_lz_read32_le(p + 4);
+
+    /* we never write frames that don't save space, LZ4 expands at most 255 times */
+    if (size <= len || size > (len - REDIS_COMPRESS_HEADER_LEN) * 255 || size > INT32_MAX)
+    {
+        return NULL;
+    }
+
+    buf = (char *)malloc(size + 1);
+    if (!buf)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return NULL;
+    }
+
+    n = _redis_lz_decompress(p + REDIS_COMPRESS_HEADER_LEN, (int)(len - REDIS_COMPRESS_HEADER_LEN),
+                             (unsigned char *)buf, (int)size);
+    if (n != (int)size || _redis_lz_checksum((unsigned char *)buf, size) != _redis_lz_read32_le(p + 8))
+    {
+        free(buf);
+        return NULL;
+    }
+
+    buf[size] = '\0';
+    *o_len = size;
+
+    return buf;
+}
+
+/**
+ * Inflate compressed strings in reply, only on clients that opted in with compress_min
+ */
+void _redis_reply_inflate(redis_client *c, redisReply *reply)
+{
+    size_t i = 0, len = 0;
+    char *str = NULL;
+
+    if (!reply || c->compress_min <= 0)
+    {
+        return;
+    }
+
+    if (REDIS_REPLY_ARRAY == reply->type)
+    {
+        for (i = 0; i < reply->elements; ++i)
+        {
+            _redis_reply_inflate(c, reply->element[i]);
+        }
+    }
+    else if (REDIS_REPLY_STRING == reply->type)
+    {
+        str = _redis_decompress(reply->str, reply->len, &len);
+        if (str)
+        {
+            free(reply->str);
+            reply->str = str;
+            reply->len = (int)len;
+        }
+    }
+}
+
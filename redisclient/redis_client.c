@@ -3,12 +3,37 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
+#include <poll.h>
 
 #include "redis_types.h"
 #include "_redis_client.h"
 #include "redis_client.h"
 
 
+struct __redis_replica
+{
+    char                ip[16];
+    int                 port;
+    redis_client       *client;                 /* Made on first read */
+    long long           ewma;                   /* Average read latency, us */
+};
+typedef struct __redis_replica redis_replica;
+
+#define REDIS_HEDGE_SAMPLES     128
+#define REDIS_HEDGE_MIN_SAMPLES 32
+
+struct __redis_hedge
+{
+    int                 samples[REDIS_HEDGE_SAMPLES];   /* Latency of recent reads, us, a ring */
+    int                 nsamples;
+    int                 delay;                  /* us, hedge_percentile of samples, < 0 until known */
+    unsigned            reads;
+    unsigned            hedges;
+};
+typedef struct __redis_hedge redis_hedge;
+
+
 static int _redis_select_p(redis_client *this, int index)
 {
     int rc = REDIS_OK;
@@ -66,24 +91,18 @@ static int redis_pipeline_create(redis_client *this)
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     this->pipeline = 0;
 
     return REDIS_OK;
 }
 
-static int redis_pipeline_exec(redis_client *this)
+static void _redis_pipeline_drain(redis_client *this)
 {
     int rc = REDIS_OK;
     redisReply *reply = NULL;
 
-    if (INT_MIN == this->pipeline)
-    {
-        EMI_LOG("%s: currently, not in pipeline mode\n", __FUNCTION__);
-        return REDIS_ERR;
-    }
-
     EMI_LOG("%s: %d commands in pipeline\n", __FUNCTION__, this->pipeline);
 
     while (this->pipeline)
@@ -99,11 +118,28 @@ static int redis_pipeline_exec(redis_client *this)
 
         this->pipeline--;
     }
+}
+
+static int redis_pipeline_exec(redis_client *this)
+{
+    if (INT_MIN == this->pipeline)
+    {
+        EMI_LOG("%s: currently, not in pipeline mode\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    _redis_pipeline_drain(this);
+
+    /* writes ran, near cache invalidations queued by them may go now */
+    if (_redis_hash_cache_flush(this) > 0)
+    {
+        _redis_pipeline_drain(this);
+    }
 
     /* exit pipeline mode */
     this->pipeline = INT_MIN;
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return REDIS_OK;
 }
@@ -118,7 +154,7 @@ static int redis_select(redis_client *this, int index)
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -129,12 +165,12 @@ static int redis_select(redis_client *this, int index)
         rc = _redis_select_s(this, index);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
 
-redis_client *redis_client_create(const char *ip, int port)
+static redis_client *_redis_client_create(const char *ip, int port, const char *path)
 {
     redis_client *c = NULL;
 
@@ -147,6 +183,7 @@ redis_client *redis_client_create(const char *ip, int port)
 
     snprintf(c->ip, sizeof(c->ip), "%s", ip);
     c->port = port;
+    snprintf(c->path, sizeof(c->path), "%s", path);
     c->redis = NULL;
     c->db_index = -1;
 
@@ -157,6 +194,50 @@ redis_client *redis_client_create(const char *ip, int port)
     pthread_mutexattr_destroy(&attr);
 
     c->pipeline = INT_MIN;
+    c->chunk_args = REDIS_CHUNK_ARGS;
+    c->compress_min = 0;
+
+    pthread_mutex_init(&c->flight_lock, NULL);
+    pthread_cond_init(&c->flight_cond, NULL);
+    c->flights = NULL;
+
+    c->connect_timeout = REDIS_CONNECT_TIMEOUT;
+    c->command_timeout = 0;
+    pthread_mutex_init(&c->reconnect_lock, NULL);
+    pthread_cond_init(&c->reconnect_cond, NULL);
+    c->reconnector_started = 0;
+    c->reconnecting = 0;
+    c->down = 0;
+    c->standby = NULL;
+    c->switched = 0;
+    c->sentinel = NULL;
+
+    c->breaker_error_rate = 0;
+    c->breaker_min_calls = REDIS_BREAKER_MIN_CALLS;
+    c->breaker_slow_ms = 0;
+    c->breaker_open_ms = REDIS_BREAKER_OPEN_MS;
+    c->breaker_probes = REDIS_BREAKER_PROBES;
+    c->breaker_state = REDIS_BREAKER_CLOSED;
+    c->breaker_since = 0;
+    c->breaker_calls = 0;
+    c->breaker_failures = 0;
+
+    pthread_mutex_init(&c->replica_lock, NULL);
+    c->replicas = NULL;
+    c->nreplicas = 0;
+    c->replica_next = 0;
+
+    c->hedge_percentile = 0;
+    c->hedge_budget = REDIS_HEDGE_BUDGET;
+    c->hedge = NULL;
+    c->stale = 0;
+
+    c->origin = NULL;
+    pthread_mutex_init(&c->local_lock, NULL);
+    c->local_key_created = 0;
+    c->locals = NULL;
+    c->local_next = NULL;
+
     c->pipeline_create = redis_pipeline_create;
     c->pipeline_exec = redis_pipeline_exec;
 
@@ -168,15 +249,697 @@ redis_client *redis_client_create(const char *ip, int port)
     redis_list_init(&c->List);
     redis_set_init(&c->Set);
     redis_sortedset_init(&c->SortedSet);
+    redis_stream_init(&c->Stream);
+    redis_script_init(&c->Script);
+    redis_publish_init(&c->Publish);
+    redis_subscribe_init(&c->Subscribe);
 
     return c;
 }
 
+redis_client *redis_client_create(const char *ip, int port)
+{
+    if (!ip)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    return _redis_client_create(ip, port, "");
+}
+
+redis_client *redis_client_create_unix(const char *path)
+{
+    if (!path || '\0' == path[0] || strlen(path) >= REDIS_UNIX_PATH_LEN)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    return _redis_client_create("", 0, path);
+}
+
+redis_client *redis_client_create_replicated(const char *ip, int port,
+                                              const char **replica_ips, const int *replica_ports, int nreplicas)
+{
+    int i = 0;
+    redis_client *c = NULL;
+
+    if (!ip || nreplicas < 0 || (nreplicas > 0 && (!replica_ips || !replica_ports)))
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    c = _redis_client_create(ip, port, "");
+    if (!c || 0 == nreplicas)
+    {
+        return c;
+    }
+
+    c->replicas = (redis_replica *)calloc(nreplicas, sizeof(redis_replica));
+    c->hedge = (redis_hedge *)calloc(1, sizeof(redis_hedge));
+    if (!c->replicas || !c->hedge)
+    {
+        EMI_LOG("%s: out of memory, malloc replicas failed\n", __FUNCTION__);
+        redis_client_destroy(c);
+        return NULL;
+    }
+
+    for (i = 0; i < nreplicas; ++i)
+    {
+        snprintf(c->replicas[i].ip, sizeof(c->replicas[i].ip), "%s", replica_ips[i]);
+        c->replicas[i].port = replica_ports[i];
+    }
+
+    c->nreplicas = nreplicas;
+    c->hedge->delay = -1;
+
+    return c;
+}
+
+redis_client *redis_client_create_sentinel(const char *name,
+                                            const char **sentinel_ips, const int *sentinel_ports, int nsentinels)
+{
+    redis_client *c = NULL;
+
+    if (!name || '\0' == name[0] || nsentinels <= 0 || !sentinel_ips || !sentinel_ports)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    c = _redis_client_create("", 0, "");
+    if (!c)
+    {
+        return NULL;
+    }
+
+    if (REDIS_OK != _redis_sentinel_start(c, name, sentinel_ips, sentinel_ports, nsentinels))
+    {
+        redis_client_destroy(c);
+        return NULL;
+    }
+
+    return c;
+}
+
+static void _redis_client_settings(redis_client *c, redis_client *this)
+{
+    c->chunk_args = this->chunk_args;
+    c->compress_min = this->compress_min;
+    c->connect_timeout = this->connect_timeout;
+    c->command_timeout = this->command_timeout;
+    c->breaker_error_rate = this->breaker_error_rate;
+    c->breaker_min_calls = this->breaker_min_calls;
+    c->breaker_slow_ms = this->breaker_slow_ms;
+    c->breaker_open_ms = this->breaker_open_ms;
+    c->breaker_probes = this->breaker_probes;
+}
+
+/**
+ * New client to the same server with the same settings, for modules that need a
+ * dedicated connection (blocking commands, subscribers, background threads)
+ */
+redis_client *_redis_client_clone(redis_client *this)
+{
+    redis_client *c = NULL;
+
+    c = _redis_client_create(this->ip, this->port, this->path);
+    if (c)
+    {
+        _redis_client_settings(c, this);
+
+        if (this->sentinel)
+        {
+            _redis_sentinel_follow(this, c);
+        }
+    }
+
+    return c;
+}
+
+/**
+ * pthread key destructor, thread owning handle c exits
+ */
+static void _redis_client_local_free(void *arg)
+{
+    redis_client *c = (redis_client *)arg;
+    redis_client *origin = c->origin;
+    redis_client **pc = NULL;
+
+    pthread_mutex_lock(&origin->local_lock);
+
+    for (pc = &origin->locals; *pc; pc = &(*pc)->local_next)
+    {
+        if (*pc == c)
+        {
+            *pc = c->local_next;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&origin->local_lock);
+
+    redis_client_destroy(c);
+}
+
+redis_client *redis_client_local(redis_client *this)
+{
+    redis_client *c = NULL;
+
+    if (!this)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    if (this->origin)
+    {
+        return this;
+    }
+
+    /* pairs with the barrier publishing local_key below */
+    if (__sync_fetch_and_add(&this->local_key_created, 0))
+    {
+        c = (redis_client *)pthread_getspecific(this->local_key);
+        if (c)
+        {
+            return c;
+        }
+    }
+
+    pthread_mutex_lock(&this->local_lock);
+
+    /* keys are few (PTHREAD_KEYS_MAX), only clients that hand out handles take one */
+    if (!this->local_key_created)
+    {
+        if (0 != pthread_key_create(&this->local_key, _redis_client_local_free))
+        {
+            EMI_LOG("%s: pthread_key_create failed\n", __FUNCTION__);
+            pthread_mutex_unlock(&this->local_lock);
+            return NULL;
+        }
+
+        __sync_fetch_and_or(&this->local_key_created, 1);
+    }
+
+    pthread_mutex_unlock(&this->local_lock);
+
+    c = _redis_client_clone(this);
+    if (!c)
+    {
+        return NULL;
+    }
+
+    _redis_script_copy(c, this);
+
+    c->origin = this;
+
+    pthread_mutex_lock(&this->local_lock);
+    c->local_next = this->locals;
+    this->locals = c;
+    pthread_mutex_unlock(&this->local_lock);
+
+    pthread_setspecific(this->local_key, c);
+
+    return c;
+}
+
+static long long _redis_replica_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Connection a read goes to, clears REDIS_READ_PRIMARY from *index
+ *
+ * @return this or a replica client, pass it to _redis_replica_done after the read
+ */
+redis_client *_redis_replica_pick(redis_client *this, int *index, long long *o_start)
+{
+    int i = 0;
+    redis_replica *r = NULL, *best = NULL;
+    redis_client *owner = this->origin ? this->origin : this;   /* replicas of thread-local handles */
+
+    *o_start = 0;
+
+    if (*index & REDIS_READ_PRIMARY)
+    {
+        *index &= ~REDIS_READ_PRIMARY;
+        return this;
+    }
+
+    if (0 == owner->nreplicas || this->pipeline >= 0)
+    {
+        return this;
+    }
+
+    pthread_mutex_lock(&owner->replica_lock);
+
+    /* start from a rotating offset, replicas of equal latency share the reads */
+    for (i = 0; i < owner->nreplicas; ++i)
+    {
+        r = &owner->replicas[(owner->replica_next + i) % owner->nreplicas];
+
+        if (r->client && (_redis_server_down(r->client) || _redis_breaker_open(r->client)))
+        {
+            continue;
+        }
+
+        if (!best || r->ewma < best->ewma)
+        {
+            best = r;
+        }
+    }
+
+    owner->replica_next++;
+
+    /* the others slowly look better again, so a replica that was slow gets retried */
+    for (i = 0; i < owner->nreplicas; ++i)
+    {
+        r = &owner->replicas[i];
+        if (r != best)
+        {
+            r->ewma -= r->ewma >> 5;
+        }
+    }
+
+    if (best && !best->client)
+    {
+        best->client = _redis_client_create(best->ip, best->port, "");
+        if (best->client)
+        {
+            _redis_client_settings(best->client, owner);
+        }
+    }
+
+    pthread_mutex_unlock(&owner->replica_lock);
+
+    if (!best || !best->client)
+    {
+        return this;
+    }
+
+    *o_start = _redis_replica_now();
+
+    return best->client;
+}
+
+/**
+ * Account latency of a read on conn, a read that lost its connection counts as
+ * REDIS_REPLICA_PENALTY
+ */
+void _redis_replica_done(redis_client *this, redis_client *conn, long long start)
+{
+    int i = 0;
+    long long sample = 0;
+
+    if (conn == this)
+    {
+        return;
+    }
+
+    this = this->origin ? this->origin : this;
+
+    sample = conn->redis ? _redis_replica_now() - start : REDIS_REPLICA_PENALTY * 1000LL;
+
+    pthread_mutex_lock(&this->replica_lock);
+
+    for (i = 0; i < this->nreplicas; ++i)
+    {
+        if (this->replicas[i].client == conn)
+        {
+            /* alpha 1/4 */
+            this->replicas[i].ewma += (sample - this->replicas[i].ewma) / 4;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&this->replica_lock);
+}
+
+static int _redis_hedge_cmp(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static void _redis_hedge_sample(redis_client *this, long long us)
+{
+    int n = 0;
+    int sorted[REDIS_HEDGE_SAMPLES];
+    redis_hedge *h = this->hedge;
+
+    pthread_mutex_lock(&this->replica_lock);
+
+    h->samples[h->nsamples++ % REDIS_HEDGE_SAMPLES] = us > INT_MAX ? INT_MAX : (int)us;
+
+    /* the percentile moves slowly, sort only every few samples */
+    if (h->nsamples >= REDIS_HEDGE_MIN_SAMPLES && 0 == h->nsamples % (REDIS_HEDGE_MIN_SAMPLES / 2))
+    {
+        n = h->nsamples < REDIS_HEDGE_SAMPLES ? h->nsamples : REDIS_HEDGE_SAMPLES;
+        memcpy(sorted, h->samples, sizeof(int) * n);
+        qsort(sorted, n, sizeof(int), _redis_hedge_cmp);
+        h->delay = sorted[(n - 1) * this->hedge_percentile / 100];
+    }
+
+    if (h->nsamples >= 2 * REDIS_HEDGE_SAMPLES)
+    {
+        h->nsamples -= REDIS_HEDGE_SAMPLES;
+    }
+
+    pthread_mutex_unlock(&this->replica_lock);
+}
+
+/**
+ * Connection to send a hedge of a read on conn to, within budget
+ *
+ * @return NULL if none or over budget
+ */
+static redis_client *_redis_hedge_target(redis_client *this, redis_client *conn)
+{
+    int i = 0;
+    redis_replica *r = NULL, *best = NULL;
+    redis_client *target = NULL;
+    redis_hedge *h = this->hedge;
+
+    pthread_mutex_lock(&this->replica_lock);
+
+    if ((unsigned long long)(h->hedges + 1) * 100 > (unsigned long long)h->reads * this->hedge_budget)
+    {
+        pthread_mutex_unlock(&this->replica_lock);
+        return NULL;
+    }
+
+    for (i = 0; i < this->nreplicas; ++i)
+    {
+        r = &this->replicas[i];
+
+        if (r->client == conn || (r->client && _redis_server_down(r->client)))
+        {
+            continue;
+        }
+
+        if (!best || r->ewma < best->ewma)
+        {
+            best = r;
+        }
+    }
+
+    if (best && !best->client)
+    {
+        best->client = _redis_client_create(best->ip, best->port, "");
+        if (best->client)
+        {
+            _redis_client_settings(best->client, this);
+        }
+    }
+
+    if (best && best->client)
+    {
+        target = best->client;
+    }
+    else if (conn != this)
+    {
+        target = this;
+    }
+
+    if (target)
+    {
+        h->hedges++;
+    }
+
+    pthread_mutex_unlock(&this->replica_lock);
+
+    return target;
+}
+
+static void _redis_hedge_drop(redis_client *c)
+{
+    EMI_LOG("%s: hedged read error: %s\n", __FUNCTION__,
+             REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr);
+
+    redisFree(c->redis);
+    c->redis = NULL;
+    c->db_index = -1;
+}
+
+static int _redis_hedge_send(redis_client *c, const char *cmd)
+{
+    int done = 0;
+
+    if (REDIS_OK != redisAppendCommand(c->redis, cmd))
+    {
+        _redis_hedge_drop(c);
+        return REDIS_ERR;
+    }
+
+    do
+    {
+        if (REDIS_OK != redisBufferWrite(c->redis, &done))
+        {
+            _redis_hedge_drop(c);
+            return REDIS_ERR;
+        }
+    } while (!done);
+
+    return REDIS_OK;
+}
+
+/**
+ * Send cmd on conn, which is locked and connected, and once it had no reply for
+ * the hedge delay, again on another connection. First reply wins, the other one
+ * is left to read and drop before the next command on its connection.
+ *
+ * @return reply, NULL on failure
+ */
+static redisReply *_redis_replica_hedged(redis_client *this, redis_client *conn, int index, const char *cmd)
+{
+    int i = 0, n = 0, rc = 0, delay = 0, timeout = 0, hedged = REDIS_FALSE;
+    int which[2] = {0};
+    long long start = 0, hedge_start = 0, elapsed = 0;
+    redis_client *conns[2] = {conn, NULL};
+    redisReply *reply = NULL;
+    struct pollfd fds[2];
+
+    EMI_LOG("%s: cmd[%s]\n", __FUNCTION__, cmd);
+
+    pthread_mutex_lock(&this->replica_lock);
+    delay = this->hedge->delay;
+    if (++this->hedge->reads >= (1u << 20))
+    {
+        this->hedge->reads >>= 1;
+        this->hedge->hedges >>= 1;
+    }
+    pthread_mutex_unlock(&this->replica_lock);
+
+    start = _redis_replica_now();
+
+    if (REDIS_OK != _redis_hedge_send(conn, cmd))
+    {
+        return NULL;
+    }
+
+    while (!reply)
+    {
+        for (n = 0, i = 0; i < 2; ++i)
+        {
+            if (conns[i] && conns[i]->redis)
+            {
+                fds[n].fd = conns[i]->redis->fd;
+                fds[n].events = POLLIN;
+                fds[n].revents = 0;
+                which[n++] = i;
+            }
+        }
+
+        if (0 == n)
+        {
+            break;
+        }
+
+        elapsed = _redis_replica_now() - start;
+
+        if (!hedged && delay >= 0)
+        {
+            timeout = elapsed >= delay ? 0 : (int)((delay - elapsed + 999) / 1000);
+        }
+        else
+        {
+            timeout = conn->command_timeout > 0 ? conn->command_timeout : -1;
+        }
+
+        rc = poll(fds, n, timeout);
+        if (rc < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (0 == rc && !hedged && delay >= 0)
+        {
+            hedged = REDIS_TRUE;
+
+            conns[1] = _redis_hedge_target(this, conn);
+            if (conns[1] && 0 != pthread_mutex_trylock(&conns[1]->lock))
+            {
+                /* busy, don't queue behind it */
+                conns[1] = NULL;
+            }
+
+            if (conns[1])
+            {
+                hedge_start = _redis_replica_now();
+
+                if (REDIS_OK != _redis_try_connect_nonblock(conns[1], index)
+                    || REDIS_OK != _redis_hedge_send(conns[1], cmd))
+                {
+                    pthread_mutex_unlock(&conns[1]->lock);
+                    conns[1] = NULL;
+                }
+            }
+
+            continue;
+        }
+
+        if (rc <= 0)
+        {
+            EMI_LOG("%s: no reply in %d ms\n", __FUNCTION__, timeout);
+            break;
+        }
+
+        for (i = 0; i < n && !reply; ++i)
+        {
+            if (!fds[i].revents)
+            {
+                continue;
+            }
+
+            if (REDIS_OK != redisBufferRead(conns[which[i]]->redis)
+                || REDIS_OK != redisGetReplyFromReader(conns[which[i]]->redis, (void **)&reply))
+            {
+                _redis_hedge_drop(conns[which[i]]);
+                reply = NULL;
+                continue;
+            }
+
+            if (reply && 1 == which[i])
+            {
+                EMI_LOG("%s: hedge won after %lld us\n", __FUNCTION__, _redis_replica_now() - start);
+            }
+
+            /* the other reply arrives later */
+            if (reply && conns[!which[i]] && conns[!which[i]]->redis)
+            {
+                conns[!which[i]]->stale++;
+            }
+        }
+    }
+
+    if (reply)
+    {
+        _redis_hedge_sample(this, _redis_replica_now() - start);
+    }
+    else
+    {
+        /* replies that never came poison their connections */
+        for (i = 0; i < 2; ++i)
+        {
+            if (conns[i] && conns[i]->redis)
+            {
+                _redis_hedge_drop(conns[i]);
+            }
+        }
+    }
+
+    if (conns[1])
+    {
+        _redis_replica_done(this, conns[1], hedge_start);
+        pthread_mutex_unlock(&conns[1]->lock);
+    }
+
+    return reply;
+}
+
+/**
+ * _redis_command_strings on conn, hedged when this->hedge_percentile enables it
+ */
+int _redis_replica_strings(redis_client *this, redis_client *conn, int index, const char *cmd, redis_member **o_members)
+{
+    int count = 0;
+    redisReply *reply = NULL;
+
+    this = this->origin ? this->origin : this;
+
+    if (!this->hedge || this->hedge_percentile <= 0 || conn->pipeline >= 0)
+    {
+        return _redis_command_strings(conn, cmd, REDIS_FALSE, o_members);
+    }
+
+    reply = _redis_replica_hedged(this, conn, index, cmd);
+    if (!reply)
+    {
+        return -1;
+    }
+
+    if (REDIS_REPLY_ERROR == reply->type)
+    {
+        EMI_LOG("%s: redisCommand reply error: %s\n", __FUNCTION__, reply->str ? reply->str : NULL);
+        freeReplyObject(reply);
+        return -1;
+    }
+
+    _redis_reply_inflate(this, reply);
+    count = _redis_reply_members(reply, o_members);
+
+    freeReplyObject(reply);
+
+    return count;
+}
+
 void redis_client_destroy(redis_client *this)
 {
+    int i = 0;
+    redis_client *local = NULL;
+
     if (this)
     {
+        /* stop reader thread before anything it may touch */
+        redis_subscribe_deinit(&this->Subscribe);
+        _redis_sentinel_stop(this);
+        _redis_reconnect_stop(this);
+
+        /* threads still running keep dangling handles, the key no longer frees them */
+        if (this->local_key_created)
+        {
+            pthread_key_delete(this->local_key);
+        }
+
+        while (this->locals)
+        {
+            local = this->locals;
+            this->locals = local->local_next;
+            redis_client_destroy(local);
+        }
+
         pthread_mutex_destroy(&this->lock);
+        pthread_mutex_destroy(&this->flight_lock);
+        pthread_cond_destroy(&this->flight_cond);
+        pthread_mutex_destroy(&this->reconnect_lock);
+        pthread_cond_destroy(&this->reconnect_cond);
+
+        for (i = 0; i < this->nreplicas; ++i)
+        {
+            redis_client_destroy(this->replicas[i].client);
+        }
+
+        free(this->replicas);
+        free(this->hedge);
+        pthread_mutex_destroy(&this->replica_lock);
+        pthread_mutex_destroy(&this->local_lock);
 
         redis_key_deinit(&this->Key);
         redis_string_deinit(&this->String);
@@ -184,6 +947,9 @@ void redis_client_destroy(redis_client *this)
         redis_list_deinit(&this->List);
         redis_set_deinit(&this->Set);
         redis_sortedset_deinit(&this->SortedSet);
+        redis_stream_deinit(&this->Stream);
+        redis_script_deinit(&this->Script);
+        redis_publish_deinit(&this->Publish);
 
         if (this->redis)
         {
@@ -15,6 +15,16 @@
 #include "redis_list.h"
 #include "redis_set.h"
 #include "redis_sortedset.h"
+#include "redis_stream.h"
+#include "redis_script.h"
+#include "redis_publish.h"
+#include "redis_subscribe.h"
+#include "redis_queue.h"
+#include "redis_scan.h"
+#include "redis_counter.h"
+#include "redis_future.h"
+#include "redis_submit.h"
+#include "redis_coroutine.h"
 #endif
 
 #ifndef EMI_LOG
@@ -25,6 +35,55 @@
 #define MAX_SINGLE_CMD_LEN  1024
 #define MAX_MEMBER_LEN      256
 
+/**
+ * Default max arguments of one variadic command, see redis_client.chunk_args
+ */
+#define REDIS_CHUNK_ARGS    1024
+
+/**
+ * sizeof(sockaddr_un.sun_path)
+ */
+#define REDIS_UNIX_PATH_LEN 108
+
+/**
+ * Default ms to wait for a connection, see redis_client.connect_timeout
+ */
+#define REDIS_CONNECT_TIMEOUT   1000
+
+/**
+ * Background reconnect backoff, ms, doubles from MIN up to MAX with jitter
+ */
+#define REDIS_RECONNECT_MIN     100
+#define REDIS_RECONNECT_MAX     5000
+
+/**
+ * Circuit breaker defaults, see redis_client.breaker_error_rate
+ */
+#define REDIS_BREAKER_MIN_CALLS 20
+#define REDIS_BREAKER_OPEN_MS   5000
+#define REDIS_BREAKER_PROBES    3
+#define REDIS_BREAKER_WINDOW    10000       /* ms over which error rate is measured */
+
+#define REDIS_BREAKER_CLOSED    0
+#define REDIS_BREAKER_OPEN      1
+#define REDIS_BREAKER_HALF_OPEN 2
+
+/**
+ * OR into `index' of a read to send it to primary even with replicas, for reading
+ * back what this client just wrote (replication is asynchronous)
+ */
+#define REDIS_READ_PRIMARY      0x40000000
+
+/**
+ * ms a failed replica read counts for in the replica's latency average
+ */
+#define REDIS_REPLICA_PENALTY   1000
+
+/**
+ * Default max percent of reads hedged, see redis_client.hedge_percentile
+ */
+#define REDIS_HEDGE_BUDGET      5
+
 #define REDIS_TRUE  1
 #define REDIS_FALSE 0
 
@@ -41,10 +100,12 @@ struct __redis_client
 {
     char                ip[16];                 /* Server IP */
     int                 port;                   /* Server Port */
+    char                path[REDIS_UNIX_PATH_LEN];  /* Server unix socket, "" for TCP */
     redisContext       *redis;                  /* hiredis context */
     int                 db_index;               /* Indicate database index in hiredis context */
 
     pthread_mutex_t     lock;
+    int                 lock_depth;             /* Times lock is held by its owner, see REDIS_LOCK */
 
     /**
      * Currently, in pipeline mode ? 
@@ -53,6 +114,104 @@ struct __redis_client
      */
     int                 pipeline;
 
+    /**
+     * Max member arguments of one variadic command, larger arrays passed to
+     * *M commands (SADDM, ZADDM, LPUSHM, ...) are split into chunks of this size
+     */
+    int                 chunk_args;
+
+    /**
+     * Values of at least compress_min bytes are stored compressed when it pays off,
+     * 0 (default) disables it. Applies to String.SET/MSET, Hash.HSETALL/HSETALL_DIRTY
+     * and Stream.XADD values. Compressed values are only inflated on reads when
+     * compress_min > 0 too, a client that reads compressed data without writing any
+     * sets it to INT_MAX. String.GETRANGE/SETRANGE/APPEND fail when it is > 0.
+     */
+    int                 compress_min;
+
+    /**
+     * Reads in flight, identical concurrent reads wait for and share one result
+     */
+    pthread_mutex_t     flight_lock;
+    pthread_cond_t      flight_cond;
+    struct __redis_flight *flights;
+
+    /**
+     * ms to wait for connect, and for each reply (0, default: no limit) before
+     * the command fails and the connection is dropped. Set them before the first
+     * command, they apply from the next connect. Blocking commands (BLPOP, ...)
+     * are bounded by command_timeout too.
+     */
+    int                 connect_timeout;
+    int                 command_timeout;
+
+    /**
+     * After a failed connect the server is taken as down: commands fail at once
+     * instead of each paying connect_timeout, while a reconnect thread retries
+     * with jittered exponential backoff and hands over the new connection.
+     */
+    pthread_mutex_t     reconnect_lock;
+    pthread_cond_t      reconnect_cond;         /* Signaled when server is up again */
+    pthread_t           reconnector;
+    int                 reconnector_started;
+    volatile int        reconnecting;
+    volatile int        down;
+    redisContext       *standby;                /* Connection made by reconnector, not used yet */
+    volatile int        switched;               /* Endpoint moved, drop current connection */
+
+    /**
+     * Primary discovery and failover, see redis_client_create_sentinel
+     */
+    struct __redis_sentinel *sentinel;
+
+    /**
+     * Circuit breaker of this endpoint, off while breaker_error_rate is 0 (default).
+     * When at least breaker_error_rate percent of breaker_min_calls or more calls
+     * within REDIS_BREAKER_WINDOW ms failed, the circuit opens and every command
+     * fails at once for breaker_open_ms. Then it is half open: the next commands go
+     * as probes, breaker_probes successes close it, one failure opens it again.
+     * Lost connections, timeouts, and calls slower than breaker_slow_ms (0: none)
+     * are failures, error replies are not.
+     */
+    int                 breaker_error_rate;
+    int                 breaker_min_calls;
+    int                 breaker_slow_ms;
+    int                 breaker_open_ms;
+    int                 breaker_probes;
+    int                 breaker_state;
+    long long           breaker_since;          /* Start of window, or when circuit opened */
+    int                 breaker_calls;
+    int                 breaker_failures;
+
+    /**
+     * Read replicas, see redis_client_create_replicated
+     */
+    pthread_mutex_t     replica_lock;
+    struct __redis_replica *replicas;
+    int                 nreplicas;
+    unsigned            replica_next;
+
+    /**
+     * Hedged reads, for clients with replicas. A Hash.HGETALL, Set.SMEMBERS or
+     * List.LRANGE with no reply after the hedge_percentile latency of recent
+     * reads (0, default: off) is sent again to another replica, or primary, and
+     * the first reply wins. At most hedge_budget percent of reads are hedged.
+     */
+    int                 hedge_percentile;
+    int                 hedge_budget;
+    struct __redis_hedge *hedge;
+    int                 stale;                  /* Replies of hedges that lost, not read yet */
+
+    /**
+     * Thread-local handles, see redis_client_local
+     */
+    redis_client       *origin;                 /* Client this thread-local handle belongs to */
+    pthread_mutex_t     local_lock;             /* Guards locals, local_key */
+    pthread_key_t       local_key;
+    volatile int        local_key_created;      /* Set atomically once local_key is valid */
+    redis_client       *locals;                 /* Handles made from this client, linked by local_next */
+    redis_client       *local_next;
+
     /**
      * Enter pipeline mode
      */
@@ -74,6 +233,10 @@ struct __redis_client
     redis_list          List;
     redis_set           Set;
     redis_sortedset     SortedSet;
+    redis_stream        Stream;
+    redis_script        Script;
+    redis_publish       Publish;
+    redis_subscribe     Subscribe;
 };
 
 struct __redis_member
@@ -89,6 +252,46 @@ struct __redis_score_member
 
 
 redis_client *redis_client_create(const char *ip, int port);
+
+/**
+ * Client of a server on this host listening on unix socket `path', it saves the
+ * TCP stack on every command. Everything works as with redis_client_create.
+ */
+redis_client *redis_client_create_unix(const char *path);
+
+/**
+ * Client of primary `ip:port' with `nreplicas' read replicas. String.GET,
+ * Hash.HGETALL, List.LRANGE, Set.SMEMBERS, SortedSet.ZRANGE and ZRANGEBYSCORE go
+ * to the replica of least average latency (EWMA, failures count as
+ * REDIS_REPLICA_PENALTY ms), or to primary when `index' has REDIS_READ_PRIMARY
+ * set, in pipeline mode, or when every replica is down. Everything else goes to
+ * primary. Replica connections are made on first use with primary's settings.
+ */
+redis_client *redis_client_create_replicated(const char *ip, int port,
+                                              const char **replica_ips, const int *replica_ports, int nreplicas);
+
+/**
+ * Client of the primary of master `name', as told by the first of `nsentinels'
+ * sentinels that knows it. A thread stays subscribed to +switch-master, so on
+ * failover the client and its dedicated connections (queue, counter, ...) move
+ * to the new primary: the next command drops the old connection and goes on with
+ * one already made to the new primary, selecting its database again. Commands
+ * waiting for the old primary to come back are woken.
+ *
+ * @return NULL if no sentinel knows `name'
+ */
+redis_client *redis_client_create_sentinel(const char *name,
+                                            const char **sentinel_ips, const int *sentinel_ports, int nsentinels);
+
+/**
+ * Handle of the calling thread on client `this', made on first call: a dedicated
+ * connection with the settings, scripts, replicas, near cache and singleflight of
+ * `this', whose commands take no lock at all. Keep it in the thread, it's freed when
+ * the thread exits, or with `this'. Register scripts before threads take handles.
+ *
+ * @return NULL on failure
+ */
+redis_client *redis_client_local(redis_client *this);
 void redis_client_destroy(redis_client *redis_db);
 
 
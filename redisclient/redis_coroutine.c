@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <poll.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+
+
+struct __redis_coroutine
+{
+    struct __redis_coroutine *next;             /* Ready list */
+    redis_sched        *sched;
+    redis_coroutine_fn  fn;
+    void               *arg;
+    int                 done;
+    ucontext_t          ctx;
+    char               *stack;
+};
+typedef struct __redis_coroutine redis_coroutine;
+
+
+/**
+ * Scheduler running on this thread, NULL outside of run()
+ */
+static __thread redis_sched *_redis_sched_current = NULL;
+
+
+static void _redis_coroutine_free(redis_coroutine *co)
+{
+    free(co->stack);
+    free(co);
+}
+
+static void _redis_sched_ready(redis_sched *this, redis_coroutine *co)
+{
+    co->next = NULL;
+
+    if (this->ready_tail)
+    {
+        this->ready_tail->next = co;
+    }
+    else
+    {
+        this->ready = co;
+    }
+
+    this->ready_tail = co;
+}
+
+static redis_coroutine *_redis_sched_next(redis_sched *this)
+{
+    redis_coroutine *co = this->ready;
+
+    if (co)
+    {
+        this->ready = co->next;
+        if (!this->ready)
+        {
+            this->ready_tail = NULL;
+        }
+    }
+
+    return co;
+}
+
+/**
+ * Back to run(), current coroutine resumes when something made it ready again
+ */
+static void _redis_sched_switch(redis_sched *this)
+{
+    redis_coroutine *co = this->current;
+
+    swapcontext(&co->ctx, &this->main);
+}
+
+static void _redis_coroutine_entry(void)
+{
+    redis_sched *sched = _redis_sched_current;
+    redis_coroutine *co = sched->current;
+
+    co->fn(sched, co->arg);
+
+    /* uc_link returns to run(), which frees the stack we are on */
+    co->done = 1;
+}
+
+/**
+ * future_complete of a future a coroutine waits on
+ */
+static void _redis_coroutine_wake(void *arg)
+{
+    redis_coroutine *co = (redis_coroutine *)arg;
+
+    _redis_sched_ready(co->sched, co);
+}
+
+/**
+ * Yield until f completes, if called in a coroutine of the scheduler whose
+ * submitter f belongs to
+ *
+ * @return REDIS_TRUE if f completed so, REDIS_FALSE if caller must block instead
+ */
+int _redis_coroutine_await(redis_future *f)
+{
+    redis_sched *sched = _redis_sched_current;
+    redis_coroutine *co = NULL;
+
+    if (!sched || !sched->current || f->owner != sched->submit)
+    {
+        return REDIS_FALSE;
+    }
+
+    co = sched->current;
+
+    pthread_mutex_lock(&f->lock);
+
+    if (f->done)
+    {
+        pthread_mutex_unlock(&f->lock);
+        return REDIS_TRUE;
+    }
+
+    f->wake = _redis_coroutine_wake;
+    f->wake_arg = co;
+
+    pthread_mutex_unlock(&f->lock);
+
+    _redis_sched_switch(sched);
+
+    return REDIS_TRUE;
+}
+
+/**
+ * Every coroutine waits for a reply: write their commands and wait for replies
+ */
+static void _redis_sched_io(redis_sched *this)
+{
+    int fd = -1, events = 0, timeout = -1, n = 0;
+    redis_submit *submit = this->submit;
+    struct pollfd pfd;
+
+    fd = submit->fd(submit);
+    if (fd < 0)
+    {
+        /* commands failed, their coroutines are ready */
+        return;
+    }
+
+    /* socket takes the batch most of the time, don't poll before */
+    if (submit->events(submit) & REDIS_EVENT_WRITE)
+    {
+        if (REDIS_OK != submit->on_writable(submit) || this->ready)
+        {
+            return;
+        }
+    }
+
+    events = submit->events(submit);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN | (events & REDIS_EVENT_WRITE ? POLLOUT : 0);
+    pfd.revents = 0;
+
+    timeout = submit->inflight && submit->client->command_timeout > 0 ? submit->client->command_timeout : -1;
+
+    n = poll(&pfd, 1, timeout);
+    if (n < 0)
+    {
+        if (EINTR != errno)
+        {
+            EMI_LOG("%s: poll failed: %s\n", __FUNCTION__, strerror(errno));
+        }
+        return;
+    }
+
+    if (0 == n)
+    {
+        /* commands in flight fail, their coroutines are ready */
+        _redis_submit_timeout(submit);
+        return;
+    }
+
+    if (pfd.revents & POLLOUT)
+    {
+        submit->on_writable(submit);
+    }
+
+    if (pfd.revents & (POLLIN | POLLERR | POLLHUP))
+    {
+        submit->on_readable(submit);
+    }
+}
+
+static int redis_sched_spawn(redis_sched *this, redis_coroutine_fn fn, void *arg)
+{
+    redis_coroutine *co = NULL;
+
+    if (!this || !fn)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    co = (redis_coroutine *)calloc(1, sizeof(redis_coroutine));
+    if (!co)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    co->stack = (char *)malloc(this->stack_size);
+    if (!co->stack)
+    {
+        EMI_LOG("%s: FATAL, out of memory, stack of %d bytes\n", __FUNCTION__, this->stack_size);
+        free(co);
+        return REDIS_ERR;
+    }
+
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = co->stack;
+    co->ctx.uc_stack.ss_size = this->stack_size;
+    co->ctx.uc_link = &this->main;
+    makecontext(&co->ctx, _redis_coroutine_entry, 0);
+
+    co->sched = this;
+    co->fn = fn;
+    co->arg = arg;
+
+    this->alive++;
+    _redis_sched_ready(this, co);
+
+    return REDIS_OK;
+}
+
+static int redis_sched_run(redis_sched *this)
+{
+    redis_coroutine *co = NULL;
+    redis_sched *outer = _redis_sched_current;
+
+    if (outer && outer->current)
+    {
+        EMI_LOG("%s: can't run a scheduler from a coroutine\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    _redis_sched_current = this;
+
+    while (this->alive > 0)
+    {
+        while ((co = _redis_sched_next(this)))
+        {
+            this->current = co;
+            swapcontext(&this->main, &co->ctx);
+            this->current = NULL;
+
+            if (co->done)
+            {
+                this->alive--;
+                _redis_coroutine_free(co);
+            }
+        }
+
+        if (this->alive > 0)
+        {
+            _redis_sched_io(this);
+        }
+    }
+
+    _redis_sched_current = outer;
+
+    return REDIS_OK;
+}
+
+static void redis_sched_yield(redis_sched *this)
+{
+    if (!this->current)
+    {
+        return;
+    }
+
+    _redis_sched_ready(this, this->current);
+    _redis_sched_switch(this);
+}
+
+static redis_future *redis_sched_command(redis_sched *this, int index, const char *format, ...)
+{
+    redis_future *f = NULL;
+    va_list ap;
+
+    va_start(ap, format);
+    f = _redis_submit_vcommand(this->submit, index, format, ap);
+    va_end(ap);
+
+    return f;
+}
+
+
+redis_sched *redis_sched_create(redis_client *client, int stack_size)
+{
+    redis_sched *sched = NULL;
+
+    if (!client)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    sched = (redis_sched *)malloc(sizeof(redis_sched));
+    if (!sched)
+    {
+        EMI_LOG("%s: out of memory, malloc redis_sched failed\n", __FUNCTION__);
+        return NULL;
+    }
+
+    memset(sched, 0, sizeof(redis_sched));
+
+    sched->submit = redis_submit_create_loop(client);
+    if (!sched->submit)
+    {
+        free(sched);
+        return NULL;
+    }
+
+    sched->stack_size = stack_size > 0 ? stack_size : REDIS_COROUTINE_STACK;
+
+    sched->spawn   = redis_sched_spawn;
+    sched->run     = redis_sched_run;
+    sched->yield   = redis_sched_yield;
+    sched->command = redis_sched_command;
+
+    return sched;
+}
+
+void redis_sched_destroy(redis_sched *this)
+{
+    redis_coroutine *co = NULL;
+
+    if (!this)
+    {
+        return;
+    }
+
+    /* fails what coroutines wait on, which makes them all ready */
+    redis_submit_destroy(this->submit);
+
+    while ((co = _redis_sched_next(this)))
+    {
+        _redis_coroutine_free(co);
+    }
+
+    free(this);
+}
+
@@ -0,0 +1,100 @@
+#ifndef __REDIS_COROUTINE_H
+#define __REDIS_COROUTINE_H
+
+
+#include <ucontext.h>
+
+#include "redis_types.h"
+
+
+/**
+ * Default stack size of a coroutine
+ */
+#define REDIS_COROUTINE_STACK       (64 * 1024)
+
+
+typedef void (*redis_coroutine_fn)(redis_sched *sched, void *arg);
+
+struct __redis_coroutine;
+
+/**
+ * Stackful coroutines on one thread, multiplexing their commands on one
+ * connection.
+ *
+ * Code in a coroutine reads like blocking code: redis_future_wait, and the
+ * redis_future_<type> decoders that call it, yield while the reply is pending
+ * and the scheduler runs other coroutines meanwhile. The scheduler drives an
+ * event loop submitter (see redis_submit_create_loop): once every coroutine is
+ * waiting it writes their commands in one batch, polls the socket, and resumes
+ * each coroutine whose reply came in. With the client's command_timeout set,
+ * commands in flight fail when no reply comes for that many ms. So thousands of request handlers, each
+ * with its own command in flight, share one thread and one connection.
+ *
+ *     static void handler(redis_sched *sched, void *arg)
+ *     {
+ *         f = sched->command(sched, 0, "HGETALL %s", key);
+ *         n = redis_future_hash(f, hdesc_tbls_account, &account);
+ *         redis_future_free(f);
+ *         ...
+ *     }
+ *
+ *     sched->spawn(sched, handler, ctx);
+ *     sched->run(sched);
+ *
+ * Coroutines must not call the blocking redis_client commands, nor wait with a
+ * timeout (redis_future_wait_for, wait_any, wait_all with timeout >= 0): those
+ * block the thread, and with it the I/O every coroutine waits for. Futures of
+ * other submitters are waited for by blocking as well.
+ */
+struct __redis_sched
+{
+    redis_submit       *submit;                 /* Event loop submitter of coroutines' commands */
+    int                 stack_size;
+
+    struct __redis_coroutine *ready;            /* Runnable, oldest first */
+    struct __redis_coroutine *ready_tail;
+    struct __redis_coroutine *current;          /* Running, NULL in scheduler */
+    int                 alive;                  /* Spawned and not returned yet */
+
+    ucontext_t          main;                   /* Context of run() */
+
+    /**
+     * Start fn(this, arg) in a new coroutine, it first runs once the caller
+     * yields or waits. Callable from coroutines and before run().
+     *
+     * @return REDIS_OK, REDIS_ERR if out of memory
+     */
+    int                 (*spawn)(redis_sched *this, redis_coroutine_fn fn, void *arg);
+
+    /**
+     * Run coroutines until all returned
+     *
+     * @return REDIS_OK, REDIS_ERR if called from a coroutine
+     */
+    int                 (*run)(redis_sched *this);
+
+    /**
+     * Let other runnable coroutines go first, from a coroutine
+     */
+    void                (*yield)(redis_sched *this);
+
+    /**
+     * Submit a command formatted like redisCommand, see redis_submit.command
+     */
+    redis_future       *(*command)(redis_sched *this, int index, const char *format, ...);
+};
+
+
+/**
+ * @param stack_size bytes of each coroutine's stack, <= 0 for REDIS_COROUTINE_STACK
+ */
+redis_sched *redis_sched_create(redis_client *client, int stack_size);
+
+/**
+ * Coroutines not run to the end are freed with their stack, not resumed
+ */
+void redis_sched_destroy(redis_sched *sched);
+
+
+#endif
+
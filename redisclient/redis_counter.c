@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+#include "redis_counter.h"
+
+
+#define REDIS_COUNTER_BUCKETS       256
+
+#define REDIS_COUNTER_HASH          0
+#define REDIS_COUNTER_SORTEDSET     1
+
+
+typedef struct __redis_counter_entry
+{
+    struct __redis_counter_entry *next;
+    int                 type;                   /* REDIS_COUNTER_HASH or REDIS_COUNTER_SORTEDSET */
+    int                 index;
+    unsigned            hash;
+    long long           delta;
+    char               *field;                  /* Points into name */
+    char                name[];                 /* Key '\0' field '\0' */
+
+} redis_counter_entry;
+
+typedef struct __redis_counter_stripe
+{
+    pthread_mutex_t     lock;
+    redis_counter_entry *buckets[REDIS_COUNTER_BUCKETS];
+
+} redis_counter_stripe;
+
+
+static unsigned _redis_counter_hash(int type, int index, const char *key, const char *field)
+{
+    unsigned hash = 2166136261u;
+
+    hash = (hash ^ (unsigned)type) * 16777619u;
+    hash = (hash ^ (unsigned)index) * 16777619u;
+
+    for (; *key; ++key)
+    {
+        hash = (hash ^ (unsigned char)*key) * 16777619u;
+    }
+
+    /* tell (k, "ab") apart from (k + "a", "b") */
+    hash = (hash ^ 0xff) * 16777619u;
+
+    for (; *field; ++field)
+    {
+        hash = (hash ^ (unsigned char)*field) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Sum entry into table, entry is freed if the counter is buffered already
+ *
+ * @return REDIS_TRUE if entry is linked as a new counter
+ */
+static int _redis_counter_merge(redis_counter *this, redis_counter_entry *e)
+{
+    redis_counter_stripe *stripe = &this->stripes[e->hash % REDIS_COUNTER_STRIPES];
+    redis_counter_entry **bucket = &stripe->buckets[(e->hash / REDIS_COUNTER_STRIPES) % REDIS_COUNTER_BUCKETS];
+    redis_counter_entry *old = NULL;
+
+    pthread_mutex_lock(&stripe->lock);
+
+    for (old = *bucket; old; old = old->next)
+    {
+        if (old->hash == e->hash && old->type == e->type && old->index == e->index
+            && 0 == strcmp(old->name, e->name) && 0 == strcmp(old->field, e->field))
+        {
+            break;
+        }
+    }
+
+    if (old)
+    {
+        old->delta += e->delta;
+    }
+    else
+    {
+        e->next = *bucket;
+        *bucket = e;
+    }
+
+    pthread_mutex_unlock(&stripe->lock);
+
+    if (old)
+    {
+        free(e);
+        return REDIS_FALSE;
+    }
+
+    return REDIS_TRUE;
+}
+
+static int _redis_counter_add(redis_counter *this, int type, int index, const char *key, const char *field, int increment)
+{
+    int key_len = 0, field_len = 0;
+    redis_counter_entry *e = NULL;
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !field || '\0' == field[0])
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    key_len = strlen(key);
+    field_len = strlen(field);
+
+    e = (redis_counter_entry *)malloc(sizeof(redis_counter_entry) + key_len + field_len + 2);
+    if (!e)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    e->next = NULL;
+    e->type = type;
+    e->index = index;
+    e->hash = _redis_counter_hash(type, index, key, field);
+    e->delta = increment;
+    e->field = e->name + key_len + 1;
+    memcpy(e->name, key, key_len + 1);
+    memcpy(e->field, field, field_len + 1);
+
+    if (_redis_counter_merge(this, e)
+        && __sync_add_and_fetch(&this->pending, 1) >= this->max_pending)
+    {
+        /* wake flusher early */
+        pthread_mutex_lock(&this->lock);
+        pthread_cond_signal(&this->cond);
+        pthread_mutex_unlock(&this->lock);
+    }
+
+    return REDIS_OK;
+}
+
+/**
+ * Unlink every buffered counter
+ */
+static redis_counter_entry *_redis_counter_detach(redis_counter *this)
+{
+    int i = 0, j = 0, count = 0;
+    redis_counter_stripe *stripe = NULL;
+    redis_counter_entry *list = NULL, *e = NULL;
+
+    for (i = 0; i < REDIS_COUNTER_STRIPES; ++i)
+    {
+        stripe = &this->stripes[i];
+
+        pthread_mutex_lock(&stripe->lock);
+
+        for (j = 0; j < REDIS_COUNTER_BUCKETS; ++j)
+        {
+            while ((e = stripe->buckets[j]))
+            {
+                stripe->buckets[j] = e->next;
+                e->next = list;
+                list = e;
+                count++;
+            }
+        }
+
+        pthread_mutex_unlock(&stripe->lock);
+    }
+
+    __sync_sub_and_fetch(&this->pending, count);
+
+    return list;
+}
+
+/**
+ * Pipeline the counters of database `index' moved from *list to *o_sent, and read
+ * their replies, flush_client lock held
+ *
+ * @return count of counters applied, < 0 if the connection broke or out of memory
+ */
+static int _redis_counter_send(redis_counter *this, int index, redis_counter_entry **list, redis_counter_entry **o_sent)
+{
+    int rc = REDIS_OK, i = 0, count = 0, applied = 0, full = REDIS_FALSE;
+    redisReply *reply = NULL;
+    redis_client *c = this->flush_client;
+    redis_counter_entry **pe = list, *e = NULL;
+    char delta_b[24] = {0};
+    const char *argv[4] = {NULL, NULL, NULL, NULL};
+
+    while ((e = *pe))
+    {
+        if (e->index != index)
+        {
+            pe = &e->next;
+            continue;
+        }
+
+        snprintf(delta_b, sizeof(delta_b), "%lld", e->delta);
+
+        if (REDIS_COUNTER_HASH == e->type)
+        {
+            argv[0] = "HINCRBY";
+            argv[1] = e->name;
+            argv[2] = e->field;
+            argv[3] = delta_b;
+        }
+        else
+        {
+            argv[0] = "ZINCRBY";
+            argv[1] = e->name;
+            argv[2] = delta_b;
+            argv[3] = e->field;
+        }
+
+        /* only fails out of memory, entry stays buffered */
+        if (REDIS_OK != redisAppendCommandArgv(c->redis, 4, argv, NULL))
+        {
+            EMI_LOG("%s: redisAppendCommandArgv error: %s\n", __FUNCTION__, c->redis->errstr);
+            full = REDIS_TRUE;
+            break;
+        }
+
+        *pe = e->next;
+        e->next = *o_sent;
+        *o_sent = e;
+        count++;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        rc = redisGetReply(c->redis, (void **)&reply);
+        if (REDIS_OK != rc)
+        {
+            EMI_LOG("%s: redisGetReply error: %s, %d counters may be lost\n", __FUNCTION__,
+                     REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr, count - i);
+
+            redisFree(c->redis);
+            c->redis = NULL;
+            c->db_index = -1;
+            return -1;
+        }
+
+        if (REDIS_REPLY_ERROR == reply->type)
+        {
+            EMI_LOG("%s: increment failed: %s\n", __FUNCTION__, reply->str);
+        }
+        else
+        {
+            applied++;
+        }
+
+        freeReplyObject(reply);
+    }
+
+    return full ? -1 : applied;
+}
+
+static int redis_counter_flush(redis_counter *this)
+{
+    int rc = 0, applied = 0;
+    redis_client *c = NULL;
+    redis_counter_entry *list = NULL, *sent = NULL, *e = NULL;
+
+    if (!this)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    c = this->flush_client;
+
+    pthread_mutex_lock(&this->flush_lock);
+
+    list = _redis_counter_detach(this);
+
+    REDIS_LOCK(c);
+
+    while (list)
+    {
+        rc = _redis_try_connect_nonblock(c, list->index);
+        if (REDIS_OK != rc)
+        {
+            EMI_LOG("%s: _redis_try_connect_nonblock failed, counters kept for next flush\n", __FUNCTION__);
+            rc = -1;
+            break;
+        }
+
+        rc = _redis_counter_send(this, list->index, &list, &sent);
+        if (rc < 0)
+        {
+            break;
+        }
+
+        applied += rc;
+    }
+
+    REDIS_UNLOCK(c);
+
+    /* not sent, buffer them again */
+    while ((e = list))
+    {
+        list = e->next;
+        if (_redis_counter_merge(this, e))
+        {
+            __sync_add_and_fetch(&this->pending, 1);
+        }
+    }
+
+    while ((e = sent))
+    {
+        sent = e->next;
+        if (REDIS_COUNTER_HASH == e->type)
+        {
+            _redis_hash_cache_invalidate(this->client, e->index, e->name);
+        }
+        free(e);
+    }
+
+    pthread_mutex_unlock(&this->flush_lock);
+
+    return rc < 0 ? -1 : applied;
+}
+
+static int redis_counter_hincrby(redis_counter *this, int index, const char *key, const char *member, int increment)
+{
+    return _redis_counter_add(this, REDIS_COUNTER_HASH, index, key, member, increment);
+}
+
+static int redis_counter_zincrby(redis_counter *this, int index, const char *key, int score, const char *member)
+{
+    return _redis_counter_add(this, REDIS_COUNTER_SORTEDSET, index, key, member, score);
+}
+
+static void *_redis_counter_flusher_routine(void *arg)
+{
+    redis_counter *this = (redis_counter *)arg;
+    struct timeval now;
+    struct timespec deadline;
+
+    while (this->running)
+    {
+        gettimeofday(&now, NULL);
+        deadline.tv_sec = now.tv_sec + this->interval / 1000;
+        deadline.tv_nsec = now.tv_usec * 1000 + (long)(this->interval % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        pthread_mutex_lock(&this->lock);
+
+        while (this->running && this->pending < this->max_pending)
+        {
+            if (ETIMEDOUT == pthread_cond_timedwait(&this->cond, &this->lock, &deadline))
+            {
+                break;
+            }
+        }
+
+        pthread_mutex_unlock(&this->lock);
+
+        if (this->pending > 0 && redis_counter_flush(this) < 0)
+        {
+            /* server unreachable, don't spin on a full table */
+            usleep(this->interval * 1000);
+        }
+    }
+
+    return NULL;
+}
+
+
+redis_counter *redis_counter_create(redis_client *client, int interval, int max_pending)
+{
+    int i = 0;
+    redis_counter *counter = NULL;
+
+    if (!client)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    counter = (redis_counter *)malloc(sizeof(redis_counter));
+    if (!counter)
+    {
+        EMI_LOG("%s: out of memory, malloc redis_counter failed\n", __FUNCTION__);
+        return NULL;
+    }
+
+    memset(counter, 0, sizeof(redis_counter));
+
+    counter->stripes = (redis_counter_stripe *)calloc(REDIS_COUNTER_STRIPES, sizeof(redis_counter_stripe));
+    if (!counter->stripes)
+    {
+        EMI_LOG("%s: out of memory, calloc stripes failed\n", __FUNCTION__);
+        free(counter);
+        return NULL;
+    }
+
+    counter->flush_client = _redis_client_clone(client);
+    if (!counter->flush_client)
+    {
+        free(counter->stripes);
+        free(counter);
+        return NULL;
+    }
+
+    for (i = 0; i < REDIS_COUNTER_STRIPES; ++i)
+    {
+        pthread_mutex_init(&counter->stripes[i].lock, NULL);
+    }
+
+    pthread_mutex_init(&counter->lock, NULL);
+    pthread_mutex_init(&counter->flush_lock, NULL);
+    pthread_cond_init(&counter->cond, NULL);
+
+    counter->client = client;
+    counter->interval = interval > 0 ? interval : REDIS_COUNTER_INTERVAL;
+    counter->max_pending = max_pending > 0 ? max_pending : REDIS_COUNTER_MAX_PENDING;
+
+    counter->HINCRBY = redis_counter_hincrby;
+    counter->ZINCRBY = redis_counter_zincrby;
+    counter->flush   = redis_counter_flush;
+
+    counter->running = REDIS_TRUE;
+    if (0 != pthread_create(&counter->flusher, NULL, _redis_counter_flusher_routine, counter))
+    {
+        EMI_LOG("%s: pthread_create failed: %s\n", __FUNCTION__, strerror(errno));
+        counter->running = REDIS_FALSE;
+        redis_counter_destroy(counter);
+        return NULL;
+    }
+
+    return counter;
+}
+
+void redis_counter_destroy(redis_counter *this)
+{
+    int i = 0;
+    redis_counter_entry *e = NULL, *next = NULL;
+
+    if (this)
+    {
+        if (this->running)
+        {
+            pthread_mutex_lock(&this->lock);
+            this->running = REDIS_FALSE;
+            pthread_cond_signal(&this->cond);
+            pthread_mutex_unlock(&this->lock);
+
+            pthread_join(this->flusher, NULL);
+        }
+
+        if (this->pending > 0 && redis_counter_flush(this) < 0)
+        {
+            EMI_LOG("%s: final flush failed, %d counters lost\n", __FUNCTION__, this->pending);
+        }
+
+        /* whatever the final flush kept */
+        e = _redis_counter_detach(this);
+        while (e)
+        {
+            next = e->next;
+            free(e);
+            e = next;
+        }
+
+        for (i = 0; i < REDIS_COUNTER_STRIPES; ++i)
+        {
+            pthread_mutex_destroy(&this->stripes[i].lock);
+        }
+
+        pthread_mutex_destroy(&this->flush_lock);
+        pthread_mutex_destroy(&this->lock);
+        pthread_cond_destroy(&this->cond);
+
+        redis_client_destroy(this->flush_client);
+
+        free(this->stripes);
+        free(this);
+    }
+}
+
@@ -0,0 +1,88 @@
+
+#ifndef __REDIS_COUNTER_H
+#define __REDIS_COUNTER_H
+
+
+#include <pthread.h>
+
+#include "redis_types.h"
+
+
+/**
+ * Default ms between two flushes, bounds how stale a counter on server may be
+ */
+#define REDIS_COUNTER_INTERVAL      100
+
+/**
+ * Default count of distinct buffered counters that triggers an early flush
+ */
+#define REDIS_COUNTER_MAX_PENDING   4096
+
+#define REDIS_COUNTER_STRIPES       16
+
+
+struct __redis_counter_stripe;
+
+/**
+ * Write-behind aggregation of Hash.HINCRBY and SortedSet.ZINCRBY.
+ *
+ * Increments are summed in memory per (db, key, field) in a striped table, and a
+ * flusher thread sends the sums as pipelined HINCRBY / ZINCRBY on a dedicated
+ * connection every `interval' ms, or as soon as `max_pending' distinct counters
+ * are buffered. So N increments of a hot counter cost one command per interval.
+ *
+ * A delta reaches server at most `interval' ms plus one flush after it was added,
+ * as long as server is reachable. Deltas of a flush that can't connect are kept
+ * for the next one; deltas in flight when the connection breaks are dropped and
+ * logged, rather than risk applying them twice. Reads through redis_client don't
+ * see buffered deltas, call flush() first when that matters, and before exit.
+ */
+struct __redis_counter
+{
+    redis_client       *client;                 /* Caller connection, for hash cache invalidation */
+    redis_client       *flush_client;           /* Dedicated connection of flusher */
+    int                 interval;               /* ms */
+    int                 max_pending;
+
+    struct __redis_counter_stripe *stripes;
+    volatile int        pending;                /* Distinct counters buffered */
+
+    volatile int        running;
+    pthread_mutex_t     lock;                   /* Guards cond */
+    pthread_mutex_t     flush_lock;             /* Serializes flushes */
+    pthread_cond_t      cond;
+    pthread_t           flusher;
+
+    /**
+     * Buffer `increment' of hash field, see Hash.HINCRBY
+     */
+    int                 (*HINCRBY)(redis_counter *this, int index, const char *key, const char *member, int increment);
+
+    /**
+     * Buffer `score' increment of sorted set member, see SortedSet.ZINCRBY
+     */
+    int                 (*ZINCRBY)(redis_counter *this, int index, const char *key, int score, const char *member);
+
+    /**
+     * Send all buffered deltas now
+     *
+     * @return count of counters sent, < 0 on failure, deltas not sent stay buffered
+     */
+    int                 (*flush)(redis_counter *this);
+};
+
+
+/**
+ * @param interval    ms between flushes, <= 0 for REDIS_COUNTER_INTERVAL
+ * @param max_pending distinct counters triggering an early flush, <= 0 for REDIS_COUNTER_MAX_PENDING
+ */
+redis_counter *redis_counter_create(redis_client *client, int interval, int max_pending);
+
+/**
+ * Stop flusher and flush what is still buffered
+ */
+void redis_counter_destroy(redis_counter *counter);
+
+
+#endif
+
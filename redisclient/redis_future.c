@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+
+
+/**
+ * @param cmd formatted command, owned by the future from now on
+ */
+redis_future *_redis_future_create(char *cmd, int len, int index)
+{
+    redis_future *f = NULL;
+
+    f = (redis_future *)calloc(1, sizeof(redis_future));
+    if (!f)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return NULL;
+    }
+
+    f->cmd = cmd;
+    f->len = len;
+    f->index = index;
+    f->refs = 2;
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->cond, NULL);
+
+    return f;
+}
+
+/**
+ * Drop one reference, the last one frees f
+ */
+void _redis_future_release(redis_future *f)
+{
+    int refs = 0;
+
+    pthread_mutex_lock(&f->lock);
+    refs = --f->refs;
+    pthread_mutex_unlock(&f->lock);
+
+    if (refs > 0)
+    {
+        return;
+    }
+
+    if (f->reply)
+    {
+        freeReplyObject(f->reply);
+    }
+
+    free(f->cmd);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->cond);
+    free(f);
+}
+
+static void _redis_future_deadline(int timeout, struct timespec *o_deadline)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    o_deadline->tv_sec = now.tv_sec + timeout / 1000;
+    o_deadline->tv_nsec = now.tv_usec * 1000 + (long)(timeout % 1000) * 1000000;
+    if (o_deadline->tv_nsec >= 1000000000)
+    {
+        o_deadline->tv_sec++;
+        o_deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/**
+ * Called by I/O thread, once per future, with the reply or NULL on failure
+ */
+void _redis_future_complete(redis_future *f, redisReply *reply)
+{
+    redis_future_callback callback = NULL;
+    void (*wake)(void *) = NULL;
+    struct __redis_future_link *l = NULL;
+
+    pthread_mutex_lock(&f->lock);
+
+    f->reply = reply;
+    f->done = 1;
+    pthread_cond_broadcast(&f->cond);
+
+    for (l = f->waiters; l; l = l->next)
+    {
+        pthread_mutex_lock(&l->waiter->lock);
+        l->waiter->fired = 1;
+        pthread_cond_signal(&l->waiter->cond);
+        pthread_mutex_unlock(&l->waiter->lock);
+    }
+
+    callback = f->callback;
+    wake = f->wake;
+
+    pthread_mutex_unlock(&f->lock);
+
+    if (callback)
+    {
+        callback(f, reply, f->callback_arg);
+    }
+
+    if (wake)
+    {
+        wake(f->wake_arg);
+    }
+
+    _redis_future_release(f);
+}
+
+redisReply *redis_future_wait(redis_future *f)
+{
+    redisReply *reply = NULL;
+
+    /* in a coroutine of its scheduler, let others run until it completes */
+    if (_redis_coroutine_await(f))
+    {
+        return f->reply;
+    }
+
+    pthread_mutex_lock(&f->lock);
+
+    while (!f->done)
+    {
+        pthread_cond_wait(&f->cond, &f->lock);
+    }
+
+    reply = f->reply;
+
+    pthread_mutex_unlock(&f->lock);
+
+    return reply;
+}
+
+int redis_future_done(redis_future *f)
+{
+    int done = 0;
+
+    pthread_mutex_lock(&f->lock);
+    done = f->done;
+    pthread_mutex_unlock(&f->lock);
+
+    return done ? REDIS_TRUE : REDIS_FALSE;
+}
+
+int redis_future_wait_for(redis_future *f, int timeout)
+{
+    int done = 0;
+    struct timespec deadline;
+
+    _redis_future_deadline(timeout, &deadline);
+
+    pthread_mutex_lock(&f->lock);
+
+    while (!f->done)
+    {
+        if (ETIMEDOUT == pthread_cond_timedwait(&f->cond, &f->lock, &deadline))
+        {
+            break;
+        }
+    }
+
+    done = f->done;
+
+    pthread_mutex_unlock(&f->lock);
+
+    return done ? REDIS_TRUE : REDIS_FALSE;
+}
+
+int redis_future_then(redis_future *f, redis_future_callback callback, void *arg)
+{
+    int done = 0;
+
+    if (!callback)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    pthread_mutex_lock(&f->lock);
+
+    if (f->callback)
+    {
+        pthread_mutex_unlock(&f->lock);
+        EMI_LOG("%s: future has a callback already\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    f->callback = callback;
+    f->callback_arg = arg;
+    done = f->done;
+
+    pthread_mutex_unlock(&f->lock);
+
+    /* completed before, I/O thread won't call it */
+    if (done)
+    {
+        callback(f, f->reply, arg);
+    }
+
+    return REDIS_OK;
+}
+
+int redis_future_wait_all(redis_future **fs, int n, int timeout)
+{
+    int i = 0;
+    struct timeval now, deadline;
+
+    if (timeout < 0)
+    {
+        for (i = 0; i < n; ++i)
+        {
+            redis_future_wait(fs[i]);
+        }
+
+        return REDIS_TRUE;
+    }
+
+    gettimeofday(&deadline, NULL);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_usec += (timeout % 1000) * 1000;
+    if (deadline.tv_usec >= 1000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_usec -= 1000000;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        gettimeofday(&now, NULL);
+        timeout = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_usec - now.tv_usec) / 1000;
+
+        if (!redis_future_wait_for(fs[i], timeout > 0 ? timeout : 0))
+        {
+            return REDIS_FALSE;
+        }
+    }
+
+    return REDIS_TRUE;
+}
+
+static int _redis_future_first_done(redis_future **fs, int n)
+{
+    int i = 0;
+
+    for (i = 0; i < n; ++i)
+    {
+        if (redis_future_done(fs[i]))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * One waiter is linked to every future, the first to complete wakes it
+ */
+int redis_future_wait_any(redis_future **fs, int n, int timeout)
+{
+    int i = 0, k = -1;
+    struct __redis_future_waiter w;
+    struct __redis_future_link *links = NULL, **pl = NULL;
+    struct timespec deadline;
+
+    k = _redis_future_first_done(fs, n);
+    if (k >= 0 || 0 == timeout || n <= 0)
+    {
+        return k;
+    }
+
+    links = (struct __redis_future_link *)malloc(sizeof(struct __redis_future_link) * n);
+    if (!links)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return -1;
+    }
+
+    memset(&w, 0, sizeof(w));
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+
+    if (timeout > 0)
+    {
+        _redis_future_deadline(timeout, &deadline);
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        links[i].waiter = &w;
+
+        pthread_mutex_lock(&fs[i]->lock);
+        links[i].next = fs[i]->waiters;
+        fs[i]->waiters = &links[i];
+        pthread_mutex_unlock(&fs[i]->lock);
+    }
+
+    /* one completed while linking may have missed the waiter */
+    k = _redis_future_first_done(fs, n);
+
+    pthread_mutex_lock(&w.lock);
+
+    while (k < 0 && !w.fired)
+    {
+        if (timeout < 0)
+        {
+            pthread_cond_wait(&w.cond, &w.lock);
+        }
+        else if (ETIMEDOUT == pthread_cond_timedwait(&w.cond, &w.lock, &deadline))
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&w.lock);
+
+    for (i = 0; i < n; ++i)
+    {
+        pthread_mutex_lock(&fs[i]->lock);
+        for (pl = &fs[i]->waiters; *pl; pl = &(*pl)->next)
+        {
+            if (*pl == &links[i])
+            {
+                *pl = links[i].next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&fs[i]->lock);
+    }
+
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.cond);
+    free(links);
+
+    return k >= 0 ? k : _redis_future_first_done(fs, n);
+}
+
+/**
+ * @return reply of a completed command, NULL if it failed or server replied an error
+ */
+static redisReply *_redis_future_reply(redis_future *f)
+{
+    redisReply *reply = NULL;
+
+    reply = redis_future_wait(f);
+    if (!reply)
+    {
+        EMI_LOG("%s: command failed, no reply\n", __FUNCTION__);
+        return NULL;
+    }
+
+    if (REDIS_REPLY_ERROR == reply->type)
+    {
+        EMI_LOG("%s: reply error: %s\n", __FUNCTION__, reply->str ? reply->str : "");
+        return NULL;
+    }
+
+    return reply;
+}
+
+int redis_future_status(redis_future *f)
+{
+    return _redis_future_reply(f) ? REDIS_OK : REDIS_ERR;
+}
+
+int redis_future_int(redis_future *f)
+{
+    redisReply *reply = NULL;
+
+    reply = _redis_future_reply(f);
+    if (!reply || REDIS_REPLY_INTEGER != reply->type)
+    {
+        return -1;
+    }
+
+    return reply->integer;
+}
+
+int redis_future_string(redis_future *f, char *buf, int size)
+{
+    redisReply *reply = NULL;
+
+    reply = _redis_future_reply(f);
+    if (!reply || REDIS_REPLY_STRING != reply->type)
+    {
+        return -1;
+    }
+
+    if (size > 0)
+    {
+        memcpy(buf, reply->str, reply->len < size ? reply->len : size);
+        if (reply->len < size)
+        {
+            buf[reply->len] = '\0';
+        }
+    }
+
+    return reply->len;
+}
+
+int redis_future_members(redis_future *f, redis_member **o_members)
+{
+    redisReply *reply = NULL;
+
+    reply = _redis_future_reply(f);
+    if (!reply)
+    {
+        return -1;
+    }
+
+    return _redis_reply_members(reply, o_members);
+}
+
+int redis_future_score_members(redis_future *f, redis_score_member **o_members)
+{
+    int i = 0, count = 0;
+    redis_member *members = NULL;
+
+    count = redis_future_members(f, &members);
+    if (count <= 0)
+    {
+        return count;
+    }
+
+    if (count & 1)
+    {
+        EMI_LOG("%s: FATAL, reply count must be dual number\n", __FUNCTION__);
+        count = -1;
+        goto on_ret;
+    }
+
+    count /= 2;
+    *o_members = (redis_score_member *)malloc(sizeof(redis_score_member) * count);
+    if (!(*o_members))
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        count = -1;
+        goto on_ret;
+    }
+
+    memset(*o_members, 0, sizeof(redis_score_member) * count);
+
+    for (i = 0; i < count; ++i)
+    {
+        (*o_members)[i].score = atoi(members[2*i + 1].member);
+        snprintf((*o_members)[i].member, MAX_MEMBER_LEN, "%s", members[2*i].member);
+    }
+
+on_ret:
+    free(members);
+
+    return count;
+}
+
+int redis_future_hash(redis_future *f, redis_hash_member *hdesc_tbls, void *data)
+{
+    int count = 0;
+    size_t i = 0;
+    redisReply *reply = NULL, *field = NULL, *value = NULL;
+    redis_hash_member *m = NULL;
+
+    reply = _redis_future_reply(f);
+    if (!reply || REDIS_REPLY_ARRAY != reply->type || (reply->elements & 1))
+    {
+        EMI_LOG("%s: not a field and value array, reply type[%d]\n", __FUNCTION__, reply ? reply->type : -1);
+        return -1;
+    }
+
+    for (i = 0; i + 1 < reply->elements; i += 2)
+    {
+        field = reply->element[i];
+        value = reply->element[i + 1];
+        if (REDIS_REPLY_STRING != field->type || REDIS_REPLY_STRING != value->type)
+        {
+            continue;
+        }
+
+        m = _redis_member_find(hdesc_tbls, field->str, field->len);
+        if (m)
+        {
+            _redis_member_decode(m, data, value->str, value->len);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void redis_future_free(redis_future *f)
+{
+    if (f)
+    {
+        _redis_future_release(f);
+    }
+}
+
@@ -0,0 +1,133 @@
+#ifndef __REDIS_FUTURE_H
+#define __REDIS_FUTURE_H
+
+
+#include <hiredis.h>
+
+#include "redis_types.h"
+#include "redis_hash_desc.h"
+
+
+/**
+ * Reply of a command sent in the background, see redis_submit.
+ *
+ * A future is owned by its caller until redis_future_free, whether or not the
+ * command completed: a reply still to come is dropped on arrival.
+ *
+ * Several independent reads submitted at once overlap their round trips, wait
+ * for them with redis_future_wait_all, or take each with redis_future_wait_any
+ * as it comes. The redis_future_<type> helpers wait for a future and decode its
+ * reply into what the synchronous command of that reply type returns:
+ *
+ *     f = submit->command(submit, 0, "SMEMBERS %s", key);
+ *     ...
+ *     count = redis_future_members(f, &members);
+ *     redis_future_free(f);
+ *
+ * Commands go to the server as formatted, past the Hash/Set/String/... layers
+ * of redis_client, so futures bypass what those layers add:
+ * - writes don't drop near cache images (Hash.cache_enable) of the client, nor
+ *   publish on its invalidation channel, caches only learn of them through
+ *   keyspace notifications or ttl; write cached hashes with Hash commands
+ * - values aren't compressed (compress_min), replies are still inflated when the
+ *   client has compress_min > 0
+ * - reads aren't sent to replicas (redis_client_create_replicated) nor hedged,
+ *   every command goes to the primary on the submitter's own connection
+ */
+
+/**
+ * Called once with the reply, NULL on failure, on the thread that completes f:
+ * I/O thread of redis_submit, or caller of redis_future_then if f completed
+ * already. Reply is owned by f. Keep it short, it holds up every other reply;
+ * it may submit commands and free f.
+ */
+typedef void (*redis_future_callback)(redis_future *f, redisReply *reply, void *arg);
+
+/**
+ * Wait until the command completes
+ *
+ * @return reply, owned by f, of any type including REDIS_REPLY_ERROR
+ * -  NULL: command failed, connection lost or server down
+ */
+redisReply *redis_future_wait(redis_future *f);
+
+/**
+ * @return REDIS_TRUE if the command completed, redis_future_wait won't block
+ */
+int redis_future_done(redis_future *f);
+
+/**
+ * @return REDIS_TRUE if the command completed within `timeout' ms
+ */
+int redis_future_wait_for(redis_future *f, int timeout);
+
+/**
+ * Set callback run when f completes, at once if it did already
+ *
+ * @return REDIS_ERR if f has a callback already
+ */
+int redis_future_then(redis_future *f, redis_future_callback callback, void *arg);
+
+/**
+ * @param timeout ms, < 0 to wait as long as it takes
+ *
+ * @return REDIS_TRUE if all `n' futures completed in time
+ */
+int redis_future_wait_all(redis_future **fs, int n, int timeout);
+
+/**
+ * @param timeout ms, < 0 to wait as long as it takes
+ *
+ * @return index of a completed future, lowest first, < 0 if none completed in time
+ */
+int redis_future_wait_any(redis_future **fs, int n, int timeout);
+
+/**
+ * Wait and decode, like the synchronous commands. Error replies count as failures.
+ */
+
+/**
+ * @return REDIS_OK or REDIS_ERR, for status replies
+ */
+int redis_future_status(redis_future *f);
+
+/**
+ * @return integer reply, < 0 on failure
+ */
+int redis_future_int(redis_future *f);
+
+/**
+ * Copy string reply into buf like String.GET
+ *
+ * @return length of value, < 0 if nil or failed
+ */
+int redis_future_string(redis_future *f, char *buf, int size);
+
+/**
+ * Strings of an array or single reply, like Set.SMEMBERS, free *o_members
+ *
+ * @return count of strings, < 0 on failure
+ */
+int redis_future_members(redis_future *f, redis_member **o_members);
+
+/**
+ * Member and score pairs of an array reply WITHSCORES, like SortedSet.ZRANGE,
+ * free *o_members
+ *
+ * @return count of members, < 0 on failure
+ */
+int redis_future_score_members(redis_future *f, redis_score_member **o_members);
+
+/**
+ * Decode field and value pairs of HGETALL into struct `data' like Hash.HGETALL,
+ * fields not in hdesc_tbls are skipped
+ *
+ * @return count of fields decoded, < 0 on failure
+ */
+int redis_future_hash(redis_future *f, redis_hash_member *hdesc_tbls, void *data);
+
+void redis_future_free(redis_future *f);
+
+
+#endif
+
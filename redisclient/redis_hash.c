@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <hiredis.h>
 
 #include "redis_client.h"
@@ -196,6 +197,511 @@ static int _redis_hash_hincrby_s(redis_client *this, int index, const char *key,
 }
 
 
+/**
+ * Near cache, see redis_hash.cache_enable
+ */
+typedef struct __redis_hash_cache_entry
+{
+    struct __redis_hash_cache_entry *hnext;             /* Bucket chain */
+    struct __redis_hash_cache_entry *prev, *next;       /* LRU list, most recent first */
+    const redis_hash_member         *hdesc_tbls;
+    int                              index;
+    unsigned                         hash;
+    long long                        expire;            /* Monotonic ms */
+    unsigned long long               present;           /* Bit i: member i has a value, members >= 64 unknown */
+    int                              size;              /* Bytes of struct image */
+    size_t                           bytes;             /* Bytes charged to budget */
+    char                            *key;
+    unsigned char                    image[];           /* Struct image, then key */
+
+} redis_hash_cache_entry;
+
+typedef struct __redis_hash_cache_shard
+{
+    pthread_mutex_t                  lock;
+    redis_hash_cache_entry         **buckets;
+    unsigned                         nbuckets;          /* Power of 2 */
+    redis_hash_cache_entry           lru;               /* Sentinel of LRU list */
+    size_t                           bytes;
+    size_t                           budget;
+    unsigned                         epoch;             /* Bumped by every invalidation */
+
+} redis_hash_cache_shard;
+
+struct __redis_hash_cache
+{
+    volatile int                     enabled;
+    int                              ttl;               /* ms */
+    char                             channel[MAX_MEMBER_LEN];   /* Invalidation channel, '\0' for keyspace notifications */
+    redis_hash_cache_shard           shards[REDIS_HASH_CACHE_SHARDS];
+};
+
+/**
+ * Invalidation of a write appended to pipeline, applied once pipeline_exec ran it
+ */
+typedef struct __redis_hash_cache_key
+{
+    struct __redis_hash_cache_key   *next;
+    int                              index;
+    char                             key[];
+
+} redis_hash_cache_key;
+
+/**
+ * Bit of member m in redis_hash_cache_entry.present, 0 if it has none
+ */
+#define REDIS_HASH_CACHE_BIT(i)     ((i) < 64 ? 1ULL << (i) : 0)
+
+
+static long long _redis_hash_cache_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned _redis_hash_cache_hash(int index, const char *key, int len)
+{
+    int i = 0;
+    unsigned hash = 5381;
+
+    for (i = 0; i < len; ++i)
+    {
+        hash = hash * 33 + (unsigned char)key[i];
+    }
+
+    return hash ^ ((unsigned)index * 0x9E3779B1u);
+}
+
+/**
+ * Bytes of the struct image described by table
+ */
+static int _redis_hash_cache_image_size(const redis_hash_member *hdesc_tbls)
+{
+    int i = 0, size = 0;
+
+    for (i = 0; hdesc_tbls[i].member; ++i)
+    {
+        if (hdesc_tbls[i].offset + hdesc_tbls[i].data_size > size)
+        {
+            size = hdesc_tbls[i].offset + hdesc_tbls[i].data_size;
+        }
+    }
+
+    return size;
+}
+
+static redis_hash_cache_shard *_redis_hash_cache_shard(redis_hash_cache *cache, unsigned hash)
+{
+    return &cache->shards[hash % REDIS_HASH_CACHE_SHARDS];
+}
+
+static redis_hash_cache_entry **
+_redis_hash_cache_bucket(redis_hash_cache_shard *shard, unsigned hash)
+{
+    return &shard->buckets[(hash / REDIS_HASH_CACHE_SHARDS) & (shard->nbuckets - 1)];
+}
+
+/**
+ * Unlink entry from bucket and LRU list and free it, shard lock held
+ */
+static void _redis_hash_cache_remove(redis_hash_cache_shard *shard, redis_hash_cache_entry *e)
+{
+    redis_hash_cache_entry **pe = _redis_hash_cache_bucket(shard, e->hash);
+
+    while (*pe != e)
+    {
+        pe = &(*pe)->hnext;
+    }
+
+    *pe = e->hnext;
+
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+
+    shard->bytes -= e->bytes;
+
+    free(e);
+}
+
+/**
+ * Copy cached struct image of (index, key, hdesc_tbls) to data,
+ * only member `m' of it if m is not NULL. A member without value is a miss,
+ * the server tells whether it exists.
+ *
+ * @return REDIS_TRUE on hit
+ */
+static int _redis_hash_cache_get(redis_hash_cache *cache, int index, const char *key,
+                                      const redis_hash_member *hdesc_tbls, void *data, const redis_hash_member *m)
+{
+    int hit = REDIS_FALSE, len = strlen(key);
+    unsigned hash = _redis_hash_cache_hash(index, key, len);
+    redis_hash_cache_shard *shard = _redis_hash_cache_shard(cache, hash);
+    redis_hash_cache_entry *e = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+
+    for (e = *_redis_hash_cache_bucket(shard, hash); e; e = e->hnext)
+    {
+        if (e->hash == hash && e->index == index && e->hdesc_tbls == hdesc_tbls && 0 == strcmp(e->key, key))
+        {
+            break;
+        }
+    }
+
+    if (e)
+    {
+        if (e->expire <= _redis_hash_cache_now())
+        {
+            _redis_hash_cache_remove(shard, e);
+        }
+        else if (m && !(e->present & REDIS_HASH_CACHE_BIT(m - hdesc_tbls)))
+        {
+            ;
+        }
+        else
+        {
+            if (m)
+            {
+                memcpy((char *)data + m->offset, e->image + m->offset, m->data_size);
+            }
+            else
+            {
+                memcpy(data, e->image, e->size);
+            }
+
+            /* move to LRU head */
+            e->prev->next = e->next;
+            e->next->prev = e->prev;
+            e->next = shard->lru.next;
+            e->prev = &shard->lru;
+            shard->lru.next->prev = e;
+            shard->lru.next = e;
+
+            hit = REDIS_TRUE;
+        }
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return hit;
+}
+
+/**
+ * Epoch of shard owning key, taken before a fetch and passed to _redis_hash_cache_put
+ */
+static unsigned _redis_hash_cache_epoch(redis_hash_cache *cache, int index, const char *key)
+{
+    unsigned epoch = 0;
+    redis_hash_cache_shard *shard = _redis_hash_cache_shard(cache, _redis_hash_cache_hash(index, key, strlen(key)));
+
+    pthread_mutex_lock(&shard->lock);
+    epoch = shard->epoch;
+    pthread_mutex_unlock(&shard->lock);
+
+    return epoch;
+}
+
+/**
+ * Store struct image fetched from server, skipped if the shard was invalidated
+ * since `epoch', as the image may predate the write
+ *
+ * @param present bit i set if member i had a value, see REDIS_HASH_CACHE_BIT
+ */
+static void _redis_hash_cache_put(redis_hash_cache *cache, int index, const char *key,
+                                       const redis_hash_member *hdesc_tbls, const void *data,
+                                       unsigned long long present, unsigned epoch)
+{
+    int len = strlen(key), size = _redis_hash_cache_image_size(hdesc_tbls);
+    unsigned hash = _redis_hash_cache_hash(index, key, len);
+    redis_hash_cache_shard *shard = _redis_hash_cache_shard(cache, hash);
+    redis_hash_cache_entry *e = NULL, *old = NULL, **bucket = NULL;
+    size_t bytes = sizeof(redis_hash_cache_entry) + size + len + 1;
+
+    if (bytes > shard->budget)
+    {
+        return;
+    }
+
+    e = (redis_hash_cache_entry *)malloc(bytes);
+    if (!e)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return;
+    }
+
+    e->hdesc_tbls = hdesc_tbls;
+    e->index = index;
+    e->hash = hash;
+    e->expire = _redis_hash_cache_now() + cache->ttl;
+    e->present = present;
+    e->size = size;
+    e->bytes = bytes;
+    e->key = (char *)e->image + size;
+    memcpy(e->image, data, size);
+    memcpy(e->key, key, len + 1);
+
+    pthread_mutex_lock(&shard->lock);
+
+    if (!cache->enabled || shard->epoch != epoch)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        free(e);
+        return;
+    }
+
+    bucket = _redis_hash_cache_bucket(shard, hash);
+    for (old = *bucket; old; old = old->hnext)
+    {
+        if (old->hash == hash && old->index == index && old->hdesc_tbls == hdesc_tbls && 0 == strcmp(old->key, key))
+        {
+            _redis_hash_cache_remove(shard, old);
+            break;
+        }
+    }
+
+    /* evict least recently used entries until it fits */
+    while (shard->bytes + bytes > shard->budget && shard->lru.prev != &shard->lru)
+    {
+        _redis_hash_cache_remove(shard, shard->lru.prev);
+    }
+
+    e->hnext = *bucket;
+    *bucket = e;
+    e->next = shard->lru.next;
+    e->prev = &shard->lru;
+    shard->lru.next->prev = e;
+    shard->lru.next = e;
+    shard->bytes += bytes;
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ * Drop every image of (index, key), index < 0 for all databases
+ */
+static void _redis_hash_cache_drop(redis_hash_cache *cache, int index, const char *key, int len)
+{
+    int i = 0;
+    unsigned hash = 0;
+    redis_hash_cache_shard *shard = NULL;
+    redis_hash_cache_entry *e = NULL, *next = NULL;
+
+    if (index >= 0)
+    {
+        hash = _redis_hash_cache_hash(index, key, len);
+        shard = _redis_hash_cache_shard(cache, hash);
+
+        pthread_mutex_lock(&shard->lock);
+
+        shard->epoch++;
+        for (e = *_redis_hash_cache_bucket(shard, hash); e; e = next)
+        {
+            next = e->hnext;
+            if (e->hash == hash && e->index == index && len == (int)strlen(e->key) && 0 == memcmp(e->key, key, len))
+            {
+                _redis_hash_cache_remove(shard, e);
+            }
+        }
+
+        pthread_mutex_unlock(&shard->lock);
+
+        return;
+    }
+
+    for (i = 0; i < REDIS_HASH_CACHE_SHARDS; ++i)
+    {
+        shard = &cache->shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+
+        shard->epoch++;
+        for (e = shard->lru.next; e != &shard->lru; e = next)
+        {
+            next = e->next;
+            if (len == (int)strlen(e->key) && 0 == memcmp(e->key, key, len))
+            {
+                _redis_hash_cache_remove(shard, e);
+            }
+        }
+
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+static void _redis_hash_cache_clear(redis_hash_cache *cache)
+{
+    int i = 0;
+    redis_hash_cache_shard *shard = NULL;
+
+    for (i = 0; i < REDIS_HASH_CACHE_SHARDS; ++i)
+    {
+        shard = &cache->shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+
+        shard->epoch++;
+        while (shard->lru.next != &shard->lru)
+        {
+            _redis_hash_cache_remove(shard, shard->lru.next);
+        }
+
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/**
+ * Invalidation message handler, runs on a subscribe dispatch thread
+ *
+ * keyspace notification: channel `__keyspace@<index>__:<key>'
+ * configured channel   : message `<index>:<key>'
+ */
+static void _redis_hash_cache_on_message(const char *pattern, const char *channel,
+                                              const char *message, int length, void *arg)
+{
+    int index = -1;
+    char *end = NULL;
+    const char *key = NULL;
+    redis_hash_cache *cache = (redis_hash_cache *)arg;
+
+    if (!cache->enabled)
+    {
+        return;
+    }
+
+    if (pattern)
+    {
+        index = strtol(channel + strlen("__keyspace@"), &end, 10);
+        if (0 != strncmp(end, "__:", 3))
+        {
+            return;
+        }
+
+        key = end + 3;
+        _redis_hash_cache_drop(cache, index, key, strlen(key));
+    }
+    else
+    {
+        index = strtol(message, &end, 10);
+        if (end == message || ':' != *end)
+        {
+            return;
+        }
+
+        key = end + 1;
+        _redis_hash_cache_drop(cache, index, key, length - (key - message));
+    }
+}
+
+/**
+ * Called after a write to hash `key', drop cached images and tell other processes
+ * through the invalidation channel. Write of other modules (Key.DEL) call it as well.
+ *
+ * A write appended to pipeline hasn't run yet, dropping now would let a read
+ * cache the old value again until ttl: it is queued for pipeline_exec instead.
+ */
+void _redis_hash_cache_invalidate(redis_client *this, int index, const char *key)
+{
+    int len = 0;
+    char message[MAX_SINGLE_CMD_LEN] = {0};
+    redis_hash_cache_key *pending = NULL;
+    redis_hash_cache *cache = this->origin ? this->origin->Hash.cache : this->Hash.cache;
+
+    if (!cache || !cache->enabled)
+    {
+        return;
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        len = strlen(key);
+        pending = (redis_hash_cache_key *)malloc(sizeof(redis_hash_cache_key) + len + 1);
+        if (pending)
+        {
+            pending->index = index;
+            memcpy(pending->key, key, len + 1);
+            pending->next = this->Hash.cache_pending;
+            this->Hash.cache_pending = pending;
+
+            REDIS_UNLOCK(this);
+            return;
+        }
+
+        /* better early than never */
+        EMI_LOG("%s: FATAL, out of memory, invalidate before exec\n", __FUNCTION__);
+    }
+
+    _redis_hash_cache_drop(cache, index, key, strlen(key));
+
+    if ('\0' != cache->channel[0])
+    {
+        len = snprintf(message, sizeof(message), "%d:%s", index, key);
+        if (len >= (int)sizeof(message))
+        {
+            len = sizeof(message) - 1;
+        }
+
+        this->Publish.PUBLISH(this, cache->channel, message, len);
+    }
+
+    REDIS_UNLOCK(this);
+}
+
+/**
+ * Invalidations queued while in pipeline mode, called by pipeline_exec once the
+ * writes ran. Still in pipeline mode, so their PUBLISHes go out in one round trip.
+ *
+ * @return count of commands appended to pipeline
+ */
+int _redis_hash_cache_flush(redis_client *this)
+{
+    int count = 0, len = 0;
+    char message[MAX_SINGLE_CMD_LEN] = {0};
+    redis_hash_cache_key *pending = NULL;
+    redis_hash_cache *cache = this->origin ? this->origin->Hash.cache : this->Hash.cache;
+
+    while ((pending = this->Hash.cache_pending))
+    {
+        this->Hash.cache_pending = pending->next;
+
+        if (cache && cache->enabled)
+        {
+            _redis_hash_cache_drop(cache, pending->index, pending->key, strlen(pending->key));
+
+            if ('\0' != cache->channel[0])
+            {
+                len = snprintf(message, sizeof(message), "%d:%s", pending->index, pending->key);
+                if (len >= (int)sizeof(message))
+                {
+                    len = sizeof(message) - 1;
+                }
+
+                if (REDIS_OK == this->Publish.PUBLISH(this, cache->channel, message, len))
+                {
+                    count++;
+                }
+            }
+        }
+
+        free(pending);
+    }
+
+    return count;
+}
+
+static redis_hash_cache *_redis_hash_cache_lookup(redis_client *this)
+{
+    /* thread-local handles share the cache of their client */
+    redis_hash_cache *cache = this->origin ? this->origin->Hash.cache : this->Hash.cache;
+
+    return (cache && cache->enabled) ? cache : NULL;
+}
+
+
 /**
  * @retrun
  * REDIS_OK :  success
@@ -231,7 +737,7 @@ int redis_hash_hset(redis_client *this, int index, const char *key,
 
     if (REDIS_INT == hdesc_tbls[i].data_type)
     {
-        snprintf(cmd, sizeof(cmd), "HSET %s %s %d", key, member, *(int *)(data + hdesc_tbls[i].offset));
+        snprintf(cmd, sizeof(cmd), "HSET %s %s %d", key, _redis_member_wire(&hdesc_tbls[i]), *(int *)(data + hdesc_tbls[i].offset));
     }
     else
     {
@@ -240,11 +746,11 @@ int redis_hash_hset(redis_client *this, int index, const char *key,
             EMI_LOG("%s: member[%s] value is empty, do nothing\n", __FUNCTION__, member);
             return REDIS_OK;
         }
-        snprintf(cmd, sizeof(cmd), "HSET %s %s %.*s", key, member, 
+        snprintf(cmd, sizeof(cmd), "HSET %s %s %.*s", key, _redis_member_wire(&hdesc_tbls[i]), 
                                     hdesc_tbls[i].data_size, (char *)(data + hdesc_tbls[i].offset));
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -255,7 +761,9 @@ int redis_hash_hset(redis_client *this, int index, const char *key,
         rc = _redis_hash_set_s(this, index, cmd);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -279,7 +787,7 @@ int redis_hash_hset2(redis_client *this, int index, const char *key, const char
 
     snprintf(cmd, sizeof(cmd), "HSET %s %s %s", key, member, value);
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -290,7 +798,9 @@ int redis_hash_hset2(redis_client *this, int index, const char *key, const char
         rc = _redis_hash_set_s(this, index, cmd);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -341,7 +851,7 @@ int redis_hash_hmset(redis_client *this, int index, const char *key,
 
         if (REDIS_INT == hdesc_tbls[i].data_type)
         {
-            len += snprintf(cmd + len, sizeof(cmd) - len, " %s %d", member, 
+            len += snprintf(cmd + len, sizeof(cmd) - len, " %s %d", _redis_member_wire(&hdesc_tbls[i]), 
                             *(int *)(data + hdesc_tbls[i].offset));
         }
         else
@@ -351,7 +861,7 @@ int redis_hash_hmset(redis_client *this, int index, const char *key,
                 EMI_LOG("%s: member[%s] value is empty\n", __FUNCTION__, member);
                 continue;
             }
-            len += snprintf(cmd + len, sizeof(cmd) - len, " %s %.*s", member, 
+            len += snprintf(cmd + len, sizeof(cmd) - len, " %s %.*s", _redis_member_wire(&hdesc_tbls[i]), 
                             hdesc_tbls[i].data_size, (char *)(data + hdesc_tbls[i].offset));
         }
 
@@ -365,7 +875,7 @@ int redis_hash_hmset(redis_client *this, int index, const char *key,
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -376,7 +886,9 @@ int redis_hash_hmset(redis_client *this, int index, const char *key,
         rc = _redis_hash_set_s(this, index, cmd);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -384,8 +896,11 @@ int redis_hash_hmset(redis_client *this, int index, const char *key,
 int redis_hash_hsetall(redis_client *this, int index, const char *key, redis_hash_member *hdesc_tbls, const void *data)
 {
     int rc = REDIS_OK;
-    int i = 0, len = 0, count = 0;
-    char cmd[MAX_SINGLE_CMD_LEN] = {0};
+    int i = 0, n = 0, len = 0, argc = 2;
+    char *ints = NULL, **bufs = NULL;
+    const char **argv = NULL;
+    size_t *argvlen = NULL;
+    redisReply *reply = NULL;
 
     if (!this || index < 0 || !key || '\0' == key[0] || !hdesc_tbls || !data)
     {
@@ -393,47 +908,82 @@ int redis_hash_hsetall(redis_client *this, int index, const char *key, redis_has
         return REDIS_ERR;
     }
 
-    len = snprintf(cmd, sizeof(cmd), "HMSET %s", key);
+    for (n = 0; hdesc_tbls[n].member; ++n)
+    {
+        ;
+    }
 
-    for (i = 0; hdesc_tbls[i].member; ++i)
+    /* built as arguments, so values may hold spaces or be compressed */
+    argv = (const char **)malloc(sizeof(char *) * (2 * n + 2));
+    argvlen = (size_t *)malloc(sizeof(size_t) * (2 * n + 2));
+    bufs = (char **)malloc(sizeof(char *) * (2 * n + 2));
+    ints = (char *)malloc(12 * (n + 1));
+    if (!argv || !argvlen || !bufs || !ints)
     {
-        if (REDIS_INT == hdesc_tbls[i].data_type)
-        {
-            len += snprintf(cmd + len, sizeof(cmd) - len, " %s %d", hdesc_tbls[i].member, 
-                            *(int *)(data + hdesc_tbls[i].offset));
-        }
-        else
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        rc = REDIS_ERR;
+        goto on_free;
+    }
+
+    argv[0] = "HMSET";
+    argvlen[0] = 5;
+    argv[1] = key;
+    argvlen[1] = strlen(key);
+
+    for (i = 0; i < n; ++i)
+    {
+        len = _redis_member_encode(&hdesc_tbls[i], data, ints + 12 * i, 12, &argv[argc + 1]);
+        if (len < 0)
         {
-            if ('\0' == ((char *)(data + hdesc_tbls[i].offset))[0])
-            {
-                EMI_LOG("%s: member[%s] value is empty\n", __FUNCTION__, hdesc_tbls[i].member);
-                continue;
-            }
-            len += snprintf(cmd + len, sizeof(cmd) - len, " %s %.*s", hdesc_tbls[i].member, 
-                            hdesc_tbls[i].data_size, (char *)(data + hdesc_tbls[i].offset));
+            EMI_LOG("%s: member[%s] value is empty\n", __FUNCTION__, hdesc_tbls[i].member);
+            continue;
         }
 
-        count++;
+        argv[argc] = _redis_member_wire(&hdesc_tbls[i]);
+        argvlen[argc] = strlen(argv[argc]);
+        argvlen[argc + 1] = len;
+        argc += 2;
     }
 
-    if (0 == count)
+    if (2 == argc)
     {
         EMI_LOG("%s: no member specified or all member is empty\n", __FUNCTION__);
-        return REDIS_ERR;
+        rc = REDIS_ERR;
+        goto on_free;
     }
 
-    pthread_mutex_lock(&this->lock);
+    _redis_compress_argv(this, argc, argv, argvlen, 3, 2, bufs);
+
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
-        rc = _redis_hash_set_p(this, index, cmd);
+        rc = _redis_command_argv_p(this, index, argc, argv, argvlen);
+    }
+    else if (REDIS_OK != (rc = _redis_try_connect_nonblock(this, index)))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+    }
+    else if ((reply = _redis_command_argv(this, argc, argv, argvlen)))
+    {
+        freeReplyObject(reply);
     }
     else
     {
-        rc = _redis_hash_set_s(this, index, cmd);
+        rc = REDIS_ERR;
     }
 
-    pthread_mutex_unlock(&this->lock);
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
+
+    _redis_compress_release(argc, bufs);
+
+on_free:
+    free(argv);
+    free(argvlen);
+    free(bufs);
+    free(ints);
 
     return rc;
 }
@@ -444,6 +994,7 @@ int redis_hash_hget(redis_client *this, int index, const char *key,
     int rc = REDIS_OK;
     int i = 0;
     char *value = NULL;
+    redis_hash_cache *cache = NULL;
     char cmd[MAX_SINGLE_CMD_LEN] = {0};
 
     if (!this || index < 0 || !key || '\0' == key[0] || 
@@ -467,9 +1018,15 @@ int redis_hash_hget(redis_client *this, int index, const char *key,
         return REDIS_ERR;
     }
 
+    cache = _redis_hash_cache_lookup(this);
+    if (cache && _redis_hash_cache_get(cache, index, key, hdesc_tbls, data, &hdesc_tbls[i]))
+    {
+        return REDIS_OK;
+    }
+
     memset(data + hdesc_tbls[i].offset, 0, hdesc_tbls[i].data_size);
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -486,7 +1043,7 @@ int redis_hash_hget(redis_client *this, int index, const char *key,
         goto on_ret;
     }
 
-    snprintf(cmd, sizeof(cmd), "HGET %s %s", key, member);
+    snprintf(cmd, sizeof(cmd), "HGET %s %s", key, _redis_member_wire(&hdesc_tbls[i]));
 
     value = _redis_command_string(this, cmd);
     if (!value)
@@ -507,7 +1064,7 @@ int redis_hash_hget(redis_client *this, int index, const char *key,
     free(value);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -524,7 +1081,7 @@ char *redis_hash_hget2(redis_client *this, int index, const char *key, const cha
         return NULL;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -544,7 +1101,7 @@ char *redis_hash_hget2(redis_client *this, int index, const char *key, const cha
     value = _redis_command_string(this, cmd);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return value;
 }
@@ -595,7 +1152,7 @@ int redis_hash_hmget(redis_client *this, int index, const char *key, redis_hash_
 
         memset(data + hdesc_tbls[i].offset, 0, hdesc_tbls[i].data_size);
 
-        len += snprintf(cmd + len, sizeof(cmd) - len, " %s", member);
+        len += snprintf(cmd + len, sizeof(cmd) - len, " %s", _redis_member_wire(&hdesc_tbls[i]));
 
         count ++;
     }
@@ -607,7 +1164,7 @@ int redis_hash_hmget(redis_client *this, int index, const char *key, redis_hash_
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -668,7 +1225,7 @@ int redis_hash_hmget(redis_client *this, int index, const char *key, redis_hash_
     rc = REDIS_OK;
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -676,10 +1233,18 @@ on_ret:
 int redis_hash_hgetall(redis_client *this, int index, const char *key, redis_hash_member *hdesc_tbls, void *data)
 {
     int rc = REDIS_OK;
-    int i = 0, len = 0;
+    int i = 0, len = 0, found = REDIS_FALSE, leader = REDIS_TRUE;
     int data_size = 0;
+    unsigned epoch = 0;
+    unsigned long long present = 0;
+    size_t size = 0;
+    void *image = NULL;
     redis_member *redis_members = NULL;
+    redis_hash_cache *cache = NULL;
+    redis_flight *flight = NULL;
     char cmd[MAX_SINGLE_CMD_LEN] = {0};
+    long long since = 0;
+    redis_client *conn = NULL;
 
     if (!this || index < 0 || !key || '\0' == key[0] || !hdesc_tbls || !data)
     {
@@ -687,13 +1252,15 @@ int redis_hash_hgetall(redis_client *this, int index, const char *key, redis_has
         return REDIS_ERR;
     }
 
+    conn = _redis_replica_pick(this, &index, &since);
+
     len = snprintf(cmd, sizeof(cmd), "HMGET %s", key);
 
     for (i = 0; hdesc_tbls[i].member; ++i)
     {
         data_size += hdesc_tbls[i].data_size;
 
-        len += snprintf(cmd + len, sizeof(cmd) - len, " %s", hdesc_tbls[i].member);
+        len += snprintf(cmd + len, sizeof(cmd) - len, " %s", _redis_member_wire(&hdesc_tbls[i]));
     }
 
     if (0 == i)
@@ -702,18 +1269,46 @@ int redis_hash_hgetall(redis_client *this, int index, const char *key, redis_has
         return REDIS_ERR;
     }
 
+    cache = _redis_hash_cache_lookup(this);
+    if (cache)
+    {
+        if (_redis_hash_cache_get(cache, index, key, hdesc_tbls, data, NULL))
+        {
+            return REDIS_OK;
+        }
+
+        epoch = _redis_hash_cache_epoch(cache, index, key);
+    }
+
     memset(data, 0, data_size);
 
-    pthread_mutex_lock(&this->lock);
+    /* share the result of an identical HGETALL in flight */
+    if (this->pipeline < 0)
+    {
+        flight = _redis_flight_begin(this, index, "HGETALL", key, hdesc_tbls, &leader);
+        if (flight && !leader)
+        {
+            rc = _redis_flight_wait(this, flight, &image, &size);
+            if (image)
+            {
+                memcpy(data, image, size);
+                free(image);
+            }
 
-    if (this->pipeline >= 0)
+            return rc;
+        }
+    }
+
+    REDIS_LOCK(conn);
+
+    if (conn->pipeline >= 0)
     {
         EMI_LOG("%s: Hash.HGETALL don't support pipeline mode\n", __FUNCTION__);
         rc = REDIS_ERR;
         goto on_ret;
     }
 
-    rc = _redis_try_connect_nonblock(this, index);
+    rc = _redis_try_connect_nonblock(conn, index);
     if (REDIS_OK != rc)
     {
         EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
@@ -721,7 +1316,17 @@ int redis_hash_hgetall(redis_client *this, int index, const char *key, redis_has
         goto on_ret;
     }
 
-    rc = _redis_command_strings(this, cmd, REDIS_FALSE, &redis_members);
+    /* a replica may not have our own writes yet, only primary reads are cached, unhedged
+     * as the hedge may be answered by a replica */
+    if (cache && conn == this)
+    {
+        rc = _redis_command_strings(conn, cmd, REDIS_FALSE, &redis_members);
+    }
+    else
+    {
+        rc = _redis_replica_strings(this, conn, index, cmd, &redis_members);
+    }
+
     if (rc <= 0)
     {
         rc = REDIS_ERR;
@@ -747,13 +1352,403 @@ int redis_hash_hgetall(redis_client *this, int index, const char *key, redis_has
         {
             snprintf((char *)(data + hdesc_tbls[i].offset), hdesc_tbls[i].data_size, "%s", redis_members[i].member);
         }
+
+        if ('\0' != redis_members[i].member[0])
+        {
+            found = REDIS_TRUE;
+            present |= REDIS_HASH_CACHE_BIT(i);
+        }
+    }
+
+    if (cache && found && conn == this)
+    {
+        _redis_hash_cache_put(cache, index, key, hdesc_tbls, data, present, epoch);
     }
 
     free(redis_members);
     rc = REDIS_OK;
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    _redis_replica_done(this, conn, since);
+
+    /* before a write waiting for the lock can run, it must not join this flight after */
+    if (flight)
+    {
+        _redis_flight_end(this, flight, rc, REDIS_OK == rc ? data : NULL, _redis_hash_cache_image_size(hdesc_tbls));
+    }
+
+    REDIS_UNLOCK(conn);
+
+    return rc;
+}
+
+int redis_hash_hgetall_batch(redis_client *this, int index, const char **keys, int count, 
+                                   redis_hash_member *hdesc_tbls, void *out, int stride, int *o_found)
+{
+    int rc = -1;
+    int i = 0, j = 0, nmembers = 0, hits = 0;
+    unsigned long long present = 0;
+    const char **argv = NULL;
+    redisReply *reply = NULL, *value = NULL;
+    void *data = NULL;
+    unsigned *epochs = NULL;
+    redis_hash_cache *cache = NULL;
+
+    if (!this || index < 0 || !keys || count <= 0 || !hdesc_tbls || !out || stride <= 0 || !o_found)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    while (hdesc_tbls[nmembers].member)
+    {
+        nmembers++;
+    }
+
+    if (0 == nmembers)
+    {
+        EMI_LOG("%s: no member in hash desc table\n", __FUNCTION__);
+        return -1;
+    }
+
+    argv = (const char **)malloc(sizeof(char *) * (nmembers + 2));
+    if (!argv)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return -1;
+    }
+
+    argv[0] = "HMGET";
+    for (j = 0; j < nmembers; ++j)
+    {
+        argv[j + 2] = _redis_member_wire(&hdesc_tbls[j]);
+    }
+
+    memset(out, 0, (size_t)count * stride);
+    memset(o_found, 0, sizeof(int) * count);
+
+    /* serve hits from near cache, only misses go to server */
+    cache = _redis_hash_cache_lookup(this);
+    if (cache)
+    {
+        epochs = (unsigned *)malloc(sizeof(unsigned) * count);
+        if (!epochs)
+        {
+            EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+            free(argv);
+            return -1;
+        }
+
+        for (i = 0; i < count; ++i)
+        {
+            o_found[i] = _redis_hash_cache_get(cache, index, keys[i], hdesc_tbls, (char *)out + (size_t)i * stride, NULL);
+            epochs[i] = o_found[i] ? 0 : _redis_hash_cache_epoch(cache, index, keys[i]);
+            hits += o_found[i];
+        }
+
+        if (hits == count)
+        {
+            free(argv);
+            free(epochs);
+            return count;
+        }
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: Hash.HGETALL_BATCH don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    rc = 0;
+    for (i = 0; i < count; ++i)
+    {
+        if (o_found[i])
+        {
+            rc++;
+            continue;
+        }
+
+        argv[1] = keys[i];
+        if (REDIS_OK != redisAppendCommandArgv(this->redis, nmembers + 2, argv, NULL))
+        {
+            /* commands appended so far would answer later commands, drop them with the connection */
+            EMI_LOG("%s: redisAppendCommandArgv failed at key %s\n", __FUNCTION__, keys[i]);
+
+            redisFree(this->redis);
+            this->redis = NULL;
+            this->db_index = -1;
+
+            rc = -1;
+            goto on_ret;
+        }
+    }
+
+    EMI_LOG("%s: cmd[HMGET ...], keys[%d], cached[%d]\n", __FUNCTION__, count, rc);
+
+    for (i = 0; i < count; ++i)
+    {
+        /* cache hit */
+        if (o_found[i])
+        {
+            continue;
+        }
+
+        if (REDIS_OK != redisGetReply(this->redis, (void **)&reply))
+        {
+            EMI_LOG("%s: redisGetReply error: %s\n", __FUNCTION__, 
+                     REDIS_ERR_IO == this->redis->err ? strerror(errno) : this->redis->errstr);
+
+            redisFree(this->redis);
+            this->redis = NULL;
+            this->db_index = -1;
+
+            rc = -1;
+            goto on_ret;
+        }
+
+        _redis_reply_inflate(this, reply);
+
+        if (REDIS_REPLY_ARRAY != reply->type || nmembers != reply->elements)
+        {
+            EMI_LOG("%s: HMGET %s reply error: reply type[%d], %s\n", __FUNCTION__, keys[i], 
+                     reply->type, REDIS_REPLY_ERROR == reply->type ? reply->str : "");
+            freeReplyObject(reply);
+            rc = -1;
+            continue;
+        }
+
+        /* a missing hash replies all fields nil */
+        data = (char *)out + (size_t)i * stride;
+        present = 0;
+        for (j = 0; j < nmembers; ++j)
+        {
+            value = reply->element[j];
+            if (REDIS_REPLY_STRING == value->type)
+            {
+                _redis_member_decode(&hdesc_tbls[j], data, value->str, value->len);
+                o_found[i] = REDIS_TRUE;
+                present |= REDIS_HASH_CACHE_BIT(j);
+            }
+        }
+
+        if (rc >= 0 && o_found[i])
+        {
+            rc++;
+        }
+
+        if (cache && o_found[i])
+        {
+            _redis_hash_cache_put(cache, index, keys[i], hdesc_tbls, data, present, epochs[i]);
+        }
+
+        freeReplyObject(reply);
+    }
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    free(argv);
+    free(epochs);
+
+    return rc;
+}
+
+int redis_hash_hgetall_tracked(redis_client *this, int index, const char *key, 
+                                     redis_hash_member *hdesc_tbls, void *data, void *shadow)
+{
+    int rc = REDIS_OK;
+
+    if (!shadow)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    rc = redis_hash_hgetall(this, index, key, hdesc_tbls, data);
+    if (REDIS_OK == rc)
+    {
+        memcpy(shadow, data, _redis_hash_cache_image_size(hdesc_tbls));
+    }
+
+    return rc;
+}
+
+static int _redis_hash_member_dirty(const redis_hash_member *m, const void *data, const void *shadow)
+{
+    if (REDIS_INT == m->data_type)
+    {
+        return *(int *)(data + m->offset) != *(int *)(shadow + m->offset);
+    }
+
+    /* bytes after the terminator don't matter */
+    return 0 != strncmp((const char *)(data + m->offset), (const char *)(shadow + m->offset), m->data_size);
+}
+
+int redis_hash_hsetall_dirty(redis_client *this, int index, const char *key, 
+                                   redis_hash_member *hdesc_tbls, const void *data, void *shadow)
+{
+    int rc = REDIS_OK;
+    int i = 0, n = 0, len = 0, argc = 2, dargc = 2;
+    int written = REDIS_FALSE, deleted = REDIS_FALSE;
+    char *ints = NULL, *sent = NULL, **bufs = NULL;
+    const char **argv = NULL, **dargv = NULL;
+    size_t *argvlen = NULL;
+    redisReply *reply = NULL;
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !hdesc_tbls || !data || !shadow)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    for (n = 0; hdesc_tbls[n].member; ++n)
+    {
+        ;
+    }
+
+    argv = (const char **)malloc(sizeof(char *) * (2 * n + 2));
+    argvlen = (size_t *)malloc(sizeof(size_t) * (2 * n + 2));
+    dargv = (const char **)malloc(sizeof(char *) * (n + 2));
+    bufs = (char **)malloc(sizeof(char *) * (2 * n + 2));
+    ints = (char *)malloc(12 * (n + 1));
+    sent = (char *)calloc(n + 1, 1);
+    if (!argv || !argvlen || !dargv || !bufs || !ints || !sent)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        rc = -1;
+        goto on_free;
+    }
+
+    argv[0] = "HMSET";
+    argvlen[0] = 5;
+    argv[1] = key;
+    argvlen[1] = strlen(key);
+    dargv[0] = "HDEL";
+    dargv[1] = key;
+
+    for (i = 0; i < n; ++i)
+    {
+        if (!_redis_hash_member_dirty(&hdesc_tbls[i], data, shadow))
+        {
+            continue;
+        }
+
+        /* a field read back empty does not exist, so an emptied field is deleted */
+        len = _redis_member_encode(&hdesc_tbls[i], data, ints + 12 * i, 12, &argv[argc + 1]);
+        if (len < 0)
+        {
+            dargv[dargc++] = _redis_member_wire(&hdesc_tbls[i]);
+            sent[i] = 'D';
+            continue;
+        }
+
+        sent[i] = 'S';
+        argv[argc] = _redis_member_wire(&hdesc_tbls[i]);
+        argvlen[argc] = strlen(argv[argc]);
+        argvlen[argc + 1] = len;
+        argc += 2;
+    }
+
+    if (2 == argc && 2 == dargc)
+    {
+        rc = 0;
+        goto on_free;
+    }
+
+    _redis_compress_argv(this, argc, argv, argvlen, 3, 2, bufs);
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        if (argc > 2)
+        {
+            rc = _redis_command_argv_p(this, index, argc, argv, argvlen);
+            written = (REDIS_OK == rc);
+        }
+
+        if (REDIS_OK == rc && dargc > 2)
+        {
+            rc = _redis_command_argv_p(this, index, dargc, dargv, NULL);
+            deleted = (REDIS_OK == rc);
+        }
+
+        goto on_ret;
+    }
+
+    rc = _redis_try_connect_nonblock(this, index);
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    if (argc > 2)
+    {
+        reply = _redis_command_argv(this, argc, argv, argvlen);
+        if (!reply)
+        {
+            rc = REDIS_ERR;
+            goto on_ret;
+        }
+
+        freeReplyObject(reply);
+        written = REDIS_TRUE;
+    }
+
+    if (dargc > 2)
+    {
+        reply = _redis_command_argv(this, dargc, dargv, NULL);
+        if (!reply)
+        {
+            rc = REDIS_ERR;
+            goto on_ret;
+        }
+
+        freeReplyObject(reply);
+        deleted = REDIS_TRUE;
+    }
+
+on_ret:
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
+
+    _redis_compress_release(argc, bufs);
+
+    /* fields of every command that went through are the new baseline, even if the other failed */
+    for (i = 0; i < n; ++i)
+    {
+        if (('S' == sent[i] && written) || ('D' == sent[i] && deleted))
+        {
+            memcpy(shadow + hdesc_tbls[i].offset, data + hdesc_tbls[i].offset, hdesc_tbls[i].data_size);
+        }
+    }
+
+    if (REDIS_OK != rc)
+    {
+        rc = -1;
+        goto on_free;
+    }
+
+    rc = (argc - 2) / 2 + dargc - 2;
+
+on_free:
+    free(argv);
+    free(argvlen);
+    free(dargv);
+    free(bufs);
+    free(ints);
+    free(sent);
 
     return rc;
 }
@@ -768,7 +1763,7 @@ int redis_hash_hdel(redis_client *this, int index, const char *key, const char *
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -779,7 +1774,9 @@ int redis_hash_hdel(redis_client *this, int index, const char *key, const char *
         rc = _redis_hash_hdel_s(this, index, key, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -795,7 +1792,7 @@ int redis_hash_hexists(redis_client *this, int index, const char *key, const cha
         return REDIS_FALSE;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -818,7 +1815,7 @@ int redis_hash_hexists(redis_client *this, int index, const char *key, const cha
     rc = (0 != rc && -1 != rc) ? REDIS_TRUE : REDIS_FALSE;
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -833,7 +1830,7 @@ int redis_hash_hincrby(redis_client *this, int index, const char *key, const cha
         return REDIS_FALSE;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -844,32 +1841,277 @@ int redis_hash_hincrby(redis_client *this, int index, const char *key, const cha
         rc = _redis_hash_hincrby_s(this, index, key, member, increment);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+
+int redis_hash_hdelm(redis_client *this, int index, const char *key, const char **members, int count)
+{
+    int rc = -1;
+    const char *head[2] = {"HDEL", key};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !members || count <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    REDIS_LOCK(this);
+
+    rc = _redis_command_chunked(this, index, head, 2, members, count, 1);
+
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
 
     return rc;
 }
 
+int redis_hash_cache_enable(redis_client *this, size_t budget, int ttl, const char *channel)
+{
+    int i = 0, rc = REDIS_ERR;
+    unsigned nbuckets = 64;
+    redis_hash_cache *cache = NULL;
+    redis_hash_cache_shard *shard = NULL;
+
+    if (!this || budget < REDIS_HASH_CACHE_SHARDS * 1024 || ttl <= 0 || 
+        (channel && ('\0' == channel[0] || strlen(channel) >= MAX_MEMBER_LEN)))
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    REDIS_LOCK(this);
+
+    cache = this->Hash.cache;
+    if (cache && cache->enabled)
+    {
+        EMI_LOG("%s: near cache allready enabled\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    /* allocated once and kept until deinit, dispatch threads may still hold it */
+    if (!cache)
+    {
+        cache = (redis_hash_cache *)calloc(1, sizeof(redis_hash_cache));
+        if (!cache)
+        {
+            EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+            goto on_ret;
+        }
+
+        /* about one bucket per 512 bytes of budget */
+        while (nbuckets < budget / REDIS_HASH_CACHE_SHARDS / 512 && nbuckets < (1u << 20))
+        {
+            nbuckets <<= 1;
+        }
+
+        for (i = 0; i < REDIS_HASH_CACHE_SHARDS; ++i)
+        {
+            shard = &cache->shards[i];
+
+            pthread_mutex_init(&shard->lock, NULL);
+            shard->lru.prev = shard->lru.next = &shard->lru;
+            shard->nbuckets = nbuckets;
+        }
+
+        this->Hash.cache = cache;
+
+        for (i = 0; i < REDIS_HASH_CACHE_SHARDS; ++i)
+        {
+            shard = &cache->shards[i];
+
+            shard->buckets = (redis_hash_cache_entry **)calloc(nbuckets, sizeof(redis_hash_cache_entry *));
+            if (!shard->buckets)
+            {
+                EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+                redis_hash_deinit(&this->Hash);
+                goto on_ret;
+            }
+        }
+    }
+
+    for (i = 0; i < REDIS_HASH_CACHE_SHARDS; ++i)
+    {
+        cache->shards[i].budget = budget / REDIS_HASH_CACHE_SHARDS;
+    }
+
+    cache->ttl = ttl;
+    snprintf(cache->channel, sizeof(cache->channel), "%s", channel ? channel : "");
+    cache->enabled = REDIS_TRUE;
+
+    if (channel)
+    {
+        rc = this->Subscribe.SUBSCRIBE(this, channel, _redis_hash_cache_on_message, cache);
+    }
+    else
+    {
+        rc = this->Subscribe.PSUBSCRIBE(this, "__keyspace@*__:*", _redis_hash_cache_on_message, cache);
+    }
+
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: subscribe invalidation failed\n", __FUNCTION__);
+        cache->enabled = REDIS_FALSE;
+    }
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+int redis_hash_cache_disable(redis_client *this)
+{
+    redis_hash_cache *cache = NULL;
+
+    if (!this)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    REDIS_LOCK(this);
+
+    cache = this->Hash.cache;
+    if (cache && cache->enabled)
+    {
+        cache->enabled = REDIS_FALSE;
+
+        if ('\0' != cache->channel[0])
+        {
+            this->Subscribe.UNSUBSCRIBE(this, cache->channel);
+        }
+        else
+        {
+            this->Subscribe.PUNSUBSCRIBE(this, "__keyspace@*__:*");
+        }
+
+        _redis_hash_cache_clear(cache);
+    }
+
+    REDIS_UNLOCK(this);
+
+    return REDIS_OK;
+}
+
+int redis_hash_desc_compact(redis_hash_member *hdesc_tbls)
+{
+    int i = 0, j = 0;
+    static const char base62[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    if (!hdesc_tbls)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    for (i = 0; hdesc_tbls[i].member; ++i)
+    {
+        if ('\0' != hdesc_tbls[i].code[0])
+        {
+            continue;
+        }
+
+        if (i < 62)
+        {
+            hdesc_tbls[i].code[0] = base62[i];
+        }
+        else if (i < 62 + 62 * 62)
+        {
+            hdesc_tbls[i].code[0] = base62[(i - 62) / 62];
+            hdesc_tbls[i].code[1] = base62[(i - 62) % 62];
+        }
+        else
+        {
+            EMI_LOG("%s: too many members in hash desc table\n", __FUNCTION__);
+            return REDIS_ERR;
+        }
+    }
+
+    for (i = 0; hdesc_tbls[i].member; ++i)
+    {
+        for (j = i + 1; hdesc_tbls[j].member; ++j)
+        {
+            if (0 == strcmp(_redis_member_wire(&hdesc_tbls[i]), _redis_member_wire(&hdesc_tbls[j])))
+            {
+                EMI_LOG("%s: member[%s] and member[%s] have the same wire name[%s]\n", __FUNCTION__,
+                         hdesc_tbls[i].member, hdesc_tbls[j].member, _redis_member_wire(&hdesc_tbls[i]));
+                return REDIS_ERR;
+            }
+        }
+    }
+
+    return REDIS_OK;
+}
 
 int redis_hash_init(redis_hash *Hash)
 {
-    Hash->HSET    = redis_hash_hset;
-    Hash->HSET2   = redis_hash_hset2;
-    Hash->HMSET   = redis_hash_hmset;
-    Hash->HSETALL = redis_hash_hsetall;
-    Hash->HGET    = redis_hash_hget;
-    Hash->HGET2   = redis_hash_hget2;
-    Hash->HMGET   = redis_hash_hmget;
-    Hash->HGETALL = redis_hash_hgetall;
-    Hash->HDEL    = redis_hash_hdel;
-    Hash->HEXISTS = redis_hash_hexists;
-    Hash->HINCRBY = redis_hash_hincrby;
+    Hash->HSET            = redis_hash_hset;
+    Hash->HSET2           = redis_hash_hset2;
+    Hash->HMSET           = redis_hash_hmset;
+    Hash->HSETALL         = redis_hash_hsetall;
+    Hash->HGET            = redis_hash_hget;
+    Hash->HGET2           = redis_hash_hget2;
+    Hash->HMGET           = redis_hash_hmget;
+    Hash->HGETALL         = redis_hash_hgetall;
+    Hash->HGETALL_BATCH   = redis_hash_hgetall_batch;
+    Hash->HGETALL_TRACKED = redis_hash_hgetall_tracked;
+    Hash->HSETALL_DIRTY   = redis_hash_hsetall_dirty;
+    Hash->HDEL            = redis_hash_hdel;
+    Hash->HEXISTS         = redis_hash_hexists;
+    Hash->HINCRBY         = redis_hash_hincrby;
+    Hash->HDELM           = redis_hash_hdelm;
+    Hash->cache_enable    = redis_hash_cache_enable;
+    Hash->cache_disable   = redis_hash_cache_disable;
+
+    Hash->cache           = NULL;
+    Hash->cache_pending   = NULL;
 
     return REDIS_OK;
 }
 
+/**
+ * Subscribe must be deinited first, so no dispatch thread touches the cache
+ */
 void redis_hash_deinit(redis_hash *Hash)
 {
-    ;
+    int i = 0;
+    redis_hash_cache *cache = Hash->cache;
+    redis_hash_cache_key *pending = NULL;
+
+    while ((pending = Hash->cache_pending))
+    {
+        Hash->cache_pending = pending->next;
+        free(pending);
+    }
+
+    if (!cache)
+    {
+        return;
+    }
+
+    for (i = 0; i < REDIS_HASH_CACHE_SHARDS; ++i)
+    {
+        if (cache->shards[i].buckets)
+        {
+            while (cache->shards[i].lru.next != &cache->shards[i].lru)
+            {
+                _redis_hash_cache_remove(&cache->shards[i], cache->shards[i].lru.next);
+            }
+
+            free(cache->shards[i].buckets);
+        }
+
+        pthread_mutex_destroy(&cache->shards[i].lock);
+    }
+
+    free(cache);
+    Hash->cache = NULL;
 }
 
 
@@ -3,10 +3,21 @@
 #define __REDIS_HASH_H
 
 
+#include <stddef.h>
+
 #include "redis_types.h"
 #include "redis_hash_desc.h"
 
 
+/**
+ * Shards of near cache, each has its own lock and LRU list
+ */
+#define REDIS_HASH_CACHE_SHARDS     16
+
+struct __redis_hash_cache;
+typedef struct __redis_hash_cache redis_hash_cache;
+
+
 typedef struct __redis_hash
 {
     int   (*HSET)(redis_client *this, int index, const char *key, redis_hash_member *hdesc_tbls, const void *data, const char *member);
@@ -17,13 +28,91 @@ typedef struct __redis_hash
     char* (*HGET2)(redis_client *this, int index, const char *key, const char *member);
     int   (*HMGET)(redis_client *this, int index, const char *key, redis_hash_member *hdesc_tbls, void *data, ...);
     int   (*HGETALL)(redis_client *this, int index, const char *key, redis_hash_member *hdesc_tbls, void *data);
+
+    /**
+     * Load `count' hashes with pipelined HMGETs in one round trip, 
+     * hash keys[i] is decoded into out + i * stride, o_found[i] tells if it exists.
+     *
+     * @return count of hashes exist, < 0 on failure
+     */
+    int   (*HGETALL_BATCH)(redis_client *this, int index, const char **keys, int count, 
+                           redis_hash_member *hdesc_tbls, void *out, int stride, int *o_found);
+
+    /**
+     * HGETALL that also copies the struct image into `shadow', as large as data,
+     * so HSETALL_DIRTY can tell which fields the caller changed since
+     */
+    int   (*HGETALL_TRACKED)(redis_client *this, int index, const char *key, 
+                             redis_hash_member *hdesc_tbls, void *data, void *shadow);
+
+    /**
+     * Write only fields of data that differ from `shadow' with one HMSET, fields
+     * changed to empty string are deleted with HDEL, as HGETALL reads them back empty.
+     * Nothing is sent when no field changed. Fields of each command that succeeded
+     * are copied to shadow, also when the other one failed.
+     *
+     * @return count of fields written, 0 if none changed, < 0 on failure
+     */
+    int   (*HSETALL_DIRTY)(redis_client *this, int index, const char *key, 
+                           redis_hash_member *hdesc_tbls, const void *data, void *shadow);
     int   (*HDEL)(redis_client *this, int index, const char *key, const char *member);
     int   (*HEXISTS)(redis_client *this, int index, const char *key, const char *member);
     int   (*HINCRBY)(redis_client *this, int index, const char *key, const char *member, int increment);
 
+    /**
+     * Delete `count' fields with commands of at most chunk_args fields
+     *
+     * @return count of fields deleted, < 0 on failure, 0 in pipeline mode
+     */
+    int   (*HDELM)(redis_client *this, int index, const char *key, const char **members, int count);
+
+    /**
+     * Enable in-process near cache of struct images decoded by HGETALL and HGETALL_BATCH,
+     * keyed by (index, key, hdesc_tbls). HGETALL, HGETALL_BATCH and HGET of a cached key
+     * cost no round trip. Hashes that do not exist are not cached, nor are HGETALL
+     * images read from a replica.
+     *
+     * Images live at most `ttl' ms and are evicted least recently used first once the
+     * cache takes more than `budget' bytes. Writes through this client (Hash.*, Key.DEL)
+     * drop images at once, or once pipeline_exec ran them in pipeline mode. HGET of a
+     * field the cached hash has no value for asks the server. Writes of others are
+     * learned through Subscribe:
+     * - channel == NULL: keyspace notifications, server needs notify-keyspace-events "Kh$g"
+     *                    or wider
+     * - channel != NULL: messages `<index>:<key>', this client also publishes one there 
+     *                    after each of its writes
+     * Messages missed while the subscriber reconnects are only bounded by ttl.
+     *
+     * @param
+     * budget: bytes of memory, entry overhead included
+     * ttl   : ms
+     */
+    int   (*cache_enable)(redis_client *this, size_t budget, int ttl, const char *channel);
+
+    /**
+     * Disable near cache and drop all images
+     */
+    int   (*cache_disable)(redis_client *this);
+
+    redis_hash_cache *cache;
+    struct __redis_hash_cache_key *cache_pending;   /* Invalidations of pipelined writes, for pipeline_exec */
+
 } redis_hash;
 
 
+/**
+ * Switch table to compact mode, every member without a code gets a 1-2 char base62
+ * code from its position, sent on the wire by all Hash and Stream APIs taking the
+ * table instead of its name. Codes may also be set by hand in the table.
+ *
+ * Generated codes depend on position: only ever append members to a compact table,
+ * hashes written through it are not readable through a table of full names.
+ * Call once before the table is used.
+ *
+ * @return REDIS_ERR if table has too many members or two wire names collide
+ */
+int redis_hash_desc_compact(redis_hash_member *hdesc_tbls);
+
 int redis_hash_init(redis_hash *Hash);
 void redis_hash_deinit(redis_hash *Hash);
 
@@ -16,6 +16,7 @@ typedef struct __redis_hash_member
     dtype         data_type;
     int           data_size;
     int           offset;
+    char          code[4];      /* Short field name on the wire, "" for member, see redis_hash_desc_compact */
 
 } redis_hash_member;
 
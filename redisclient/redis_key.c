@@ -145,7 +145,7 @@ int redis_key_del(redis_client *this, int index, const char *key)
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -156,7 +156,9 @@ int redis_key_del(redis_client *this, int index, const char *key)
         rc = _redis_key_del_s(this, index, key);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    _redis_hash_cache_invalidate(this, index, key);
+
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -177,7 +179,7 @@ int redis_key_exists(redis_client *this, int index, const char *key)
         return REDIS_FALSE;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -200,7 +202,7 @@ int redis_key_exists(redis_client *this, int index, const char *key)
     rc = (0 != rc && -1 != rc) ? REDIS_TRUE : REDIS_FALSE;
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -216,7 +218,7 @@ int redis_key_expire(redis_client *this, int index, const char *key, unsigned se
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -227,7 +229,7 @@ int redis_key_expire(redis_client *this, int index, const char *key, unsigned se
         rc = _redis_key_expire_s(this, index, key, seconds);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -1,4 +1,5 @@
 
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <hiredis.h>
@@ -147,7 +148,8 @@ static int
 _redis_list_rem_s(redis_client *this, int index, const char *key, int count, const char *member)
 {
     int rc = -1;
-    char cmd[MAX_SINGLE_CMD_LEN] = {0};
+    char count_b[12] = {0};
+    const char *argv[4] = {"LREM", key, count_b, member};
 
     rc = _redis_try_connect_nonblock(this, index);
     if (REDIS_OK != rc)
@@ -156,9 +158,10 @@ _redis_list_rem_s(redis_client *this, int index, const char *key, int count, con
         return -1;
     }
 
-    snprintf(cmd, sizeof(cmd), "LREM %s %d %s", key, count, member);
+    /* member may be an arbitrary job payload, keep it as one argument */
+    snprintf(count_b, sizeof(count_b), "%d", count);
 
-    rc = _redis_command_int(this, cmd);
+    rc = _redis_command_argv_int(this, 4, argv, NULL);
 
     return rc;
 }
@@ -174,7 +177,7 @@ int redis_list_lpush(redis_client *this, int index, const char *key, const char
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -185,7 +188,7 @@ int redis_list_lpush(redis_client *this, int index, const char *key, const char
         rc = _redis_list_push_s(this, index, REDIS_TRUE, key, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -200,7 +203,7 @@ int redis_list_rpush(redis_client *this, int index, const char *key, const char
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -211,7 +214,7 @@ int redis_list_rpush(redis_client *this, int index, const char *key, const char
         rc = _redis_list_push_s(this, index, REDIS_FALSE, key, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -228,7 +231,7 @@ char *redis_list_lpop(redis_client *this, int index, const char *key)
         return NULL;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -248,7 +251,7 @@ char *redis_list_lpop(redis_client *this, int index, const char *key)
     member = _redis_command_string(this, cmd);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return member;
 }
@@ -265,7 +268,7 @@ char *redis_list_rpop(redis_client *this, int index, const char *key)
         return NULL;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -285,7 +288,7 @@ char *redis_list_rpop(redis_client *this, int index, const char *key)
     member = _redis_command_string(this, cmd);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return member;
 }
@@ -301,7 +304,7 @@ char *redis_list_blpop(redis_client *this, int index, const char *key)
         return NULL;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -316,7 +319,7 @@ char *redis_list_blpop(redis_client *this, int index, const char *key)
     member = _redis_command_string(this, cmd);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return member;
 }
@@ -332,7 +335,7 @@ char *redis_list_brpop(redis_client *this, int index, const char *key)
         return NULL;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -347,7 +350,7 @@ char *redis_list_brpop(redis_client *this, int index, const char *key)
     member = _redis_command_string(this, cmd);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return member;
 }
@@ -363,7 +366,7 @@ int redis_list_llen(redis_client *this, int index, const char *key)
         return -1;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -384,7 +387,7 @@ int redis_list_llen(redis_client *this, int index, const char *key)
     rc = _redis_command_int(this, cmd);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -393,6 +396,8 @@ int redis_list_lrange(redis_client *this, int index, const char *key, int start,
 {
     int rc = -1;
     char cmd[MAX_SINGLE_CMD_LEN] = {0};
+    long long since = 0;
+    redis_client *conn = NULL;
 
     if (!this || index < 0 || !key || '\0' == key[0] || !o_members)
     {
@@ -400,18 +405,20 @@ int redis_list_lrange(redis_client *this, int index, const char *key, int start,
         return -1;
     }
 
+    conn = _redis_replica_pick(this, &index, &since);
+
     *o_members = NULL;
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(conn);
 
-    if (this->pipeline >= 0)
+    if (conn->pipeline >= 0)
     {
         EMI_LOG("%s: List.LRANGE don't support pipeline mode\n", __FUNCTION__);
         rc = -1;
         goto on_ret;
     }
 
-    rc = _redis_try_connect_nonblock(this, index);
+    rc = _redis_try_connect_nonblock(conn, index);
     if (REDIS_OK != rc)
     {
         EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
@@ -420,10 +427,11 @@ int redis_list_lrange(redis_client *this, int index, const char *key, int start,
     }
 
     snprintf(cmd, sizeof(cmd), "LRANGE %s %d %d", key, start, stop);
-    rc = _redis_command_strings(this, cmd, REDIS_FALSE, o_members);
+    rc = _redis_replica_strings(this, conn, index, cmd, o_members);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    _redis_replica_done(this, conn, since);
+    REDIS_UNLOCK(conn);
 
     return rc;
 }
@@ -438,7 +446,7 @@ int redis_list_lrem(redis_client *this, int index, const char *key, int count, c
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -449,23 +457,163 @@ int redis_list_lrem(redis_client *this, int index, const char *key, int count, c
         rc = _redis_list_rem_s(this, index, key, count, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+
+/**
+ * Push all members with LPUSH commands of at most chunk_args members,
+ * members[0] is pushed first.
+ */
+int redis_list_lpushm(redis_client *this, int index, const char *key, const char **members, int count)
+{
+    int rc = REDIS_OK;
+    const char *head[2] = {"LPUSH", key};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !members || count <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    REDIS_LOCK(this);
+
+    rc = _redis_command_chunked(this, index, head, 2, members, count, 1) < 0 ? REDIS_ERR : REDIS_OK;
+
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+/**
+ * Push all members with RPUSH commands of at most chunk_args members,
+ * members[0] is pushed first.
+ */
+int redis_list_rpushm(redis_client *this, int index, const char *key, const char **members, int count)
+{
+    int rc = REDIS_OK;
+    const char *head[2] = {"RPUSH", key};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !members || count <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    REDIS_LOCK(this);
+
+    rc = _redis_command_chunked(this, index, head, 2, members, count, 1) < 0 ? REDIS_ERR : REDIS_OK;
+
+    REDIS_UNLOCK(this);
 
     return rc;
 }
 
+/**
+ * Atomically pop the tail of source and push it to the head of destination.
+ *
+ * @return the moved member, caller must free it
+ * -  NULL: source is empty or command failed
+ */
+char *redis_list_rpoplpush(redis_client *this, int index, const char *source, const char *destination)
+{
+    int rc = REDIS_OK;
+    char *member = NULL;
+    const char *argv[3] = {"RPOPLPUSH", source, destination};
+
+    if (!this || index < 0 || !source || '\0' == source[0] || !destination || '\0' == destination[0])
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: List.RPOPLPUSH don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    rc = _redis_try_connect_nonblock(this, index);
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    member = _redis_command_argv_string(this, 3, argv, NULL);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return member;
+}
+
+/**
+ * Blocking RPOPLPUSH, waits at most timeout seconds (0: forever).
+ * BRPOPLPUSH is used instead of BLMOVE to keep working with servers before 6.2.
+ *
+ * @return the moved member, caller must free it
+ * -  NULL: timeout or command failed
+ */
+char *redis_list_brpoplpush(redis_client *this, int index, const char *source, const char *destination, int timeout)
+{
+    int rc = REDIS_OK;
+    char *member = NULL;
+    char timeout_b[12] = {0};
+    const char *argv[4] = {"BRPOPLPUSH", source, destination, timeout_b};
+
+    if (!this || index < 0 || !source || '\0' == source[0] || 
+        !destination || '\0' == destination[0] || timeout < 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: List.BRPOPLPUSH don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    rc = _redis_try_connect_nonblock(this, index);
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    snprintf(timeout_b, sizeof(timeout_b), "%d", timeout);
+
+    member = _redis_command_argv_string(this, 4, argv, NULL);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return member;
+}
+
 
 int redis_list_init(redis_list *List)
 {
-    List->LPUSH  = redis_list_lpush;
-    List->RPUSH  = redis_list_rpush;
-    List->LPOP   = redis_list_lpop;
-    List->RPOP   = redis_list_rpop;
-    List->BLPOP  = redis_list_blpop;
-    List->BRPOP  = redis_list_brpop;
-    List->LLEN   = redis_list_llen;
-    List->LRANGE = redis_list_lrange;
-    List->LREM   = redis_list_lrem;
+    List->LPUSH      = redis_list_lpush;
+    List->RPUSH      = redis_list_rpush;
+    List->LPOP       = redis_list_lpop;
+    List->RPOP       = redis_list_rpop;
+    List->BLPOP      = redis_list_blpop;
+    List->BRPOP      = redis_list_brpop;
+    List->LLEN       = redis_list_llen;
+    List->LRANGE     = redis_list_lrange;
+    List->LREM       = redis_list_lrem;
+    List->LPUSHM     = redis_list_lpushm;
+    List->RPUSHM     = redis_list_rpushm;
+    List->RPOPLPUSH  = redis_list_rpoplpush;
+    List->BRPOPLPUSH = redis_list_brpoplpush;
 
     return REDIS_OK;
 }
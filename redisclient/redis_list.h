@@ -17,6 +17,10 @@ typedef struct __redis_list
     int   (*LLEN)(redis_client *this, int index, const char *key);
     int   (*LRANGE)(redis_client *this, int index, const char *key, int start, int stop, redis_member **o_members);
     int   (*LREM)(redis_client *this, int index, const char *key, int count, const char *member);
+    int   (*LPUSHM)(redis_client *this, int index, const char *key, const char **members, int count);
+    int   (*RPUSHM)(redis_client *this, int index, const char *key, const char **members, int count);
+    char* (*RPOPLPUSH)(redis_client *this, int index, const char *source, const char *destination);
+    char* (*BRPOPLPUSH)(redis_client *this, int index, const char *source, const char *destination, int timeout);
 
 } redis_list;
 
@@ -0,0 +1,109 @@
+
+
+#include <string.h>
+#include <errno.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+#include "redis_publish.h"
+
+
+/**
+ * Channels are not bound to database, publish on whichever one is selected
+ */
+#define REDIS_PUBLISH_INDEX(c)  ((c)->db_index >= 0 ? (c)->db_index : 0)
+
+
+static int _redis_publish_p(redis_client *this, const char *channel, const char *message, int length)
+{
+    int rc = REDIS_OK;
+    const char *argv[3] = {"PUBLISH", channel, message};
+    size_t argvlen[3] = {7, strlen(channel), (size_t)length};
+
+    if (0 == this->pipeline)
+    {
+        rc = _redis_try_connect_nonblock(this, REDIS_PUBLISH_INDEX(this));
+        if (REDIS_OK != rc)
+        {
+            EMI_LOG("%s: pipeline mode, _redis_try_connect_nonblock failed\n", __FUNCTION__);
+            return rc;
+        }
+    }
+
+    rc = redisAppendCommandArgv(this->redis, 3, argv, argvlen);
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: pipeline mode, redisAppendCommandArgv error: %s\n", __FUNCTION__, 
+                 REDIS_ERR_IO == this->redis->err ? strerror(errno) : this->redis->errstr);
+        return rc;
+    }
+
+    this->pipeline++;
+
+    return rc;
+}
+
+static int _redis_publish_s(redis_client *this, const char *channel, const char *message, int length)
+{
+    int rc = REDIS_OK;
+    const char *argv[3] = {"PUBLISH", channel, message};
+    size_t argvlen[3] = {7, strlen(channel), (size_t)length};
+
+    rc = _redis_try_connect_nonblock(this, REDIS_PUBLISH_INDEX(this));
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        return -1;
+    }
+
+    rc = _redis_command_argv_int(this, 3, argv, argvlen);
+
+    return rc;
+}
+
+
+/**
+ * @return
+ * -  >= 0: count of subscribers received the message, 0 in pipeline mode
+ * -  <  0: command failed
+ */
+int redis_publish_publish(redis_client *this, const char *channel, const char *message, int length)
+{
+    int rc = REDIS_OK;
+
+    if (!this || !channel || '\0' == channel[0] || !message || length < 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        rc = (REDIS_OK == _redis_publish_p(this, channel, message, length)) ? 0 : -1;
+    }
+    else
+    {
+        rc = _redis_publish_s(this, channel, message, length);
+    }
+
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+
+int redis_publish_init(redis_publish *Publish)
+{
+    Publish->PUBLISH = redis_publish_publish;
+
+    return REDIS_OK;
+}
+
+void redis_publish_deinit(redis_publish *Publish)
+{
+    ;
+}
+
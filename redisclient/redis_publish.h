@@ -0,0 +1,25 @@
+
+
+#ifndef __REDIS_PUBLISH_H
+#define __REDIS_PUBLISH_H
+
+
+#include "redis_types.h"
+
+
+typedef struct __redis_publish
+{
+    /**
+     * message: length bytes, binary safe
+     */
+    int (*PUBLISH)(redis_client *this, const char *channel, const char *message, int length);
+
+} redis_publish;
+
+
+int redis_publish_init(redis_publish *Publish);
+void redis_publish_deinit(redis_publish *Publish);
+
+
+#endif
+
@@ -0,0 +1,663 @@
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+#include "redis_queue.h"
+
+
+/**
+ * Seconds a worker blocks in BRPOPLPUSH, bounds how long stop() waits
+ */
+#define REDIS_QUEUE_BLOCK_TIMEOUT   1
+
+/**
+ * Worker backs off from this many ms after an error, doubling up to one block timeout
+ */
+#define REDIS_QUEUE_BACKOFF_MIN     100
+#define REDIS_QUEUE_BACKOFF_MAX     (REDIS_QUEUE_BLOCK_TIMEOUT * 1000)
+
+#define REDIS_QUEUE_CONSUMER_LEN    160
+
+/**
+ * `name:processing:<consumer>', the longest key, consumer may come from SMEMBERS
+ */
+#define REDIS_QUEUE_KEY_LEN         (REDIS_QUEUE_NAME_LEN + sizeof(":processing:") + MAX_MEMBER_LEN)
+
+
+typedef struct __redis_queue_worker
+{
+    redis_queue        *queue;
+    int                 id;
+    redis_client       *client;                 /* Dedicated connection of this worker */
+    char                consumer[REDIS_QUEUE_CONSUMER_LEN];     /* <host>:<pid>:<id> */
+    char                processing[REDIS_QUEUE_KEY_LEN];
+    char                alive[REDIS_QUEUE_KEY_LEN];
+    char                queue_consumers[REDIS_QUEUE_KEY_LEN];
+    char                attempts[REDIS_QUEUE_KEY_LEN];
+    char                dead[REDIS_QUEUE_KEY_LEN];
+    int                 backoff;                /* ms slept after last error, 0 after success */
+    pthread_t           thread;
+    int                 started;
+
+} redis_queue_worker;
+
+
+/**
+ * @return REDIS_OK, REDIS_ERR if key doesn't fit in buf
+ */
+static int _redis_queue_key(redis_queue *this, char *buf, size_t size, const char *type, const char *consumer)
+{
+    int n = 0;
+
+    if (consumer)
+    {
+        n = snprintf(buf, size, "%s:%s:%s", this->name, type, consumer);
+    }
+    else
+    {
+        n = snprintf(buf, size, "%s:%s", this->name, type);
+    }
+
+    if (n < 0 || (size_t)n >= size)
+    {
+        EMI_LOG("%s: key of queue[%s] type[%s] too long\n", __FUNCTION__, this->name, type);
+        return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+/**
+ * Sleep after an error, so a worker doesn't spin on a server that keeps failing
+ */
+static void _redis_queue_backoff(redis_queue_worker *worker)
+{
+    if (worker->backoff <= 0)
+    {
+        worker->backoff = REDIS_QUEUE_BACKOFF_MIN;
+    }
+    else if ((worker->backoff *= 2) > REDIS_QUEUE_BACKOFF_MAX)
+    {
+        worker->backoff = REDIS_QUEUE_BACKOFF_MAX;
+    }
+
+    usleep(worker->backoff * 1000);
+}
+
+/**
+ * Run a command on worker's connection
+ *
+ * @return integer reply, < 0 on failure
+ */
+static int _redis_queue_command_int(redis_queue_worker *worker, int argc, const char **argv)
+{
+    int rc = -1;
+    redis_client *c = worker->client;
+
+    REDIS_LOCK(c);
+
+    if (REDIS_OK != _redis_try_connect_nonblock(c, worker->queue->index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    rc = _redis_command_argv_int(c, argc, argv, NULL);
+
+on_ret:
+    REDIS_UNLOCK(c);
+
+    return rc;
+}
+
+/**
+ * Move next job to processing list, waiting at most REDIS_QUEUE_BLOCK_TIMEOUT
+ *
+ * @return REDIS_OK with *o_job NULL on timeout, REDIS_ERR on connection or error reply
+ */
+static int _redis_queue_take(redis_queue_worker *worker, char **o_job)
+{
+    int rc = REDIS_ERR;
+    redisReply *reply = NULL;
+    redis_client *c = worker->client;
+    char timeout_b[12] = {0};
+    const char *argv[4] = {"BRPOPLPUSH", worker->queue->name, worker->processing, timeout_b};
+
+    *o_job = NULL;
+
+    snprintf(timeout_b, sizeof(timeout_b), "%d", REDIS_QUEUE_BLOCK_TIMEOUT);
+
+    REDIS_LOCK(c);
+
+    if (REDIS_OK != _redis_try_connect_nonblock(c, worker->queue->index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    /* unlike List.BRPOPLPUSH, tell a timeout (nil) from an error reply */
+    reply = _redis_command_argv(c, 4, argv, NULL);
+    if (!reply)
+    {
+        goto on_ret;
+    }
+
+    rc = REDIS_OK;
+
+    if (REDIS_REPLY_STRING == reply->type)
+    {
+        *o_job = (char *)malloc(reply->len + 1);
+        if (!*o_job)
+        {
+            EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+            rc = REDIS_ERR;
+            goto on_ret;
+        }
+
+        memcpy(*o_job, reply->str, reply->len);
+        (*o_job)[reply->len] = '\0';
+    }
+
+on_ret:
+    REDIS_UNLOCK(c);
+
+    if (reply)
+    {
+        freeReplyObject(reply);
+    }
+
+    return rc;
+}
+
+/**
+ * Handler failed: count the attempt, push job back to pending list, or to the
+ * dead-letter list once it failed max_attempts times
+ */
+static int _redis_queue_retry(redis_queue_worker *worker, const char *job)
+{
+    int attempts = 0;
+    redis_queue *queue = worker->queue;
+    const char *incr[4] = {"HINCRBY", worker->attempts, job, "1"};
+    const char *hdel[3] = {"HDEL", worker->attempts, job};
+    const char *push[3] = {"LPUSH", queue->name, job};
+
+    if (queue->max_attempts > 0)
+    {
+        /* count unknown on failure, requeue anyway rather than drop the job */
+        attempts = _redis_queue_command_int(worker, 4, incr);
+    }
+
+    if (queue->max_attempts > 0 && attempts >= queue->max_attempts)
+    {
+        EMI_LOG("%s: worker[%s] job failed %d times, move it to %s\n", 
+                __FUNCTION__, worker->consumer, attempts, worker->dead);
+
+        push[1] = worker->dead;
+        if (_redis_queue_command_int(worker, 3, push) < 0)
+        {
+            return REDIS_ERR;
+        }
+
+        _redis_queue_command_int(worker, 3, hdel);
+
+        return REDIS_OK;
+    }
+
+    EMI_LOG("%s: worker[%s] handle job failed, requeue it\n", __FUNCTION__, worker->consumer);
+
+    return _redis_queue_command_int(worker, 3, push) < 0 ? REDIS_ERR : REDIS_OK;
+}
+
+/**
+ * Refresh `name:alive:<consumer>' for stall_timeout seconds, and (re)register
+ * consumer in case reaper dropped it while a handler overran stall_timeout
+ */
+static int _redis_queue_heartbeat(redis_queue_worker *worker)
+{
+    int rc = REDIS_OK;
+    redisReply *reply = NULL;
+    redis_client *c = worker->client;
+    char ttl_b[12] = {0};
+    const char *argv[5] = {"SET", worker->alive, "1", "EX", ttl_b};
+
+    snprintf(ttl_b, sizeof(ttl_b), "%d", worker->queue->stall_timeout);
+
+    REDIS_LOCK(c);
+
+    rc = _redis_try_connect_nonblock(c, worker->queue->index);
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(c, 5, argv, NULL);
+    if (!reply)
+    {
+        rc = REDIS_ERR;
+        goto on_ret;
+    }
+
+    freeReplyObject(reply);
+
+    rc = c->Set.SADD(c, worker->queue->index, worker->queue_consumers, worker->consumer);
+
+on_ret:
+    REDIS_UNLOCK(c);
+
+    return rc;
+}
+
+/**
+ * Move every job of `consumer' back to pending list.
+ *
+ * @return count of requeued jobs, < 0 on failure
+ */
+static int _redis_queue_requeue(redis_queue *this, redis_client *c, const char *consumer)
+{
+    int count = 0;
+    char *job = NULL;
+    char processing[REDIS_QUEUE_KEY_LEN] = {0};
+
+    if (REDIS_OK != _redis_queue_key(this, processing, sizeof(processing), "processing", consumer))
+    {
+        return -1;
+    }
+
+    /* RPOPLPUSH moves one job atomically, so concurrent reapers never lose or duplicate it */
+    while ((job = c->List.RPOPLPUSH(c, this->index, processing, this->name)))
+    {
+        EMI_LOG("%s: requeue job of consumer[%s]\n", __FUNCTION__, consumer);
+        free(job);
+        count++;
+    }
+
+    if (!c->redis)
+    {
+        return -1;
+    }
+
+    return count;
+}
+
+static void *_redis_queue_worker_routine(void *arg)
+{
+    int rc = REDIS_OK;
+    char *job = NULL;
+    time_t last_beat = 0;
+    redis_queue_worker *worker = (redis_queue_worker *)arg;
+    redis_queue *queue = worker->queue;
+    redis_client *c = worker->client;
+    const char *hdel[3] = {"HDEL", worker->attempts, NULL};
+
+    _redis_queue_heartbeat(worker);
+    last_beat = time(NULL);
+
+    while (queue->running)
+    {
+        if (time(NULL) - last_beat >= queue->stall_timeout / 3)
+        {
+            if (REDIS_OK == _redis_queue_heartbeat(worker))
+            {
+                last_beat = time(NULL);
+            }
+        }
+
+        /* lost connection or error reply (e.g. WRONGTYPE), don't spin on it */
+        if (REDIS_OK != _redis_queue_take(worker, &job))
+        {
+            _redis_queue_backoff(worker);
+            continue;
+        }
+
+        if (!job)
+        {
+            continue;
+        }
+
+        rc = queue->handler(queue, job, queue->arg);
+        if (REDIS_OK == rc)
+        {
+            if (queue->max_attempts > 0)
+            {
+                /* attempts of a job that failed before, a no-op otherwise */
+                hdel[2] = job;
+                _redis_queue_command_int(worker, 3, hdel);
+            }
+        }
+        else
+        {
+            /* push back before ack, a crash in between duplicates the job but never loses it */
+            if (REDIS_OK != _redis_queue_retry(worker, job))
+            {
+                /* not pushed anywhere, leave it in processing list for stop() or reaper */
+                EMI_LOG("%s: worker[%s] requeue job failed, keep it\n", __FUNCTION__, worker->consumer);
+                free(job);
+                _redis_queue_backoff(worker);
+                continue;
+            }
+
+            /* job is taken care of, only errors of the server back off */
+            rc = REDIS_OK;
+        }
+
+        if (c->List.LREM(c, queue->index, worker->processing, 1, job) < 0)
+        {
+            EMI_LOG("%s: worker[%s] ack job failed, reaper will requeue it\n", __FUNCTION__, worker->consumer);
+            rc = REDIS_ERR;
+        }
+
+        free(job);
+
+        if (REDIS_OK != rc)
+        {
+            _redis_queue_backoff(worker);
+        }
+        else
+        {
+            worker->backoff = 0;
+        }
+    }
+
+    /* processing list is empty unless ack or requeue failed, hand leftovers back before leaving */
+    _redis_queue_requeue(queue, c, worker->consumer);
+    c->Key.DEL(c, queue->index, worker->alive);
+    c->Set.SREM(c, queue->index, worker->queue_consumers, worker->consumer);
+
+    return NULL;
+}
+
+static void *_redis_queue_reaper_routine(void *arg)
+{
+    int elapsed = 0;
+    int interval = 0;
+    redis_queue *queue = (redis_queue *)arg;
+
+    interval = queue->stall_timeout / 2 > 0 ? queue->stall_timeout / 2 : 1;
+
+    while (queue->running)
+    {
+        sleep(1);
+
+        if (++elapsed < interval)
+        {
+            continue;
+        }
+
+        elapsed = 0;
+        queue->reap(queue);
+    }
+
+    return NULL;
+}
+
+
+static int redis_queue_push(redis_queue *this, const char **jobs, int count)
+{
+    if (!this || !jobs || count <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    return this->client->List.LPUSHM(this->client, this->index, this->name, jobs, count);
+}
+
+static int redis_queue_length(redis_queue *this)
+{
+    if (!this)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    return this->client->List.LLEN(this->client, this->index, this->name);
+}
+
+static int redis_queue_reap(redis_queue *this)
+{
+    int i = 0, rc = 0, count = 0, requeued = 0;
+    redis_client *c = NULL;
+    redis_member *members = NULL;
+    char key[REDIS_QUEUE_KEY_LEN] = {0};
+    char consumers[REDIS_QUEUE_KEY_LEN] = {0};
+
+    if (!this)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    c = this->reaper_client;
+
+    if (REDIS_OK != _redis_queue_key(this, consumers, sizeof(consumers), "consumers", NULL))
+    {
+        return -1;
+    }
+
+    rc = c->Set.SMEMBERS(c, this->index, consumers, &members);
+    if (rc <= 0)
+    {
+        return rc < 0 ? -1 : 0;
+    }
+
+    for (i = 0; i < rc; ++i)
+    {
+        if (REDIS_OK != _redis_queue_key(this, key, sizeof(key), "alive", members[i].member))
+        {
+            continue;
+        }
+
+        if (REDIS_TRUE == c->Key.EXISTS(c, this->index, key))
+        {
+            continue;
+        }
+
+        if (!c->redis)
+        {
+            /* EXISTS failed on connection, heartbeat state is unknown */
+            break;
+        }
+
+        EMI_LOG("%s: consumer[%s] stalled\n", __FUNCTION__, members[i].member);
+
+        requeued = _redis_queue_requeue(this, c, members[i].member);
+        if (requeued < 0)
+        {
+            break;
+        }
+
+        count += requeued;
+        c->Set.SREM(c, this->index, consumers, members[i].member);
+    }
+
+    free(members);
+
+    return count;
+}
+
+static int redis_queue_stop(redis_queue *this)
+{
+    int i = 0;
+
+    if (!this)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    if (!this->running)
+    {
+        return REDIS_OK;
+    }
+
+    this->running = 0;
+
+    for (i = 0; i < this->nworkers; ++i)
+    {
+        if (this->workers[i].started)
+        {
+            pthread_join(this->workers[i].thread, NULL);
+        }
+
+        redis_client_destroy(this->workers[i].client);
+    }
+
+    pthread_join(this->reaper, NULL);
+
+    free(this->workers);
+    this->workers = NULL;
+    this->nworkers = 0;
+
+    return REDIS_OK;
+}
+
+static int redis_queue_start(redis_queue *this, int workers, redis_queue_handler handler, void *arg)
+{
+    int i = 0;
+    redis_queue_worker *worker = NULL;
+
+    if (!this || workers <= 0 || !handler)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    if (this->running)
+    {
+        EMI_LOG("%s: queue[%s] allready started\n", __FUNCTION__, this->name);
+        return REDIS_ERR;
+    }
+
+    this->workers = (redis_queue_worker *)malloc(sizeof(redis_queue_worker) * workers);
+    if (!this->workers)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    memset(this->workers, 0, sizeof(redis_queue_worker) * workers);
+
+    this->handler = handler;
+    this->arg = arg;
+    this->nworkers = workers;
+    this->running = 1;
+
+    if (0 != pthread_create(&this->reaper, NULL, _redis_queue_reaper_routine, this))
+    {
+        EMI_LOG("%s: create reaper thread failed: %s\n", __FUNCTION__, strerror(errno));
+        this->running = 0;
+        free(this->workers);
+        this->workers = NULL;
+        this->nworkers = 0;
+        return REDIS_ERR;
+    }
+
+    for (i = 0; i < workers; ++i)
+    {
+        worker = &this->workers[i];
+        worker->queue = this;
+        worker->id = i;
+
+        snprintf(worker->consumer, sizeof(worker->consumer), "%s:%d", this->consumer, i);
+
+        /* name and consumer are bounded, so keys always fit */
+        _redis_queue_key(this, worker->processing, sizeof(worker->processing), "processing", worker->consumer);
+        _redis_queue_key(this, worker->alive, sizeof(worker->alive), "alive", worker->consumer);
+        _redis_queue_key(this, worker->queue_consumers, sizeof(worker->queue_consumers), "consumers", NULL);
+        _redis_queue_key(this, worker->attempts, sizeof(worker->attempts), "attempts", NULL);
+        _redis_queue_key(this, worker->dead, sizeof(worker->dead), "dead", NULL);
+
+        /* a blocking BRPOPLPUSH holds its connection, so every worker gets its own */
+        worker->client = _redis_client_clone(this->client);
+        if (!worker->client)
+        {
+            EMI_LOG("%s: create connection of worker[%d] failed\n", __FUNCTION__, i);
+            redis_queue_stop(this);
+            return REDIS_ERR;
+        }
+
+        /* BRPOPLPUSH waits up to REDIS_QUEUE_BLOCK_TIMEOUT for a reply */
+        worker->client->command_timeout = 0;
+
+        if (0 != pthread_create(&worker->thread, NULL, _redis_queue_worker_routine, worker))
+        {
+            EMI_LOG("%s: create thread of worker[%d] failed: %s\n", __FUNCTION__, i, strerror(errno));
+            redis_queue_stop(this);
+            return REDIS_ERR;
+        }
+
+        worker->started = 1;
+    }
+
+    return REDIS_OK;
+}
+
+
+redis_queue *redis_queue_create(redis_client *client, int index, const char *name, int stall_timeout)
+{
+    redis_queue *q = NULL;
+    char host[64] = {0};
+
+    if (!client || index < 0 || !name || '\0' == name[0])
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    q = (redis_queue *)malloc(sizeof(redis_queue));
+    if (!q)
+    {
+        EMI_LOG("%s: out of memory, malloc redis_queue failed\n", __FUNCTION__);
+        return NULL;
+    }
+
+    memset(q, 0, sizeof(redis_queue));
+
+    q->reaper_client = _redis_client_clone(client);
+    if (!q->reaper_client)
+    {
+        free(q);
+        return NULL;
+    }
+
+    if (0 != gethostname(host, sizeof(host) - 1))
+    {
+        snprintf(host, sizeof(host), "localhost");
+    }
+
+    q->client = client;
+    q->index = index;
+    q->stall_timeout = stall_timeout > 0 ? stall_timeout : REDIS_QUEUE_STALL_TIMEOUT;
+    q->max_attempts = REDIS_QUEUE_MAX_ATTEMPTS;
+    snprintf(q->name, sizeof(q->name), "%s", name);
+    snprintf(q->consumer, sizeof(q->consumer), "%s:%d", host, (int)getpid());
+
+    q->push   = redis_queue_push;
+    q->start  = redis_queue_start;
+    q->stop   = redis_queue_stop;
+    q->reap   = redis_queue_reap;
+    q->length = redis_queue_length;
+
+    return q;
+}
+
+void redis_queue_destroy(redis_queue *this)
+{
+    if (this)
+    {
+        redis_queue_stop(this);
+
+        redis_client_destroy(this->reaper_client);
+
+        free(this);
+    }
+}
+
@@ -0,0 +1,107 @@
+
+
+#ifndef __REDIS_QUEUE_H
+#define __REDIS_QUEUE_H
+
+
+#include <pthread.h>
+
+#include "redis_types.h"
+
+
+/**
+ * Default seconds a worker may stay silent before the reaper requeues its jobs
+ */
+#define REDIS_QUEUE_STALL_TIMEOUT   30
+
+/**
+ * Default times a job may fail before it is moved to the dead-letter list
+ */
+#define REDIS_QUEUE_MAX_ATTEMPTS    5
+
+#define REDIS_QUEUE_NAME_LEN        256
+
+
+/**
+ * Job handler, called on a worker thread. Jobs are C strings: push, the attempts
+ * count, requeue and the LREM acknowledgement all stop at the first '\0', so a job
+ * pushed by other means must not hold NUL bytes either.
+ *
+ * @return
+ * - REDIS_OK : job done, it is acknowledged and removed
+ * - REDIS_ERR: job failed, it is pushed back to the pending list, or to the
+ *              dead-letter list once it failed max_attempts times
+ */
+typedef int (*redis_queue_handler)(redis_queue *queue, const char *job, void *arg);
+
+struct __redis_queue_worker;
+
+/**
+ * Reliable queue on top of List.
+ *
+ * Producers LPUSH jobs to the pending list `name'. Every worker owns a dedicated 
+ * connection and moves jobs with BRPOPLPUSH to its own processing list 
+ * `name:processing:<consumer>', so a job always lives in exactly one list. 
+ * A job is acknowledged by LREM from the processing list once handled.
+ *
+ * Each worker keeps `name:alive:<consumer>' alive with a heartbeat and registers
+ * itself in the set `name:consumers'. The reaper requeues the processing list of
+ * any consumer whose heartbeat expired, a job whose handler runs longer than 
+ * stall_timeout is considered stalled as well, so jobs are delivered at least once.
+ *
+ * Failures of a job are counted in the hash `name:attempts', keyed by the job
+ * itself, so equal jobs share their count. A job failing max_attempts times is
+ * moved to the dead-letter list `name:dead' instead of taking worker time forever.
+ */
+struct __redis_queue
+{
+    redis_client       *client;                 /* Producer connection, shared with caller */
+    int                 index;                  /* Database index */
+    char                name[REDIS_QUEUE_NAME_LEN];   /* Pending list key */
+    char                consumer[128];          /* Consumer prefix of this process, <host>:<pid> */
+    int                 stall_timeout;          /* Seconds before a silent worker's jobs are requeued */
+    int                 max_attempts;           /* Failures before dead-letter, <= 0: retry forever, set before start */
+
+    redis_queue_handler handler;
+    void               *arg;
+
+    volatile int        running;
+    int                 nworkers;
+    struct __redis_queue_worker *workers;
+
+    redis_client       *reaper_client;          /* Dedicated connection of reaper */
+    pthread_t           reaper;
+
+    /**
+     * Push jobs to pending list with one command, jobs[0] is consumed first
+     */
+    int                 (*push)(redis_queue *this, const char **jobs, int count);
+
+    /**
+     * Start `workers' consumer threads and the reaper thread
+     */
+    int                 (*start)(redis_queue *this, int workers, redis_queue_handler handler, void *arg);
+
+    /**
+     * Stop all threads, in-flight jobs are finished and acknowledged first
+     */
+    int                 (*stop)(redis_queue *this);
+
+    /**
+     * Requeue jobs of stalled workers once, return count of requeued jobs, < 0 on failure
+     */
+    int                 (*reap)(redis_queue *this);
+
+    /**
+     * Count of pending jobs
+     */
+    int                 (*length)(redis_queue *this);
+};
+
+
+redis_queue *redis_queue_create(redis_client *client, int index, const char *name, int stall_timeout);
+void redis_queue_destroy(redis_queue *queue);
+
+
+#endif
+
@@ -0,0 +1,335 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "redis_types.h"
+#include "_redis_client.h"
+#include "redis_client.h"
+
+
+static const char *s_scan_cmds[] =
+{
+    "SCAN", "SSCAN", "ZSCAN", "HSCAN"
+};
+
+
+static void _redis_scan_disconnect(redis_client *c)
+{
+    EMI_LOG("%s: redis error: %s\n", __FUNCTION__,
+             REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr);
+
+    redisFree(c->redis);
+    c->redis = NULL;
+    c->db_index = -1;
+}
+
+/**
+ * Send request of page `cursor' without waiting for the reply
+ */
+static int _redis_scan_send(redis_scan *this)
+{
+    int argc = 0, done = 0;
+    const char *argv[8];
+    char count[16] = {0};
+    redis_client *c = this->conn;
+
+    if (REDIS_OK != _redis_try_connect_nonblock(c, this->index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    argv[argc++] = s_scan_cmds[this->type];
+    if (REDIS_SCAN_KEYS != this->type)
+    {
+        argv[argc++] = this->key;
+    }
+    argv[argc++] = this->cursor;
+    if (this->pattern)
+    {
+        argv[argc++] = "MATCH";
+        argv[argc++] = this->pattern;
+    }
+    snprintf(count, sizeof(count), "%d", this->count);
+    argv[argc++] = "COUNT";
+    argv[argc++] = count;
+
+    EMI_LOG("%s: cmd[%s %s ...], argc[%d]\n", __FUNCTION__, argv[0], argv[1], argc);
+
+    redisAppendCommandArgv(c->redis, argc, argv, NULL);
+
+    /* flush now, so the server works on it while the caller handles current page */
+    do
+    {
+        if (REDIS_OK != redisBufferWrite(c->redis, &done))
+        {
+            _redis_scan_disconnect(c);
+            return REDIS_ERR;
+        }
+    } while (!done);
+
+    this->inflight = REDIS_TRUE;
+
+    return REDIS_OK;
+}
+
+/**
+ * Receive the page requested by _redis_scan_send, advance cursor
+ *
+ * @return count of elements, < 0 on failure
+ */
+static int _redis_scan_recv(redis_scan *this, redis_member **o_members)
+{
+    int count = -1;
+    redisReply *reply = NULL;
+    redis_client *c = this->conn;
+
+    this->inflight = REDIS_FALSE;
+
+    if (REDIS_OK != redisGetReply(c->redis, (void **)&reply))
+    {
+        _redis_scan_disconnect(c);
+        return -1;
+    }
+
+    if (REDIS_REPLY_ARRAY != reply->type || 2 != reply->elements ||
+        REDIS_REPLY_STRING != reply->element[0]->type ||
+        REDIS_REPLY_ARRAY != reply->element[1]->type)
+    {
+        EMI_LOG("%s: %s reply error: reply type[%d], %s\n", __FUNCTION__,
+                 s_scan_cmds[this->type], reply->type,
+                 REDIS_REPLY_ERROR == reply->type ? reply->str : "");
+        goto on_ret;
+    }
+
+    snprintf(this->cursor, sizeof(this->cursor), "%.*s",
+              reply->element[0]->len, reply->element[0]->str);
+    if (0 == strcmp(this->cursor, "0"))
+    {
+        this->finished = REDIS_TRUE;
+    }
+
+    _redis_reply_inflate(c, reply->element[1]);
+    count = _redis_reply_members(reply->element[1], o_members);
+
+on_ret:
+    freeReplyObject(reply);
+
+    return count;
+}
+
+static int _redis_scan_next_page(redis_scan *this, redis_member **o_members)
+{
+    int count = -1;
+
+    if (!this->inflight && REDIS_OK != _redis_scan_send(this))
+    {
+        return -1;
+    }
+
+    count = _redis_scan_recv(this, o_members);
+    if (count < 0)
+    {
+        return -1;
+    }
+
+    if (this->prefetch && !this->finished)
+    {
+        /* a failed prefetch is retried by the next call */
+        _redis_scan_send(this);
+    }
+
+    return count;
+}
+
+static int redis_scan_next(redis_scan *this, redis_member **o_members)
+{
+    int count = 0;
+
+    if (!this || !o_members)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    *o_members = NULL;
+
+    REDIS_LOCK(this->conn);
+
+    if (this->conn->pipeline >= 0)
+    {
+        EMI_LOG("%s: scan iterator don't support pipeline mode\n", __FUNCTION__);
+        count = -1;
+        goto on_ret;
+    }
+
+    /* a page may be empty while the cursor is not exhausted, skip it */
+    while (!this->finished && 0 == count)
+    {
+        count = _redis_scan_next_page(this, o_members);
+        if (0 == count)
+        {
+            free(*o_members);
+            *o_members = NULL;
+        }
+    }
+
+on_ret:
+    REDIS_UNLOCK(this->conn);
+
+    return count;
+}
+
+static int redis_scan_next_score(redis_scan *this, redis_score_member **o_members)
+{
+    int i = 0, count = 0;
+    redis_member *members = NULL;
+
+    if (!this || REDIS_SCAN_SORTEDSET != this->type || !o_members)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    *o_members = NULL;
+
+    count = redis_scan_next(this, &members);
+    if (count <= 0)
+    {
+        return count;
+    }
+
+    count /= 2;
+    *o_members = (redis_score_member *)malloc(sizeof(redis_score_member) * count);
+    if (!(*o_members))
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        free(members);
+        return -1;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        (*o_members)[i].score = atoi(members[2*i + 1].member);
+        snprintf((*o_members)[i].member, MAX_MEMBER_LEN, "%s", members[2*i].member);
+    }
+
+    free(members);
+
+    return count;
+}
+
+static int redis_scan_reset(redis_scan *this)
+{
+    if (!this)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    REDIS_LOCK(this->conn);
+
+    /* drop the page prefetched for the old cursor */
+    if (this->inflight)
+    {
+        redisReply *reply = NULL;
+
+        if (REDIS_OK == redisGetReply(this->conn->redis, (void **)&reply))
+        {
+            freeReplyObject(reply);
+        }
+        else
+        {
+            _redis_scan_disconnect(this->conn);
+        }
+
+        this->inflight = REDIS_FALSE;
+    }
+
+    snprintf(this->cursor, sizeof(this->cursor), "0");
+    this->finished = REDIS_FALSE;
+
+    REDIS_UNLOCK(this->conn);
+
+    return REDIS_OK;
+}
+
+redis_scan *redis_scan_create(redis_client *client, int index, redis_scan_type type,
+                                  const char *key, const char *pattern, int count, int prefetch)
+{
+    redis_scan *scan = NULL;
+
+    if (!client || index < 0 || type < REDIS_SCAN_KEYS || type > REDIS_SCAN_HASH ||
+        (REDIS_SCAN_KEYS != type && (!key || '\0' == key[0])))
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    scan = (redis_scan *)malloc(sizeof(redis_scan));
+    if (!scan)
+    {
+        EMI_LOG("%s: out of memory, malloc redis_scan failed\n", __FUNCTION__);
+        return NULL;
+    }
+
+    memset(scan, 0, sizeof(redis_scan));
+
+    scan->client = client;
+    scan->index = index;
+    scan->type = type;
+    scan->count = count > 0 ? count : REDIS_SCAN_COUNT;
+    scan->prefetch = prefetch;
+    snprintf(scan->cursor, sizeof(scan->cursor), "0");
+
+    if (REDIS_SCAN_KEYS != type)
+    {
+        scan->key = strdup(key);
+    }
+    if (pattern && '\0' != pattern[0])
+    {
+        scan->pattern = strdup(pattern);
+    }
+
+    if (prefetch)
+    {
+        /* the prefetched reply occupies the connection between two next() calls */
+        scan->conn = _redis_client_clone(client);
+    }
+    else
+    {
+        scan->conn = client;
+    }
+
+    if (!scan->conn || (REDIS_SCAN_KEYS != type && !scan->key) ||
+        (pattern && '\0' != pattern[0] && !scan->pattern))
+    {
+        EMI_LOG("%s: out of memory\n", __FUNCTION__);
+        redis_scan_destroy(scan);
+        return NULL;
+    }
+
+    scan->next = redis_scan_next;
+    scan->next_score = redis_scan_next_score;
+    scan->reset = redis_scan_reset;
+
+    return scan;
+}
+
+void redis_scan_destroy(redis_scan *scan)
+{
+    if (scan)
+    {
+        if (scan->conn && scan->conn != scan->client)
+        {
+            redis_client_destroy(scan->conn);
+        }
+
+        free(scan->key);
+        free(scan->pattern);
+        free(scan);
+    }
+}
+
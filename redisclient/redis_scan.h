@@ -0,0 +1,97 @@
+
+#ifndef __REDIS_SCAN_H
+#define __REDIS_SCAN_H
+
+
+#include "redis_types.h"
+
+
+/**
+ * Default COUNT hint of each page
+ */
+#define REDIS_SCAN_COUNT        100
+
+#define REDIS_SCAN_CURSOR_LEN   32
+
+
+/**
+ * What the iterator walks
+ */
+typedef enum
+{
+    REDIS_SCAN_KEYS = 0,        /* SCAN, keyspace of database `index' */
+    REDIS_SCAN_SET,             /* SSCAN key */
+    REDIS_SCAN_SORTEDSET,       /* ZSCAN key, members and scores alternate */
+    REDIS_SCAN_HASH,            /* HSCAN key, fields and values alternate */
+
+} redis_scan_type;
+
+
+/**
+ * Cursor iterator over SCAN/SSCAN/ZSCAN/HSCAN.
+ *
+ * Each next() returns one page of at most about `count' elements, so memory stays
+ * bounded however large the key is. Pages come in the order the server returns them,
+ * elements added or removed during iteration may or may not show up, and an element
+ * may be returned more than once, see SCAN guarantees.
+ *
+ * Without prefetch every page is a round trip on the shared connection, under its
+ * lock. With prefetch the iterator owns a dedicated connection and sends the request
+ * for the next page as soon as the current one arrives, so the server works on it
+ * while the caller processes the current page.
+ *
+ * An iterator must not be used by more than one thread at a time.
+ */
+struct __redis_scan
+{
+    redis_client       *client;                 /* Shared connection, owned by caller */
+    redis_client       *conn;                   /* Connection used, dedicated one in prefetch mode */
+    int                 index;                  /* Database index */
+    redis_scan_type     type;
+    char               *key;                    /* Key scanned, NULL for REDIS_SCAN_KEYS */
+    char               *pattern;                /* MATCH pattern, NULL for all */
+    int                 count;                  /* COUNT hint of each page */
+    int                 prefetch;
+
+    char                cursor[REDIS_SCAN_CURSOR_LEN];  /* Cursor of the next page */
+    int                 inflight;               /* Request for `cursor' already sent */
+    int                 finished;               /* Server returned cursor 0 */
+
+    /**
+     * Fetch next page, caller must free *o_members.
+     * For REDIS_SCAN_SORTEDSET and REDIS_SCAN_HASH elements come in pairs,
+     * o_members[2*i] is the member or field and o_members[2*i+1] its score or value.
+     *
+     * @return
+     * -  > 0: count of elements in page
+     * -  = 0: iteration finished
+     * -  < 0: command failed, next() retries the same page
+     */
+    int                 (*next)(redis_scan *this, redis_member **o_members);
+
+    /**
+     * Same as next() for REDIS_SCAN_SORTEDSET, return count of members with score
+     */
+    int                 (*next_score)(redis_scan *this, redis_score_member **o_members);
+
+    /**
+     * Restart iteration from cursor 0
+     */
+    int                 (*reset)(redis_scan *this);
+};
+
+
+/**
+ * @param
+ * key     : NULL for REDIS_SCAN_KEYS
+ * pattern : MATCH pattern, NULL for all
+ * count   : COUNT hint of each page, <= 0 for REDIS_SCAN_COUNT
+ * prefetch: REDIS_TRUE to fetch next page on a dedicated connection in advance
+ */
+redis_scan *redis_scan_create(redis_client *client, int index, redis_scan_type type,
+                                  const char *key, const char *pattern, int count, int prefetch);
+void redis_scan_destroy(redis_scan *scan);
+
+
+#endif
+
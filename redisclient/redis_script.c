@@ -0,0 +1,487 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+#include "redis_script.h"
+
+
+struct __redis_script_entry
+{
+    char   *body;
+    size_t  len;
+    char    sha[REDIS_SCRIPT_SHA_LEN];
+    int     loaded;                 /* Known to be cached by server of current connection */
+};
+
+
+#define SHA1_ROL(v, n)  (((v) << (n)) | ((v) >> (32 - (n))))
+
+static void _redis_sha1_block(uint32_t h[5], const unsigned char *p)
+{
+    int i = 0;
+    uint32_t w[80], a, b, c, d, e, f, k, t;
+
+    for (i = 0; i < 16; ++i)
+    {
+        w[i] = (uint32_t)p[4*i] << 24 | (uint32_t)p[4*i + 1] << 16 | (uint32_t)p[4*i + 2] << 8 | p[4*i + 3];
+    }
+
+    for (i = 16; i < 80; ++i)
+    {
+        w[i] = SHA1_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+    for (i = 0; i < 80; ++i)
+    {
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        t = SHA1_ROL(a, 5) + f + e + k + w[i];
+        e = d; d = c; c = SHA1_ROL(b, 30); b = a; a = t;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+/**
+ * SHA1 of data in lowercase hex, as SCRIPT LOAD returns
+ */
+static void _redis_sha1_hex(const char *data, size_t len, char hex[REDIS_SCRIPT_SHA_LEN])
+{
+    int i = 0;
+    size_t off = 0, rest = 0;
+    uint64_t bits = (uint64_t)len * 8;
+    unsigned char block[128];
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    for (off = 0; off + 64 <= len; off += 64)
+    {
+        _redis_sha1_block(h, (const unsigned char *)data + off);
+    }
+
+    /* pad the tail with 0x80, zeros and length in bits to one or two blocks */
+    rest = len - off;
+    memset(block, 0, sizeof(block));
+    memcpy(block, data + off, rest);
+    block[rest] = 0x80;
+    rest = rest < 56 ? 64 : 128;
+
+    for (i = 0; i < 8; ++i)
+    {
+        block[rest - 1 - i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    _redis_sha1_block(h, block);
+    if (128 == rest)
+    {
+        _redis_sha1_block(h, block + 64);
+    }
+
+    for (i = 0; i < 5; ++i)
+    {
+        snprintf(hex + 8 * i, REDIS_SCRIPT_SHA_LEN - 8 * i, "%08x", h[i]);
+    }
+}
+
+
+/**
+ * Load all registered scripts on a new connection, called by _redis_try_connect_nonblock.
+ * A failure only leaves the script unloaded, the next EVALSHA falls back to EVAL.
+ */
+void _redis_script_reload(redis_client *c)
+{
+    int i = 0;
+    redisReply *reply = NULL;
+    redis_script *Script = &c->Script;
+
+    for (i = 0; i < Script->nscripts; ++i)
+    {
+        Script->scripts[i].loaded = REDIS_FALSE;
+        redisAppendCommand(c->redis, "SCRIPT LOAD %b", Script->scripts[i].body, Script->scripts[i].len);
+    }
+
+    if (Script->nscripts > 0)
+    {
+        EMI_LOG("%s: reload %d scripts\n", __FUNCTION__, Script->nscripts);
+    }
+
+    for (i = 0; i < Script->nscripts; ++i)
+    {
+        if (REDIS_OK != redisGetReply(c->redis, (void **)&reply))
+        {
+            /* leave it to the caller's next command to notice the broken connection */
+            EMI_LOG("%s: redisGetReply error: %s\n", __FUNCTION__,
+                     REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr);
+            return;
+        }
+
+        if (REDIS_REPLY_STRING == reply->type)
+        {
+            Script->scripts[i].loaded = REDIS_TRUE;
+        }
+        else
+        {
+            EMI_LOG("%s: SCRIPT LOAD %s failed: %s\n", __FUNCTION__, Script->scripts[i].sha,
+                     REDIS_REPLY_ERROR == reply->type ? reply->str : "");
+        }
+
+        freeReplyObject(reply);
+    }
+}
+
+/**
+ * @return argv of "EVALSHA/EVAL sha/body nkeys keys... args...", caller must free it
+ */
+static const char **
+_redis_script_argv(struct __redis_script_entry *s, int eval, char *nkeys_b,
+                       const char **keys, int nkeys, const char **args, int nargs, size_t **o_argvlen)
+{
+    int i = 0, argc = nkeys + nargs + 3;
+    const char **argv = NULL;
+    size_t *argvlen = NULL;
+
+    argv = (const char **)malloc(sizeof(char *) * argc);
+    argvlen = (size_t *)malloc(sizeof(size_t) * argc);
+    if (!argv || !argvlen)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        free(argv);
+        free(argvlen);
+        return NULL;
+    }
+
+    argv[0] = eval ? "EVAL" : "EVALSHA";
+    argv[1] = eval ? s->body : s->sha;
+    argv[2] = nkeys_b;
+    argvlen[0] = strlen(argv[0]);
+    argvlen[1] = eval ? s->len : strlen(s->sha);
+    argvlen[2] = strlen(nkeys_b);
+
+    for (i = 0; i < nkeys; ++i)
+    {
+        argv[3 + i] = keys[i];
+        argvlen[3 + i] = strlen(keys[i]);
+    }
+
+    for (i = 0; i < nargs; ++i)
+    {
+        argv[3 + nkeys + i] = args[i];
+        argvlen[3 + nkeys + i] = strlen(args[i]);
+    }
+
+    *o_argvlen = argvlen;
+
+    return argv;
+}
+
+static int
+_redis_script_eval_p(redis_client *this, int index, struct __redis_script_entry *s,
+                          const char **keys, int nkeys, const char **args, int nargs)
+{
+    int rc = REDIS_OK, eval = REDIS_FALSE;
+    char nkeys_b[12] = {0};
+    const char **argv = NULL;
+    size_t *argvlen = NULL;
+
+    /* a new connection of this pipeline loads scripts first */
+    if (0 == this->pipeline)
+    {
+        rc = _redis_try_connect_nonblock(this, index);
+        if (REDIS_OK != rc)
+        {
+            EMI_LOG("%s: pipeline mode, _redis_try_connect_nonblock failed\n", __FUNCTION__);
+            return rc;
+        }
+    }
+
+    eval = !s->loaded;
+    snprintf(nkeys_b, sizeof(nkeys_b), "%d", nkeys);
+
+    argv = _redis_script_argv(s, eval, nkeys_b, keys, nkeys, args, nargs, &argvlen);
+    if (!argv)
+    {
+        return REDIS_ERR;
+    }
+
+    rc = _redis_command_argv_p(this, index, nkeys + nargs + 3, argv, argvlen);
+    if (REDIS_OK == rc && eval)
+    {
+        s->loaded = REDIS_TRUE;
+    }
+
+    free(argv);
+    free(argvlen);
+
+    return rc;
+}
+
+static int
+_redis_script_eval_s(redis_client *this, int index, struct __redis_script_entry *s,
+                          const char **keys, int nkeys, const char **args, int nargs,
+                          redis_member **o_members)
+{
+    int rc = -1, eval = REDIS_FALSE;
+    char nkeys_b[12] = {0};
+    const char **argv = NULL;
+    size_t *argvlen = NULL;
+    redisReply *reply = NULL;
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        return -1;
+    }
+
+    snprintf(nkeys_b, sizeof(nkeys_b), "%d", nkeys);
+
+    for (eval = REDIS_FALSE; eval <= REDIS_TRUE; ++eval)
+    {
+        argv = _redis_script_argv(s, eval, nkeys_b, keys, nkeys, args, nargs, &argvlen);
+        if (!argv)
+        {
+            return -1;
+        }
+
+        EMI_LOG("%s: cmd[%s %s ...], argc[%d]\n", __FUNCTION__, argv[0], s->sha, nkeys + nargs + 3);
+
+        reply = (redisReply *)redisCommandArgv(this->redis, nkeys + nargs + 3, argv, argvlen);
+
+        free(argv);
+        free(argvlen);
+
+        if (!reply)
+        {
+            EMI_LOG("%s: redisCommandArgv error: %s\n", __FUNCTION__,
+                     REDIS_ERR_IO == this->redis->err ? strerror(errno) : this->redis->errstr);
+
+            redisFree(this->redis);
+            this->redis = NULL;
+            this->db_index = -1;
+
+            return -1;
+        }
+
+        if (REDIS_REPLY_ERROR != reply->type || 0 != strncmp(reply->str, "NOSCRIPT", 8))
+        {
+            break;
+        }
+
+        /* server lost the script, e.g. SCRIPT FLUSH or failover */
+        s->loaded = REDIS_FALSE;
+        freeReplyObject(reply);
+        reply = NULL;
+    }
+
+    if (REDIS_REPLY_ERROR == reply->type)
+    {
+        EMI_LOG("%s: script %s error: %s\n", __FUNCTION__, s->sha, reply->str);
+        goto on_ret;
+    }
+
+    s->loaded = REDIS_TRUE;
+
+    if (REDIS_REPLY_NIL == reply->type || !o_members)
+    {
+        rc = 0;
+        goto on_ret;
+    }
+
+    _redis_reply_inflate(this, reply);
+    rc = _redis_reply_members(reply, o_members);
+
+on_ret:
+    freeReplyObject(reply);
+
+    return rc;
+}
+
+
+/**
+ * Register scripts of src on dst in the same order, so handles are the same
+ */
+void _redis_script_copy(redis_client *dst, redis_client *src)
+{
+    int i = 0;
+
+    REDIS_LOCK(src);
+
+    for (i = 0; i < src->Script.nscripts; ++i)
+    {
+        dst->Script.REGISTER(dst, src->Script.scripts[i].body);
+    }
+
+    REDIS_UNLOCK(src);
+}
+
+int redis_script_register(redis_client *this, const char *body)
+{
+    int rc = -1;
+    struct __redis_script_entry *s = NULL;
+    redis_script *Script = NULL;
+
+    if (!this || !body || '\0' == body[0])
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    Script = &this->Script;
+
+    REDIS_LOCK(this);
+
+    if (Script->nscripts == Script->capacity)
+    {
+        int capacity = Script->capacity ? 2 * Script->capacity : 8;
+
+        s = (struct __redis_script_entry *)realloc(Script->scripts, sizeof(*s) * capacity);
+        if (!s)
+        {
+            EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+            goto on_ret;
+        }
+
+        Script->scripts = s;
+        Script->capacity = capacity;
+    }
+
+    s = &Script->scripts[Script->nscripts];
+    s->len = strlen(body);
+    s->body = strdup(body);
+    if (!s->body)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    _redis_sha1_hex(body, s->len, s->sha);
+    s->loaded = REDIS_FALSE;
+
+    rc = Script->nscripts++;
+
+    EMI_LOG("%s: script %d sha1[%s]\n", __FUNCTION__, rc, s->sha);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+int redis_script_evalsha(redis_client *this, int index, int script, const char **keys, int nkeys,
+                              const char **args, int nargs, redis_member **o_members)
+{
+    int rc = -1;
+    struct __redis_script_entry *s = NULL;
+
+    if (o_members)
+    {
+        *o_members = NULL;
+    }
+
+    if (!this || index < 0 || script < 0 || nkeys < 0 || nargs < 0 ||
+        (nkeys > 0 && !keys) || (nargs > 0 && !args))
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    REDIS_LOCK(this);
+
+    if (script >= this->Script.nscripts)
+    {
+        EMI_LOG("%s: script %d not registered\n", __FUNCTION__, script);
+        goto on_ret;
+    }
+
+    s = &this->Script.scripts[script];
+
+    if (this->pipeline >= 0)
+    {
+        rc = (REDIS_OK == _redis_script_eval_p(this, index, s, keys, nkeys, args, nargs)) ? 0 : -1;
+    }
+    else
+    {
+        rc = _redis_script_eval_s(this, index, s, keys, nkeys, args, nargs, o_members);
+    }
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+const char *redis_script_sha(redis_client *this, int script)
+{
+    const char *sha = NULL;
+
+    if (!this || script < 0)
+    {
+        return NULL;
+    }
+
+    REDIS_LOCK(this);
+
+    if (script < this->Script.nscripts)
+    {
+        sha = this->Script.scripts[script].sha;
+    }
+
+    REDIS_UNLOCK(this);
+
+    return sha;
+}
+
+
+int redis_script_init(redis_script *Script)
+{
+    Script->scripts  = NULL;
+    Script->nscripts = 0;
+    Script->capacity = 0;
+
+    Script->REGISTER = redis_script_register;
+    Script->EVALSHA  = redis_script_evalsha;
+    Script->SHA      = redis_script_sha;
+
+    return REDIS_OK;
+}
+
+void redis_script_deinit(redis_script *Script)
+{
+    int i = 0;
+
+    for (i = 0; i < Script->nscripts; ++i)
+    {
+        free(Script->scripts[i].body);
+    }
+
+    free(Script->scripts);
+    Script->scripts = NULL;
+    Script->nscripts = 0;
+    Script->capacity = 0;
+}
+
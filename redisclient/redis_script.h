@@ -0,0 +1,58 @@
+
+#ifndef __REDIS_SCRIPT_H
+#define __REDIS_SCRIPT_H
+
+
+#include "redis_types.h"
+
+
+#define REDIS_SCRIPT_SHA_LEN    41
+
+
+struct __redis_script_entry;
+
+/**
+ * Lua scripts run through EVALSHA.
+ *
+ * A script is registered once and referred to by the handle REGISTER returns, its
+ * SHA1 is computed client-side. EVALSHA replied NOSCRIPT falls back to EVAL, which
+ * caches the script in server as SCRIPT LOAD does. All registered scripts are loaded
+ * again whenever the connection is re-established.
+ *
+ * In pipeline mode replies are not seen, so EVALSHA is only sent for scripts known
+ * to be loaded on current connection, otherwise the full script is sent with EVAL.
+ */
+typedef struct __redis_script
+{
+    struct __redis_script_entry *scripts;
+    int                          nscripts;
+    int                          capacity;
+
+    /**
+     * @return handle of script, < 0 on failure
+     */
+    int (*REGISTER)(redis_client *this, const char *body);
+
+    /**
+     * Run script with `nkeys' keys and `nargs' arguments, caller must free *o_members.
+     * An integer or string reply is returned as one member, an array as members.
+     *
+     * @return count of members, < 0 on failure, 0 for nil reply or in pipeline mode
+     */
+    int (*EVALSHA)(redis_client *this, int index, int script, const char **keys, int nkeys,
+                   const char **args, int nargs, redis_member **o_members);
+
+    /**
+     * SHA1 of script in hex, NULL if handle is invalid, valid until next REGISTER
+     */
+    const char *(*SHA)(redis_client *this, int script);
+
+} redis_script;
+
+
+int redis_script_init(redis_script *Script);
+void redis_script_deinit(redis_script *Script);
+
+
+#endif
+
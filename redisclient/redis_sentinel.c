@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+
+
+/**
+ * ms between two rounds over all sentinels when none answers
+ */
+#define REDIS_SENTINEL_RETRY        1000
+
+#define REDIS_SENTINEL_CHANNEL      "+switch-master"
+
+
+struct __redis_sentinel
+{
+    redis_client       *client;                 /* Owner, follows the primary */
+    char                name[MAX_MEMBER_LEN];   /* Master name known by sentinels */
+    char              (*ips)[16];
+    int                *ports;
+    int                 n;
+    int                 next;                   /* Sentinel to try first */
+
+    volatile int        running;
+    pthread_mutex_t     lock;                   /* Guards fd, followers, switching, cond */
+    pthread_cond_t      cond;
+    int                 fd;                     /* Subscribed socket, shut down to stop watcher */
+    pthread_t           watcher;
+
+    /**
+     * Clones of the owner (dedicated connections of queue, counter, ...), moved
+     * along with it
+     */
+    redis_client      **followers;
+    int                 nfollowers;
+    int                 switching;              /* Followers being moved outside lock */
+};
+typedef struct __redis_sentinel redis_sentinel;
+
+
+/**
+ * Connect to the first sentinel that answers, starting from s->next
+ */
+static redisContext *_redis_sentinel_connect(redis_sentinel *s)
+{
+    int i = 0, k = 0;
+    redisContext *redis = NULL;
+    struct timeval tv;
+
+    tv.tv_sec = s->client->connect_timeout / 1000;
+    tv.tv_usec = (s->client->connect_timeout % 1000) * 1000;
+
+    for (i = 0; i < s->n; ++i)
+    {
+        k = (s->next + i) % s->n;
+
+        redis = s->client->connect_timeout > 0 ? redisConnectWithTimeout(s->ips[k], s->ports[k], tv)
+                                               : redisConnect(s->ips[k], s->ports[k]);
+        if (redis && 0 == redis->err)
+        {
+            /* queries answer at once, don't wait forever on a hung sentinel */
+            if (s->client->connect_timeout > 0)
+            {
+                redisSetTimeout(redis, tv);
+            }
+            s->next = k;
+            return redis;
+        }
+
+        EMI_LOG("%s: failed on redisConnect[%s:%d]: %s\n", __FUNCTION__,
+                 s->ips[k], s->ports[k], redis ? redis->errstr : "out of memory");
+
+        if (redis)
+        {
+            redisFree(redis);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * SENTINEL get-master-addr-by-name
+ */
+static int _redis_sentinel_query(redis_sentinel *s, redisContext *redis, char *ip, int size, int *port)
+{
+    int rc = REDIS_ERR;
+    redisReply *reply = NULL;
+
+    reply = (redisReply *)redisCommand(redis, "SENTINEL get-master-addr-by-name %s", s->name);
+    if (!reply)
+    {
+        EMI_LOG("%s: redisCommand error: %s\n", __FUNCTION__,
+                 REDIS_ERR_IO == redis->err ? strerror(errno) : redis->errstr);
+        return REDIS_ERR;
+    }
+
+    if (REDIS_REPLY_ARRAY == reply->type && 2 == reply->elements
+        && REDIS_REPLY_STRING == reply->element[0]->type && REDIS_REPLY_STRING == reply->element[1]->type)
+    {
+        snprintf(ip, size, "%s", reply->element[0]->str);
+        *port = atoi(reply->element[1]->str);
+        rc = REDIS_OK;
+    }
+    else
+    {
+        EMI_LOG("%s: sentinel doesn't know master[%s]\n", __FUNCTION__, s->name);
+    }
+
+    freeReplyObject(reply);
+
+    return rc;
+}
+
+/**
+ * Move owner and followers to the new primary, each move connects, so it's done
+ * outside s->lock on a copy of the followers
+ */
+static void _redis_sentinel_switch(redis_sentinel *s, const char *ip, int port)
+{
+    int i = 0, n = 0;
+    redis_client **followers = NULL;
+
+    if (0 == strcmp(ip, s->client->ip) && port == s->client->port)
+    {
+        return;
+    }
+
+    EMI_LOG("%s: master[%s] moved from [%s:%d] to [%s:%d]\n", __FUNCTION__,
+             s->name, s->client->ip, s->client->port, ip, port);
+
+    _redis_endpoint_switch(s->client, ip, port);
+
+    pthread_mutex_lock(&s->lock);
+
+    n = s->nfollowers;
+    followers = (redis_client **)malloc(sizeof(redis_client *) * (n + 1));
+    if (!followers)
+    {
+        EMI_LOG("%s: FATAL, out of memory, moving followers under lock\n", __FUNCTION__);
+
+        for (i = 0; i < s->nfollowers; ++i)
+        {
+            _redis_endpoint_switch(s->followers[i], ip, port);
+        }
+
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+
+    memcpy(followers, s->followers, sizeof(redis_client *) * n);
+
+    /* a follower leaving meanwhile waits for us, see _redis_sentinel_stop */
+    s->switching = REDIS_TRUE;
+
+    pthread_mutex_unlock(&s->lock);
+
+    for (i = 0; i < n; ++i)
+    {
+        _redis_endpoint_switch(followers[i], ip, port);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->switching = REDIS_FALSE;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    free(followers);
+}
+
+/**
+ * message: <master name> <old ip> <old port> <new ip> <new port>
+ */
+static void _redis_sentinel_message(redis_sentinel *s, redisReply *reply)
+{
+    int port = 0;
+    char name[MAX_MEMBER_LEN] = {0};
+    char ip[16] = {0};
+
+    if (REDIS_REPLY_ARRAY != reply->type || 3 != reply->elements
+        || REDIS_REPLY_STRING != reply->element[2]->type || 0 != strcmp("message", reply->element[0]->str))
+    {
+        return;
+    }
+
+    if (3 != sscanf(reply->element[2]->str, "%255s %*s %*d %15s %d", name, ip, &port))
+    {
+        EMI_LOG("%s: UNEXPECT, message[%s]\n", __FUNCTION__, reply->element[2]->str);
+        return;
+    }
+
+    if (0 == strcmp(name, s->name))
+    {
+        _redis_sentinel_switch(s, ip, port);
+    }
+}
+
+static void _redis_sentinel_wait(redis_sentinel *s, int ms)
+{
+    struct timeval now;
+    struct timespec deadline;
+
+    gettimeofday(&now, NULL);
+    deadline.tv_sec = now.tv_sec + ms / 1000;
+    deadline.tv_nsec = now.tv_usec * 1000 + (long)(ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&s->lock);
+
+    while (s->running)
+    {
+        if (ETIMEDOUT == pthread_cond_timedwait(&s->cond, &s->lock, &deadline))
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * Stay subscribed to +switch-master on one sentinel, on any error go to the next
+ * one and query the master again, a failover may have happened meanwhile
+ */
+static void *_redis_sentinel_routine(void *arg)
+{
+    int port = 0;
+    char ip[16] = {0};
+    redis_sentinel *s = (redis_sentinel *)arg;
+    redisContext *redis = NULL;
+    redisReply *reply = NULL;
+    struct timeval tv = {0, 0};
+
+    while (s->running)
+    {
+        redis = _redis_sentinel_connect(s);
+        if (!redis)
+        {
+            _redis_sentinel_wait(s, REDIS_SENTINEL_RETRY);
+            continue;
+        }
+
+        if (REDIS_OK == _redis_sentinel_query(s, redis, ip, sizeof(ip), &port))
+        {
+            _redis_sentinel_switch(s, ip, port);
+        }
+
+        reply = (redisReply *)redisCommand(redis, "SUBSCRIBE %s", REDIS_SENTINEL_CHANNEL);
+        if (reply)
+        {
+            freeReplyObject(reply);
+
+            /* messages come whenever a failover happens */
+            redisSetTimeout(redis, tv);
+
+            pthread_mutex_lock(&s->lock);
+            s->fd = s->running ? redis->fd : -1;
+            pthread_mutex_unlock(&s->lock);
+
+            while (s->running && REDIS_OK == redisGetReply(redis, (void **)&reply))
+            {
+                _redis_sentinel_message(s, reply);
+                freeReplyObject(reply);
+            }
+
+            pthread_mutex_lock(&s->lock);
+            s->fd = -1;
+            pthread_mutex_unlock(&s->lock);
+        }
+
+        if (s->running)
+        {
+            EMI_LOG("%s: lost sentinel[%s:%d]\n", __FUNCTION__, s->ips[s->next], s->ports[s->next]);
+            s->next = (s->next + 1) % s->n;
+        }
+
+        redisFree(redis);
+    }
+
+    return NULL;
+}
+
+static void _redis_sentinel_free(redis_sentinel *s)
+{
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->followers);
+    free(s->ips);
+    free(s->ports);
+    free(s);
+}
+
+/**
+ * Resolve current primary of `name' into c, and keep following it
+ */
+int _redis_sentinel_start(redis_client *c, const char *name, const char **ips, const int *ports, int n)
+{
+    int i = 0, port = 0, rc = REDIS_ERR;
+    char ip[16] = {0};
+    redis_sentinel *s = NULL;
+    redisContext *redis = NULL;
+
+    s = (redis_sentinel *)calloc(1, sizeof(redis_sentinel));
+    if (!s)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    s->ips = (char (*)[16])malloc(sizeof(*s->ips) * n);
+    s->ports = (int *)malloc(sizeof(int) * n);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (!s->ips || !s->ports)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        _redis_sentinel_free(s);
+        return REDIS_ERR;
+    }
+
+    s->client = c;
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    for (i = 0; i < n; ++i)
+    {
+        snprintf(s->ips[i], sizeof(s->ips[i]), "%s", ips[i]);
+        s->ports[i] = ports[i];
+    }
+    s->n = n;
+    s->fd = -1;
+
+    /* the first primary, before any command needs it */
+    while (s->next < n && REDIS_OK != rc)
+    {
+        redis = _redis_sentinel_connect(s);
+        if (!redis)
+        {
+            break;
+        }
+
+        rc = _redis_sentinel_query(s, redis, ip, sizeof(ip), &port);
+        redisFree(redis);
+
+        if (REDIS_OK != rc)
+        {
+            s->next++;
+        }
+    }
+
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: no sentinel knows master[%s]\n", __FUNCTION__, name);
+        _redis_sentinel_free(s);
+        return REDIS_ERR;
+    }
+
+    snprintf(c->ip, sizeof(c->ip), "%s", ip);
+    c->port = port;
+    c->sentinel = s;
+
+    s->running = 1;
+    if (0 != pthread_create(&s->watcher, NULL, _redis_sentinel_routine, s))
+    {
+        EMI_LOG("%s: create watcher thread failed: %s\n", __FUNCTION__, strerror(errno));
+        c->sentinel = NULL;
+        _redis_sentinel_free(s);
+        return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+/**
+ * Move follower, a clone of c, along with c on failover
+ */
+void _redis_sentinel_follow(redis_client *c, redis_client *follower)
+{
+    redis_sentinel *s = c->sentinel;
+    redis_client **followers = NULL;
+
+    pthread_mutex_lock(&s->lock);
+
+    followers = (redis_client **)realloc(s->followers, sizeof(redis_client *) * (s->nfollowers + 1));
+    if (followers)
+    {
+        s->followers = followers;
+        s->followers[s->nfollowers++] = follower;
+        follower->sentinel = s;
+    }
+    else
+    {
+        EMI_LOG("%s: FATAL, out of memory, clone won't follow failover\n", __FUNCTION__);
+    }
+
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * Owner stops the watcher, a follower just leaves
+ */
+void _redis_sentinel_stop(redis_client *c)
+{
+    int i = 0;
+    redis_sentinel *s = c->sentinel;
+
+    if (!s)
+    {
+        return;
+    }
+
+    c->sentinel = NULL;
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->client != c)
+    {
+        for (i = 0; i < s->nfollowers; ++i)
+        {
+            if (s->followers[i] == c)
+            {
+                s->followers[i] = s->followers[--s->nfollowers];
+                break;
+            }
+        }
+
+        /* c may be in the copy being moved, it's freed once we return */
+        while (s->switching)
+        {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+
+    /* followers outliving c stay where they are */
+    for (i = 0; i < s->nfollowers; ++i)
+    {
+        s->followers[i]->sentinel = NULL;
+    }
+
+    s->running = 0;
+    if (s->fd >= 0)
+    {
+        /* wakes the watcher blocked on the subscription */
+        shutdown(s->fd, SHUT_RDWR);
+    }
+    pthread_cond_broadcast(&s->cond);
+
+    pthread_mutex_unlock(&s->lock);
+
+    pthread_join(s->watcher, NULL);
+
+    _redis_sentinel_free(s);
+}
+
@@ -149,7 +149,7 @@ int redis_set_sadd(redis_client *this, int index, const char *key, const char *m
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -160,7 +160,7 @@ int redis_set_sadd(redis_client *this, int index, const char *key, const char *m
         rc = _redis_set_sadd_s(this, index, key, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -180,7 +180,7 @@ int redis_set_srem(redis_client *this, int index, const char *key, const char *m
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -191,7 +191,7 @@ int redis_set_srem(redis_client *this, int index, const char *key, const char *m
         rc = _redis_set_srem_s(this, index, key, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -207,7 +207,7 @@ int redis_set_sismember(redis_client *this, int index, const char *key, const ch
         return REDIS_FALSE;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -230,15 +230,19 @@ int redis_set_sismember(redis_client *this, int index, const char *key, const ch
     rc = (0 != rc && -1 != rc) ? REDIS_TRUE : REDIS_FALSE;
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
 
 int redis_set_smembers(redis_client *this, int index, const char *key, redis_member **o_members)
 {
-    int rc = 0;
+    int rc = 0, leader = REDIS_TRUE;
+    size_t size = 0;
+    redis_flight *flight = NULL;
     char cmd[MAX_SINGLE_CMD_LEN] = {0};
+    long long since = 0;
+    redis_client *conn = NULL;
 
     if (!this || index < 0 || !key || '\0' == key[0] || !o_members)
     {
@@ -246,18 +250,30 @@ int redis_set_smembers(redis_client *this, int index, const char *key, redis_mem
         return -1;
     }
 
+    conn = _redis_replica_pick(this, &index, &since);
+
     *o_members = NULL;
 
-    pthread_mutex_lock(&this->lock);
+    /* share the result of an identical SMEMBERS in flight */
+    if (this->pipeline < 0)
+    {
+        flight = _redis_flight_begin(this, index, "SMEMBERS", key, NULL, &leader);
+        if (flight && !leader)
+        {
+            return _redis_flight_wait(this, flight, (void **)o_members, &size);
+        }
+    }
+
+    REDIS_LOCK(conn);
 
-    if (this->pipeline >= 0)
+    if (conn->pipeline >= 0)
     {
         EMI_LOG("%s: Set.SMEMBERS don't support pipeline mode\n", __FUNCTION__);
         rc = -1;
         goto on_ret;
     }
 
-    rc = _redis_try_connect_nonblock(this, index);
+    rc = _redis_try_connect_nonblock(conn, index);
     if (REDIS_OK != rc)
     {
         EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
@@ -267,10 +283,18 @@ int redis_set_smembers(redis_client *this, int index, const char *key, redis_mem
 
     snprintf(cmd, sizeof(cmd), "SMEMBERS %s", key);
 
-    rc = _redis_command_strings(this, cmd, REDIS_FALSE, o_members);
+    rc = _redis_replica_strings(this, conn, index, cmd, o_members);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    _redis_replica_done(this, conn, since);
+
+    /* before a write waiting for the lock can run, it must not join this flight after */
+    if (flight)
+    {
+        _redis_flight_end(this, flight, rc, *o_members, rc > 0 ? sizeof(redis_member) * rc : 0);
+    }
+
+    REDIS_UNLOCK(conn);
 
     return rc;
 }
@@ -291,7 +315,7 @@ int redis_set_sscan(redis_client *this, int index,
 
     *o_members = NULL;
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -313,11 +337,42 @@ int redis_set_sscan(redis_client *this, int index,
     rc = _redis_command_strings(this, cmd, REDIS_TRUE, o_members);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+static int 
+_redis_set_multi(redis_client *this, int index, const char *cmd, const char *key, const char **members, int count)
+{
+    int rc = -1;
+    const char *head[2] = {cmd, key};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !members || count <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    REDIS_LOCK(this);
+
+    rc = _redis_command_chunked(this, index, head, 2, members, count, 1);
+
+    REDIS_UNLOCK(this);
 
     return rc;
 }
 
+int redis_set_saddm(redis_client *this, int index, const char *key, const char **members, int count)
+{
+    return _redis_set_multi(this, index, "SADD", key, members, count);
+}
+
+int redis_set_sremm(redis_client *this, int index, const char *key, const char **members, int count)
+{
+    return _redis_set_multi(this, index, "SREM", key, members, count);
+}
+
 int redis_set_init(redis_set *Set)
 {
 	Set->SADD      = redis_set_sadd;
@@ -325,6 +380,8 @@ int redis_set_init(redis_set *Set)
 	Set->SISMEMBER = redis_set_sismember;
     Set->SMEMBERS  = redis_set_smembers;
     Set->SSCAN     = redis_set_sscan;
+    Set->SADDM     = redis_set_saddm;
+    Set->SREMM     = redis_set_sremm;
 
     return REDIS_OK;
 }
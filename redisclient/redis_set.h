@@ -14,6 +14,14 @@ typedef struct __redis_set
     int (*SMEMBERS)(redis_client *this, int index, const char *key, redis_member **o_members);
     int (*SSCAN)(redis_client *this, int index, const char *key, const char *pattern, int count, redis_member **o_members);
 
+    /**
+     * Add or remove `count' members with commands of at most chunk_args members
+     *
+     * @return count of members added or removed, < 0 on failure, 0 in pipeline mode
+     */
+    int (*SADDM)(redis_client *this, int index, const char *key, const char **members, int count);
+    int (*SREMM)(redis_client *this, int index, const char *key, const char **members, int count);
+
 } redis_set;
 
 
@@ -215,7 +215,7 @@ int redis_sortedset_zadd(redis_client *this, int index, const char *key, int sco
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -226,7 +226,7 @@ int redis_sortedset_zadd(redis_client *this, int index, const char *key, int sco
         rc = _redis_sortedset_zadd_s(this, index, key, score, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -242,7 +242,7 @@ int redis_sortedset_zcount(redis_client *this, int index, const char *key, int m
         return -1;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -264,7 +264,7 @@ int redis_sortedset_zcount(redis_client *this, int index, const char *key, int m
     rc = _redis_command_int(this, cmd);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -279,7 +279,7 @@ int redis_sortedset_zincrby(redis_client *this, int index, const char *key, int
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -290,7 +290,7 @@ int redis_sortedset_zincrby(redis_client *this, int index, const char *key, int
         rc = _redis_sortedset_zincrby_s(this, index, key, score, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -311,6 +311,8 @@ int redis_sortedset_zrange(redis_client *this, int index,
 {
     int rc = -1;
     char cmd[MAX_SINGLE_CMD_LEN] = {0};
+    long long since = 0;
+    redis_client *conn = NULL;
 
     if (!this || index < 0 || !key || '\0' == key[0] || !o_data)
     {
@@ -318,18 +320,20 @@ int redis_sortedset_zrange(redis_client *this, int index,
         return -1;
     }
 
+    conn = _redis_replica_pick(this, &index, &since);
+
     *o_data = NULL;
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(conn);
 
-    if (this->pipeline >= 0)
+    if (conn->pipeline >= 0)
     {
         EMI_LOG("%s: SortedSet.ZRANGE don't support pipeline mode\n", __FUNCTION__);
         rc = -1;
         goto on_ret;
     }
 
-    rc = _redis_try_connect_nonblock(this, index);
+    rc = _redis_try_connect_nonblock(conn, index);
     if (REDIS_OK != rc)
     {
         EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
@@ -340,16 +344,17 @@ int redis_sortedset_zrange(redis_client *this, int index,
     if (REDIS_TRUE == withscores)
     {
         snprintf(cmd, sizeof(cmd), "ZRANGE %s %d %d WITHSCORES", key, start, stop);
-        rc = _redis_command_score_strings(this, cmd, REDIS_FALSE, (redis_score_member **)o_data);
+        rc = _redis_command_score_strings(conn, cmd, REDIS_FALSE, (redis_score_member **)o_data);
     }
     else
     {
         snprintf(cmd, sizeof(cmd), "ZRANGE %s %d %d", key, start, stop);
-        rc = _redis_command_strings(this, cmd, REDIS_FALSE, (redis_member **)o_data);
+        rc = _redis_command_strings(conn, cmd, REDIS_FALSE, (redis_member **)o_data);
     }
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    _redis_replica_done(this, conn, since);
+    REDIS_UNLOCK(conn);
 
     return rc;
 }
@@ -372,6 +377,8 @@ int redis_sortedset_zrangebyscore(redis_client *this, int index,
     char min_b[12] = {0};
     char max_b[12] = {0};
     char cmd[MAX_SINGLE_CMD_LEN] = {0};
+    long long since = 0;
+    redis_client *conn = NULL;
 
     if (!this || index < 0 || !key || '\0' == key[0] || !o_data)
     {
@@ -379,18 +386,20 @@ int redis_sortedset_zrangebyscore(redis_client *this, int index,
         return -1;
     }
 
+    conn = _redis_replica_pick(this, &index, &since);
+
     *o_data = NULL;
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(conn);
 
-    if (this->pipeline >= 0)
+    if (conn->pipeline >= 0)
     {
         EMI_LOG("%s: SortedSet.ZRANGEBYSCORE don't support pipeline mode\n", __FUNCTION__);
         rc = -1;
         goto on_ret;
     }
 
-    rc = _redis_try_connect_nonblock(this, index);
+    rc = _redis_try_connect_nonblock(conn, index);
     if (REDIS_OK != rc)
     {
         EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
@@ -404,16 +413,17 @@ int redis_sortedset_zrangebyscore(redis_client *this, int index,
     if (REDIS_TRUE == withscores)
     {
         snprintf(cmd, sizeof(cmd), "ZRANGEBYSCORE %s %s %s WITHSCORES", key, min_b, max_b);
-        rc = _redis_command_score_strings(this, cmd, REDIS_FALSE, (redis_score_member **)o_data);
+        rc = _redis_command_score_strings(conn, cmd, REDIS_FALSE, (redis_score_member **)o_data);
     }
     else
     {
         snprintf(cmd, sizeof(cmd), "ZRANGEBYSCORE %s %s %s", key, min_b, min_b);
-        rc = _redis_command_strings(this, cmd, REDIS_FALSE, (redis_member **)o_data);
+        rc = _redis_command_strings(conn, cmd, REDIS_FALSE, (redis_member **)o_data);
     }
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    _redis_replica_done(this, conn, since);
+    REDIS_UNLOCK(conn);
 
     return rc;
 }
@@ -430,7 +440,7 @@ int redis_sortedset_zscore(redis_client *this, int index, const char *key, const
         return INT_MAX;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -454,7 +464,7 @@ int redis_sortedset_zscore(redis_client *this, int index, const char *key, const
     free(score);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -475,7 +485,7 @@ int redis_sortedset_zscan(redis_client *this, int index,
 
     *o_members = NULL;
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -497,7 +507,7 @@ int redis_sortedset_zscan(redis_client *this, int index,
     rc = _redis_command_score_strings(this, cmd, REDIS_TRUE, o_members);
 
 on_ret:
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
@@ -512,7 +522,7 @@ int redis_sortedset_zrem(redis_client *this, int index, const char *key, const c
         return REDIS_ERR;
     }
 
-    pthread_mutex_lock(&this->lock);
+    REDIS_LOCK(this);
 
     if (this->pipeline >= 0)
     {
@@ -523,12 +533,101 @@ int redis_sortedset_zrem(redis_client *this, int index, const char *key, const c
         rc = _redis_sortedset_zrem_s(this, index, key, member);
     }
 
-    pthread_mutex_unlock(&this->lock);
+    REDIS_UNLOCK(this);
 
     return rc;
 }
 
 
+int redis_sortedset_zaddm(redis_client *this, int index, const char *key, 
+                                const int *scores, const char **members, int count, int flags)
+{
+    int i = 0, nhead = 2, rc = -1;
+    const char *head[5] = {"ZADD", key};
+    const char **args = NULL;
+    char (*scores_b)[12] = NULL;
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !scores || !members || count <= 0 ||
+        ((flags & REDIS_ZADD_NX) && (flags & (REDIS_ZADD_XX | REDIS_ZADD_GT | REDIS_ZADD_LT))) ||
+        ((flags & REDIS_ZADD_GT) && (flags & REDIS_ZADD_LT)))
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    if (flags & REDIS_ZADD_NX)
+    {
+        head[nhead++] = "NX";
+    }
+
+    if (flags & REDIS_ZADD_XX)
+    {
+        head[nhead++] = "XX";
+    }
+
+    if (flags & REDIS_ZADD_GT)
+    {
+        head[nhead++] = "GT";
+    }
+
+    if (flags & REDIS_ZADD_LT)
+    {
+        head[nhead++] = "LT";
+    }
+
+    if (flags & REDIS_ZADD_CH)
+    {
+        head[nhead++] = "CH";
+    }
+
+    args = (const char **)malloc(sizeof(char *) * 2 * count);
+    scores_b = malloc(sizeof(*scores_b) * count);
+    if (!args || !scores_b)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        goto on_free;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        snprintf(scores_b[i], sizeof(scores_b[i]), "%d", scores[i]);
+        args[2*i] = scores_b[i];
+        args[2*i + 1] = members[i];
+    }
+
+    REDIS_LOCK(this);
+
+    rc = _redis_command_chunked(this, index, head, nhead, args, 2 * count, 2);
+
+    REDIS_UNLOCK(this);
+
+on_free:
+    free(args);
+    free(scores_b);
+
+    return rc;
+}
+
+int redis_sortedset_zremm(redis_client *this, int index, const char *key, const char **members, int count)
+{
+    int rc = -1;
+    const char *head[2] = {"ZREM", key};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !members || count <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    REDIS_LOCK(this);
+
+    rc = _redis_command_chunked(this, index, head, 2, members, count, 1);
+
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
 int redis_sortedset_init(redis_sortedset *SortedSet)
 {
 	SortedSet->ZADD          = redis_sortedset_zadd;
@@ -539,6 +638,8 @@ int redis_sortedset_init(redis_sortedset *SortedSet)
     SortedSet->ZSCORE        = redis_sortedset_zscore;
     SortedSet->ZSCAN         = redis_sortedset_zscan;
     SortedSet->ZREM          = redis_sortedset_zrem;
+    SortedSet->ZADDM         = redis_sortedset_zaddm;
+    SortedSet->ZREMM         = redis_sortedset_zremm;
 
     return REDIS_OK;
 }
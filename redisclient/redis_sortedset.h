@@ -6,6 +6,16 @@
 #include "redis_types.h"
 
 
+/**
+ * Flags of SortedSet.ZADDM, combine with `|'
+ */
+#define REDIS_ZADD_NX   0x01        /* Only add new members */
+#define REDIS_ZADD_XX   0x02        /* Only update existing members */
+#define REDIS_ZADD_GT   0x04        /* Only update when new score is greater */
+#define REDIS_ZADD_LT   0x08        /* Only update when new score is less */
+#define REDIS_ZADD_CH   0x10        /* Count changed members instead of added */
+
+
 typedef struct __redis_sortedset
 {
     int (*ZADD)(redis_client *this, int index, const char *key, int score, const char *member);
@@ -17,6 +27,16 @@ typedef struct __redis_sortedset
     int (*ZSCAN)(redis_client *this, int index, const char *key, const char *pattern, int count, redis_score_member **o_members);
     int (*ZREM)(redis_client *this, int index, const char *key, const char *member);
 
+    /**
+     * Add `count' members with scores[i] for members[i], or remove them, 
+     * with commands of at most chunk_args arguments
+     *
+     * @return count of members added (changed with REDIS_ZADD_CH) or removed, 
+     *         < 0 on failure, 0 in pipeline mode
+     */
+    int (*ZADDM)(redis_client *this, int index, const char *key, const int *scores, const char **members, int count, int flags);
+    int (*ZREMM)(redis_client *this, int index, const char *key, const char **members, int count);
+
 } redis_sortedset;
 
 
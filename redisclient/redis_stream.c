@@ -0,0 +1,854 @@
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+#include "redis_stream.h"
+
+
+/**
+ * Argument buffers of XREADGROUP
+ */
+typedef struct __redis_stream_readgroup_args
+{
+    const char *argv[12];
+    char        count_b[12];
+    char        block_b[12];
+    int         argc;
+
+} redis_stream_readgroup_args;
+
+
+/**
+ * Milliseconds CONSUME backs off after a failed batch, doubling up to MAX
+ */
+#define REDIS_STREAM_BACKOFF_MIN    100
+#define REDIS_STREAM_BACKOFF_MAX    1000
+
+/**
+ * _redis_stream_consume_batch: group or stream is gone (deleted, FLUSHDB)
+ */
+#define REDIS_STREAM_NOGROUP        -2
+
+/**
+ * _redis_stream_consume_batch: XACK failed, entries read with it were dropped
+ */
+#define REDIS_STREAM_UNACKED        -3
+
+
+static void _redis_stream_disconnect(redis_client *c)
+{
+    EMI_LOG("%s: redis error: %s\n", __FUNCTION__,
+             REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr);
+
+    redisFree(c->redis);
+    c->redis = NULL;
+    c->db_index = -1;
+}
+
+static void _redis_stream_copy_id(redis_stream_id *o_id, const redisReply *id)
+{
+    snprintf(o_id->id, sizeof(o_id->id), "%.*s", id->len, id->str);
+}
+
+/**
+ * Decode an array of [id, [field, value, ...]] entries.
+ * Entries deleted from stream but still pending ([id, nil]) are not decoded,
+ * their ids go to o_skipped if not NULL, so the caller can ack them.
+ *
+ * @return count of decoded entries, < 0 on malformed reply
+ */
+static int _redis_stream_decode(const redisReply *entries, redis_hash_member *hdesc_tbls,
+                                void *o_data, int stride, redis_stream_id *o_ids, int max,
+                                redis_stream_id *o_skipped, int *o_nskipped)
+{
+    int i = 0, j = 0, n = 0, skipped = 0;
+    void *data = NULL;
+    redisReply *entry = NULL, *fields = NULL;
+    redis_hash_member *m = NULL;
+
+    if (REDIS_REPLY_ARRAY != entries->type)
+    {
+        return REDIS_REPLY_NIL == entries->type ? 0 : -1;
+    }
+
+    for (i = 0; i < entries->elements && n + skipped < max; ++i)
+    {
+        entry = entries->element[i];
+        if (REDIS_REPLY_ARRAY != entry->type || 2 != entry->elements ||
+            REDIS_REPLY_STRING != entry->element[0]->type)
+        {
+            continue;
+        }
+
+        if (REDIS_REPLY_ARRAY != entry->element[1]->type)
+        {
+            if (o_skipped)
+            {
+                _redis_stream_copy_id(&o_skipped[skipped++], entry->element[0]);
+            }
+            continue;
+        }
+
+        if (o_ids)
+        {
+            _redis_stream_copy_id(&o_ids[n], entry->element[0]);
+        }
+
+        data = (char *)o_data + n * stride;
+        memset(data, 0, stride);
+
+        fields = entry->element[1];
+        for (j = 0; j + 1 < fields->elements; j += 2)
+        {
+            if (REDIS_REPLY_STRING != fields->element[j]->type ||
+                REDIS_REPLY_STRING != fields->element[j + 1]->type)
+            {
+                continue;
+            }
+
+            m = _redis_member_find(hdesc_tbls, fields->element[j]->str, fields->element[j]->len);
+            if (m)
+            {
+                _redis_member_decode(m, data, fields->element[j + 1]->str, fields->element[j + 1]->len);
+            }
+        }
+
+        n++;
+    }
+
+    if (o_nskipped)
+    {
+        *o_nskipped = skipped;
+    }
+
+    return n;
+}
+
+/**
+ * Decode reply of XREADGROUP: [[key, entries]] or nil on timeout
+ */
+static int _redis_stream_decode_read(const redisReply *reply, redis_hash_member *hdesc_tbls,
+                                     void *o_data, int stride, redis_stream_id *o_ids, int max,
+                                     redis_stream_id *o_skipped, int *o_nskipped)
+{
+    const redisReply *stream = NULL;
+
+    if (REDIS_REPLY_NIL == reply->type)
+    {
+        return 0;
+    }
+
+    if (REDIS_REPLY_ARRAY != reply->type || reply->elements < 1)
+    {
+        EMI_LOG("%s: unexpected reply type[%d]\n", __FUNCTION__, reply->type);
+        return -1;
+    }
+
+    stream = reply->element[0];
+    if (REDIS_REPLY_ARRAY != stream->type || 2 != stream->elements)
+    {
+        EMI_LOG("%s: unexpected stream reply type[%d]\n", __FUNCTION__, stream->type);
+        return -1;
+    }
+
+    return _redis_stream_decode(stream->element[1], hdesc_tbls, o_data, stride, o_ids, max, o_skipped, o_nskipped);
+}
+
+static void _redis_stream_readgroup_argv(redis_stream_readgroup_args *args, const char *key,
+                                         const char *group, const char *consumer,
+                                         const char *id, int count, int block)
+{
+    snprintf(args->count_b, sizeof(args->count_b), "%d", count);
+    snprintf(args->block_b, sizeof(args->block_b), "%d", block);
+
+    args->argc = 0;
+    args->argv[args->argc++] = "XREADGROUP";
+    args->argv[args->argc++] = "GROUP";
+    args->argv[args->argc++] = group;
+    args->argv[args->argc++] = consumer;
+    args->argv[args->argc++] = "COUNT";
+    args->argv[args->argc++] = args->count_b;
+    if (block >= 0)
+    {
+        args->argv[args->argc++] = "BLOCK";
+        args->argv[args->argc++] = args->block_b;
+    }
+    args->argv[args->argc++] = "STREAMS";
+    args->argv[args->argc++] = key;
+    args->argv[args->argc++] = id;
+}
+
+/**
+ * @return argv of "cmd key group [extra] id ...", caller must free it
+ */
+static const char **_redis_stream_ids_argv(const char **head, int nhead, const redis_stream_id *ids, int count)
+{
+    int i = 0;
+    const char **argv = NULL;
+
+    argv = (const char **)malloc(sizeof(char *) * (nhead + count));
+    if (!argv)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return NULL;
+    }
+
+    memcpy(argv, head, sizeof(char *) * nhead);
+
+    for (i = 0; i < count; ++i)
+    {
+        argv[nhead + i] = ids[i].id;
+    }
+
+    return argv;
+}
+
+
+int redis_stream_xadd(redis_client *this, int index, const char *key, int maxlen,
+                      redis_hash_member *hdesc_tbls, const void *data, redis_stream_id *o_id)
+{
+    int rc = REDIS_OK;
+    int i = 0, n = 0, len = 0, argc = 0, head = 0;
+    const char **argv = NULL;
+    size_t *argvlen = NULL;
+    char *ints = NULL, **bufs = NULL;
+    char maxlen_b[12] = {0};
+    redisReply *reply = NULL;
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !hdesc_tbls || !data)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    for (n = 0; hdesc_tbls[n].member; ++n)
+    {
+        ;
+    }
+
+    argv = (const char **)malloc(sizeof(char *) * (2 * n + 6));
+    argvlen = (size_t *)malloc(sizeof(size_t) * (2 * n + 6));
+    bufs = (char **)malloc(sizeof(char *) * (2 * n + 6));
+    ints = (char *)malloc(12 * (n + 1));
+    if (!argv || !argvlen || !bufs || !ints)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        rc = REDIS_ERR;
+        goto on_free;
+    }
+
+    argv[argc] = "XADD";
+    argvlen[argc++] = 4;
+    argv[argc] = key;
+    argvlen[argc++] = strlen(key);
+
+    if (maxlen > 0)
+    {
+        /* approximate trimming lets server drop whole nodes, much cheaper than exact */
+        snprintf(maxlen_b, sizeof(maxlen_b), "%d", maxlen);
+        argv[argc] = "MAXLEN";
+        argvlen[argc++] = 6;
+        argv[argc] = "~";
+        argvlen[argc++] = 1;
+        argv[argc] = maxlen_b;
+        argvlen[argc++] = strlen(maxlen_b);
+    }
+
+    argv[argc] = "*";
+    argvlen[argc++] = 1;
+    head = argc;
+
+    for (i = 0; i < n; ++i)
+    {
+        len = _redis_member_encode(&hdesc_tbls[i], data, ints + 12 * i, 12, &argv[argc + 1]);
+        if (len < 0)
+        {
+            continue;
+        }
+
+        argv[argc] = _redis_member_wire(&hdesc_tbls[i]);
+        argvlen[argc] = strlen(argv[argc]);
+        argvlen[argc + 1] = len;
+        argc += 2;
+    }
+
+    if (head == argc)
+    {
+        EMI_LOG("%s: all member is empty\n", __FUNCTION__);
+        rc = REDIS_ERR;
+        goto on_free;
+    }
+
+    _redis_compress_argv(this, argc, argv, argvlen, head + 1, 2, bufs);
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        rc = _redis_command_argv_p(this, index, argc, argv, argvlen);
+        goto on_ret;
+    }
+
+    rc = _redis_try_connect_nonblock(this, index);
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(this, argc, argv, argvlen);
+    if (!reply)
+    {
+        rc = REDIS_ERR;
+        goto on_ret;
+    }
+
+    if (o_id && REDIS_REPLY_STRING == reply->type)
+    {
+        _redis_stream_copy_id(o_id, reply);
+    }
+
+    freeReplyObject(reply);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    _redis_compress_release(argc, bufs);
+
+on_free:
+    free(argv);
+    free(argvlen);
+    free(bufs);
+    free(ints);
+
+    return rc;
+}
+
+int redis_stream_xgroup_create(redis_client *this, int index, const char *key, const char *group, const char *id)
+{
+    int rc = REDIS_OK;
+    redisReply *reply = NULL;
+    const char *argv[6] = {"XGROUP", "CREATE", key, group, id, "MKSTREAM"};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !group || '\0' == group[0] || !id || '\0' == id[0])
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: Stream.XGROUP_CREATE don't support pipeline mode\n", __FUNCTION__);
+        rc = REDIS_ERR;
+        goto on_ret;
+    }
+
+    rc = _redis_try_connect_nonblock(this, index);
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    EMI_LOG("%s: cmd[XGROUP CREATE %s %s %s MKSTREAM]\n", __FUNCTION__, key, group, id);
+
+    reply = (redisReply *)redisCommandArgv(this->redis, 6, argv, NULL);
+    if (!reply)
+    {
+        _redis_stream_disconnect(this);
+        rc = REDIS_ERR;
+        goto on_ret;
+    }
+
+    if (REDIS_REPLY_ERROR == reply->type && 0 != strncmp(reply->str, "BUSYGROUP", 9))
+    {
+        EMI_LOG("%s: redisCommandArgv reply error: %s\n", __FUNCTION__, reply->str);
+        rc = REDIS_ERR;
+    }
+
+    freeReplyObject(reply);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+int redis_stream_xreadgroup(redis_client *this, int index, const char *key, const char *group, const char *consumer,
+                            const char *id, int count, int block,
+                            redis_hash_member *hdesc_tbls, void *o_data, int stride, redis_stream_id *o_ids)
+{
+    int rc = -1;
+    redisReply *reply = NULL;
+    redis_stream_readgroup_args args;
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !group || '\0' == group[0] ||
+        !consumer || '\0' == consumer[0] || !id || '\0' == id[0] || count <= 0 ||
+        !hdesc_tbls || !o_data || stride <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    _redis_stream_readgroup_argv(&args, key, group, consumer, id, count, block);
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: Stream.XREADGROUP don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(this, args.argc, args.argv, NULL);
+    if (!reply)
+    {
+        goto on_ret;
+    }
+
+    rc = _redis_stream_decode_read(reply, hdesc_tbls, o_data, stride, o_ids, count, NULL, NULL);
+
+    freeReplyObject(reply);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+int redis_stream_xack(redis_client *this, int index, const char *key, const char *group,
+                      const redis_stream_id *ids, int count)
+{
+    int rc = -1;
+    const char **argv = NULL;
+    const char *head[3] = {"XACK", key, group};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !group || '\0' == group[0] || !ids || count <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    argv = _redis_stream_ids_argv(head, 3, ids, count);
+    if (!argv)
+    {
+        return -1;
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        rc = (REDIS_OK == _redis_command_argv_p(this, index, count + 3, argv, NULL)) ? 0 : -1;
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    rc = _redis_command_argv_int(this, count + 3, argv, NULL);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    free(argv);
+
+    return rc;
+}
+
+int redis_stream_xpending(redis_client *this, int index, const char *key, const char *group,
+                          int count, redis_stream_pending **o_pending)
+{
+    int i = 0, rc = -1;
+    char count_b[12] = {0};
+    redisReply *reply = NULL, *e = NULL;
+    const char *argv[6] = {"XPENDING", key, group, "-", "+", count_b};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !group || '\0' == group[0] || count <= 0 || !o_pending)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    *o_pending = NULL;
+
+    snprintf(count_b, sizeof(count_b), "%d", count);
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: Stream.XPENDING don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(this, 6, argv, NULL);
+    if (!reply)
+    {
+        goto on_ret;
+    }
+
+    if (REDIS_REPLY_ARRAY != reply->type)
+    {
+        EMI_LOG("%s: unexpected reply type[%d]\n", __FUNCTION__, reply->type);
+        goto on_free;
+    }
+
+    rc = 0;
+    if (0 == reply->elements)
+    {
+        goto on_free;
+    }
+
+    *o_pending = (redis_stream_pending *)malloc(sizeof(redis_stream_pending) * reply->elements);
+    if (!(*o_pending))
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        rc = -1;
+        goto on_free;
+    }
+
+    memset(*o_pending, 0, sizeof(redis_stream_pending) * reply->elements);
+
+    for (i = 0; i < reply->elements; ++i)
+    {
+        e = reply->element[i];
+        if (REDIS_REPLY_ARRAY != e->type || 4 != e->elements)
+        {
+            continue;
+        }
+
+        snprintf((*o_pending)[rc].id, REDIS_STREAM_ID_LEN, "%.*s", e->element[0]->len, e->element[0]->str);
+        snprintf((*o_pending)[rc].consumer, REDIS_STREAM_CONSUMER_LEN, "%.*s", e->element[1]->len, e->element[1]->str);
+        (*o_pending)[rc].idle = e->element[2]->integer;
+        (*o_pending)[rc].deliveries = e->element[3]->integer;
+        rc++;
+    }
+
+on_free:
+    freeReplyObject(reply);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+int redis_stream_xclaim(redis_client *this, int index, const char *key, const char *group, const char *consumer,
+                        int min_idle, const redis_stream_id *ids, int count,
+                        redis_hash_member *hdesc_tbls, void *o_data, int stride, redis_stream_id *o_ids)
+{
+    int rc = -1;
+    char min_idle_b[12] = {0};
+    const char **argv = NULL;
+    redisReply *reply = NULL;
+    const char *head[5] = {"XCLAIM", key, group, consumer, min_idle_b};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !group || '\0' == group[0] ||
+        !consumer || '\0' == consumer[0] || min_idle < 0 || !ids || count <= 0 ||
+        !hdesc_tbls || !o_data || stride <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    snprintf(min_idle_b, sizeof(min_idle_b), "%d", min_idle);
+
+    argv = _redis_stream_ids_argv(head, 5, ids, count);
+    if (!argv)
+    {
+        return -1;
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: Stream.XCLAIM don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(this, count + 5, argv, NULL);
+    if (!reply)
+    {
+        goto on_ret;
+    }
+
+    rc = _redis_stream_decode(reply, hdesc_tbls, o_data, stride, o_ids, count, NULL, NULL);
+
+    freeReplyObject(reply);
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    free(argv);
+
+    return rc;
+}
+
+/**
+ * Send pending acknowledgements and next XREADGROUP in one round trip.
+ * Ids of deleted entries read are written over acks, they are acked next time.
+ *
+ * @return count of entries read
+ * -  REDIS_STREAM_NOGROUP: group or stream is gone, it must be created again
+ * -  REDIS_STREAM_UNACKED: acks were kept to be resent, entries read along are
+ *                          pending and must be replayed from history
+ * -  < 0 : other failure, acks must be resent
+ */
+static int _redis_stream_consume_batch(redis_client *c, redis_stream_consumer *sc, const char *id,
+                                       redis_stream_id *acks, int *nacks,
+                                       void *entries, redis_stream_id *ids)
+{
+    int rc = -1, acked = REDIS_TRUE;
+    const char **argv = NULL;
+    redisReply *reply = NULL;
+    redis_stream_readgroup_args args;
+    const char *head[3] = {"XACK", sc->key, sc->group};
+
+    if (REDIS_OK != _redis_try_connect_nonblock(c, sc->index))
+    {
+        return -1;
+    }
+
+    if (*nacks > 0)
+    {
+        argv = _redis_stream_ids_argv(head, 3, acks, *nacks);
+        if (!argv)
+        {
+            return -1;
+        }
+
+        rc = redisAppendCommandArgv(c->redis, *nacks + 3, argv, NULL);
+        free(argv);
+        if (REDIS_OK != rc)
+        {
+            EMI_LOG("%s: redisAppendCommandArgv XACK failed\n", __FUNCTION__);
+            _redis_stream_disconnect(c);
+            return -1;
+        }
+    }
+
+    _redis_stream_readgroup_argv(&args, sc->key, sc->group, sc->consumer, id, sc->batch, sc->block);
+    if (REDIS_OK != redisAppendCommandArgv(c->redis, args.argc, args.argv, NULL))
+    {
+        EMI_LOG("%s: redisAppendCommandArgv XREADGROUP failed\n", __FUNCTION__);
+        _redis_stream_disconnect(c);
+        return -1;
+    }
+
+    rc = -1;
+
+    if (*nacks > 0)
+    {
+        if (REDIS_OK != redisGetReply(c->redis, (void **)&reply))
+        {
+            _redis_stream_disconnect(c);
+            return -1;
+        }
+
+        if (REDIS_REPLY_ERROR == reply->type)
+        {
+            EMI_LOG("%s: XACK reply error: %s\n", __FUNCTION__, reply->str);
+            acked = REDIS_FALSE;
+        }
+
+        freeReplyObject(reply);
+    }
+
+    if (REDIS_OK != redisGetReply(c->redis, (void **)&reply))
+    {
+        _redis_stream_disconnect(c);
+        return -1;
+    }
+
+    if (REDIS_REPLY_ERROR == reply->type)
+    {
+        EMI_LOG("%s: XREADGROUP reply error: %s\n", __FUNCTION__, reply->str);
+        if (0 == strncmp(reply->str, "NOGROUP", 7))
+        {
+            rc = REDIS_STREAM_NOGROUP;
+        }
+    }
+    else if (!acked)
+    {
+        /* acks must not be overwritten, whatever was read stays pending to us */
+        rc = REDIS_STREAM_UNACKED;
+    }
+    else
+    {
+        /* acks went out with this request */
+        *nacks = 0;
+        _redis_reply_inflate(c, reply);
+        rc = _redis_stream_decode_read(reply, sc->hdesc_tbls, entries, sc->stride, ids, sc->batch, acks, nacks);
+    }
+
+    freeReplyObject(reply);
+
+    return rc;
+}
+
+int redis_stream_consume(redis_client *this, redis_stream_consumer *sc)
+{
+    int rc = REDIS_OK;
+    int count = 0, nacks = 0, history = 1, created = 0, backoff = 0;
+    redis_client *c = NULL;
+    void *entries = NULL;
+    redis_stream_id *ids = NULL, *acks = NULL;
+    redis_stream_id history_id = {"0"};
+
+    if (!this || !sc || sc->index < 0 || !sc->key || '\0' == sc->key[0] || !sc->group || '\0' == sc->group[0] ||
+        !sc->consumer || '\0' == sc->consumer[0] || sc->batch <= 0 ||
+        !sc->hdesc_tbls || sc->stride <= 0 || !sc->handler)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    /* blocking reads would hold this->lock, the loop runs on its own connection */
+    c = _redis_client_clone(this);
+    if (c)
+    {
+        /* XREADGROUP BLOCK waits longer than a command */
+        c->command_timeout = 0;
+    }
+    entries = malloc(sc->batch * sc->stride);
+    ids = (redis_stream_id *)malloc(sizeof(redis_stream_id) * sc->batch);
+    acks = (redis_stream_id *)malloc(sizeof(redis_stream_id) * sc->batch);
+    if (!c || !entries || !ids || !acks)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        rc = REDIS_ERR;
+        goto on_ret;
+    }
+
+    while (sc->running)
+    {
+        if (!created)
+        {
+            if (REDIS_OK != c->Stream.XGROUP_CREATE(c, sc->index, sc->key, sc->group, "$"))
+            {
+                sleep(1);
+                continue;
+            }
+
+            created = 1;
+        }
+
+        /* entries delivered to this consumer before a restart are replayed first */
+        count = _redis_stream_consume_batch(c, sc, history ? history_id.id : ">", acks, &nacks, entries, ids);
+        if (count < 0)
+        {
+            if (REDIS_STREAM_NOGROUP == count)
+            {
+                /* deleted group or stream, acks and history went with it */
+                EMI_LOG("%s: group[%s] of stream[%s] is gone, create it again\n", __FUNCTION__, sc->group, sc->key);
+                created = 0;
+                nacks = 0;
+                history = 1;
+                snprintf(history_id.id, sizeof(history_id.id), "0");
+            }
+            else if (REDIS_STREAM_UNACKED == count)
+            {
+                /* entries read along with the failed XACK come back from the start */
+                history = 1;
+                snprintf(history_id.id, sizeof(history_id.id), "0");
+            }
+
+            /* error replies (NOGROUP, WRONGTYPE, ...) come back at once, don't spin on them */
+            backoff = backoff > 0 ? backoff * 2 : REDIS_STREAM_BACKOFF_MIN;
+            if (backoff > REDIS_STREAM_BACKOFF_MAX)
+            {
+                backoff = REDIS_STREAM_BACKOFF_MAX;
+            }
+            usleep(backoff * 1000);
+            continue;
+        }
+
+        backoff = 0;
+
+        if (0 == count)
+        {
+            /* a batch of deleted entries only doesn't end the replay */
+            if (0 == nacks)
+            {
+                history = 0;
+            }
+            continue;
+        }
+
+        if (history)
+        {
+            history_id = ids[count - 1];
+        }
+
+        if (REDIS_OK == sc->handler(ids, entries, count, sc->arg))
+        {
+            /* after ids of deleted entries, both come from one batch so they fit */
+            memcpy(acks + nacks, ids, sizeof(redis_stream_id) * count);
+            nacks += count;
+        }
+    }
+
+    if (nacks > 0)
+    {
+        c->Stream.XACK(c, sc->index, sc->key, sc->group, acks, nacks);
+    }
+
+on_ret:
+    redis_client_destroy(c);
+    free(entries);
+    free(ids);
+    free(acks);
+
+    return rc;
+}
+
+
+int redis_stream_init(redis_stream *Stream)
+{
+    Stream->XADD          = redis_stream_xadd;
+    Stream->XGROUP_CREATE = redis_stream_xgroup_create;
+    Stream->XREADGROUP    = redis_stream_xreadgroup;
+    Stream->XACK          = redis_stream_xack;
+    Stream->XPENDING      = redis_stream_xpending;
+    Stream->XCLAIM        = redis_stream_xclaim;
+    Stream->CONSUME       = redis_stream_consume;
+
+    return REDIS_OK;
+}
+
+void redis_stream_deinit(redis_stream *Stream)
+{
+    ;
+}
+
@@ -0,0 +1,128 @@
+
+
+#ifndef __REDIS_STREAM_H
+#define __REDIS_STREAM_H
+
+
+#include "redis_types.h"
+#include "redis_hash_desc.h"
+
+
+#define REDIS_STREAM_ID_LEN         48
+#define REDIS_STREAM_CONSUMER_LEN   128
+
+
+typedef struct __redis_stream_id
+{
+    char id[REDIS_STREAM_ID_LEN];
+
+} redis_stream_id;
+
+typedef struct __redis_stream_pending
+{
+    char      id[REDIS_STREAM_ID_LEN];
+    char      consumer[REDIS_STREAM_CONSUMER_LEN];
+    long long idle;                         /* Milliseconds since last delivery */
+    long long deliveries;                   /* Times delivered */
+
+} redis_stream_pending;
+
+/**
+ * Batch handler of Stream.CONSUME, entries[i] is the decoded struct of ids[i], 
+ * entries are laid out with consumer stride.
+ *
+ * @return
+ * - REDIS_OK : batch done, all ids are acknowledged
+ * - REDIS_ERR: ids stay pending, they can be XCLAIMed later
+ */
+typedef int (*redis_stream_handler)(const redis_stream_id *ids, void *entries, int count, void *arg);
+
+/**
+ * Parameters and state of a Stream.CONSUME loop
+ */
+typedef struct __redis_stream_consumer
+{
+    int                     index;          /* Database index */
+    const char             *key;            /* Stream key */
+    const char             *group;          /* Consumer group, created if missing */
+    const char             *consumer;       /* Consumer name in group */
+    int                     batch;          /* Max entries per XREADGROUP */
+    int                     block;          /* Milliseconds XREADGROUP blocks */
+    redis_hash_member      *hdesc_tbls;     /* Field descriptors of entries */
+    int                     stride;         /* Size of one decoded struct */
+    redis_stream_handler    handler;
+    void                   *arg;
+    volatile int            running;        /* Set 0 to make CONSUME return */
+
+} redis_stream_consumer;
+
+
+typedef struct __redis_stream
+{
+    /**
+     * XADD key [MAXLEN ~ maxlen] * field value ..., fields come from hdesc_tbls.
+     * maxlen <= 0 disables trimming, o_id may be NULL and is not set in pipeline mode.
+     */
+    int (*XADD)(redis_client *this, int index, const char *key, int maxlen, 
+                redis_hash_member *hdesc_tbls, const void *data, redis_stream_id *o_id);
+
+    /**
+     * XGROUP CREATE key group id MKSTREAM, an existing group is not an error
+     */
+    int (*XGROUP_CREATE)(redis_client *this, int index, const char *key, const char *group, const char *id);
+
+    /**
+     * XREADGROUP GROUP group consumer COUNT count [BLOCK block] STREAMS key id,
+     * entry i is decoded into o_data + i * stride.
+     * id ">" reads new entries, "0" replays entries pending on this consumer.
+     * block < 0 does not block. Pending entries deleted from the stream are
+     * left out, they stay pending until acked by id.
+     *
+     * @return count of entries, 0 on timeout, < 0 on failure
+     */
+    int (*XREADGROUP)(redis_client *this, int index, const char *key, const char *group, const char *consumer,
+                      const char *id, int count, int block, 
+                      redis_hash_member *hdesc_tbls, void *o_data, int stride, redis_stream_id *o_ids);
+
+    /**
+     * @return count of acknowledged ids, < 0 on failure
+     */
+    int (*XACK)(redis_client *this, int index, const char *key, const char *group, 
+                const redis_stream_id *ids, int count);
+
+    /**
+     * XPENDING key group - + count, o_pending must be freed by caller
+     *
+     * @return count of pending entries, < 0 on failure
+     */
+    int (*XPENDING)(redis_client *this, int index, const char *key, const char *group, 
+                    int count, redis_stream_pending **o_pending);
+
+    /**
+     * XCLAIM key group consumer min_idle id ..., claimed entries are decoded like XREADGROUP
+     *
+     * @return count of claimed entries, < 0 on failure
+     */
+    int (*XCLAIM)(redis_client *this, int index, const char *key, const char *group, const char *consumer,
+                  int min_idle, const redis_stream_id *ids, int count,
+                  redis_hash_member *hdesc_tbls, void *o_data, int stride, redis_stream_id *o_ids);
+
+    /**
+     * Consumer loop on a dedicated connection: replays entries still pending on 
+     * this consumer, then reads new entries in batches. Acknowledgement of a batch 
+     * is pipelined with the next XREADGROUP, so a batch costs one round trip.
+     * Deleted entries are acked without reaching the handler. A failed read backs
+     * off, and the group is created again when the stream or group was deleted.
+     * Returns when consumer->running is cleared.
+     */
+    int (*CONSUME)(redis_client *this, redis_stream_consumer *consumer);
+
+} redis_stream;
+
+
+int redis_stream_init(redis_stream *Stream);
+void redis_stream_deinit(redis_stream *Stream);
+
+
+#endif
+
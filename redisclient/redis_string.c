@@ -1,21 +1,507 @@
 
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <hiredis.h>
 
 #include "redis_client.h"
+#include "_redis_client.h"
 #include "redis_string.h"
 
 
-int redis_string_nop(redis_client *this, int index)
+#define VALUE_LEN(value, len)   ((len) < 0 ? strlen(value) : (size_t)(len))
+
+
+/**
+ * Copy a string reply into caller buffer, NUL-terminate it when there is room
+ *
+ * @return full length of string
+ */
+static int _redis_string_copy(const redisReply *reply, char *buf, int size)
 {
-    return REDIS_OK;
+    int len = reply->len;
+
+    memcpy(buf, reply->str, len < size ? len : size);
+    if (len < size)
+    {
+        buf[len] = '\0';
+    }
+
+    return len;
+}
+
+/**
+ * Run a command in single mode or append it in pipeline mode
+ *
+ * @return integer reply, 0 in pipeline mode, < 0 on failure
+ */
+static int
+_redis_string_command_int(redis_client *this, int index, int argc, const char **argv, const size_t *argvlen)
+{
+    if (this->pipeline >= 0)
+    {
+        return REDIS_OK == _redis_command_argv_p(this, index, argc, argv, argvlen) ? 0 : -1;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        return -1;
+    }
+
+    return _redis_command_argv_int(this, argc, argv, argvlen);
+}
+
+
+int redis_string_get(redis_client *this, int index, const char *key, char *buf, int size)
+{
+    int rc = -1;
+    redisReply *reply = NULL;
+    const char *argv[2] = {"GET", key};
+    long long since = 0;
+    redis_client *conn = NULL;
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !buf || size <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    conn = _redis_replica_pick(this, &index, &since);
+
+    REDIS_LOCK(conn);
+
+    if (conn->pipeline >= 0)
+    {
+        EMI_LOG("%s: String.GET don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(conn, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(conn, 2, argv, NULL);
+    if (reply)
+    {
+        if (REDIS_REPLY_STRING == reply->type)
+        {
+            rc = _redis_string_copy(reply, buf, size);
+        }
+
+        freeReplyObject(reply);
+    }
+
+on_ret:
+    _redis_replica_done(this, conn, since);
+    REDIS_UNLOCK(conn);
+
+    return rc;
+}
+
+int redis_string_set(redis_client *this, int index, const char *key, const char *value, int len, int ttl, int flags)
+{
+    int rc = -1, argc = 3;
+    redisReply *reply = NULL;
+    char ttl_b[12] = {0};
+    char *buf = NULL;
+    const char *argv[6] = {"SET", key, value};
+    size_t argvlen[6];
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !value ||
+        ((flags & REDIS_STRING_EX) && (flags & REDIS_STRING_PX)) ||
+        ((flags & REDIS_STRING_NX) && (flags & REDIS_STRING_XX)) ||
+        ((flags & (REDIS_STRING_EX | REDIS_STRING_PX)) && ttl <= 0))
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    argvlen[0] = 3;
+    argvlen[1] = strlen(key);
+    argvlen[2] = VALUE_LEN(value, len);
+
+    if (_redis_compress(this, value, argvlen[2], &buf, &argvlen[2]))
+    {
+        argv[2] = buf;
+    }
+
+    if (flags & (REDIS_STRING_EX | REDIS_STRING_PX))
+    {
+        snprintf(ttl_b, sizeof(ttl_b), "%d", ttl);
+        argv[argc] = (flags & REDIS_STRING_EX) ? "EX" : "PX";
+        argvlen[argc++] = 2;
+        argv[argc] = ttl_b;
+        argvlen[argc++] = strlen(ttl_b);
+    }
+
+    if (flags & (REDIS_STRING_NX | REDIS_STRING_XX))
+    {
+        argv[argc] = (flags & REDIS_STRING_NX) ? "NX" : "XX";
+        argvlen[argc++] = 2;
+    }
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        rc = REDIS_OK == _redis_command_argv_p(this, index, argc, argv, argvlen) ? 0 : -1;
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(this, argc, argv, argvlen);
+    if (reply)
+    {
+        /* nil reply means NX/XX condition not met */
+        rc = (REDIS_REPLY_STATUS == reply->type) ? 1 : 0;
+
+        freeReplyObject(reply);
+    }
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    free(buf);
+
+    return rc;
 }
 
+int redis_string_mget(redis_client *this, int index, const char **keys, int count,
+                           void *out, int stride, int *o_lens)
+{
+    int i = 0, rc = -1;
+    redisReply *reply = NULL, *sub_reply = NULL;
+    const char **argv = NULL;
+
+    if (!this || index < 0 || !keys || count <= 0 || !out || stride <= 0 || !o_lens)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    argv = (const char **)malloc(sizeof(char *) * (count + 1));
+    if (!argv)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return -1;
+    }
+
+    argv[0] = "MGET";
+    memcpy(argv + 1, keys, sizeof(char *) * count);
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: String.MGET don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(this, count + 1, argv, NULL);
+    if (!reply)
+    {
+        goto on_ret;
+    }
+
+    if (REDIS_REPLY_ARRAY != reply->type || count != reply->elements)
+    {
+        EMI_LOG("%s: MGET reply error: reply type[%d], reply elements[%ld]\n",
+                 __FUNCTION__, reply->type, (long)reply->elements);
+        goto on_ret;
+    }
+
+    rc = 0;
+    for (i = 0; i < count; ++i)
+    {
+        sub_reply = reply->element[i];
+        if (REDIS_REPLY_STRING == sub_reply->type)
+        {
+            o_lens[i] = _redis_string_copy(sub_reply, (char *)out + i * stride, stride);
+            rc++;
+        }
+        else
+        {
+            o_lens[i] = -1;
+        }
+    }
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    if (reply)
+    {
+        freeReplyObject(reply);
+    }
+
+    free(argv);
+
+    return rc;
+}
+
+int redis_string_mset(redis_client *this, int index, const char **keys, const char **values,
+                           const int *lens, int count)
+{
+    int i = 0, rc = REDIS_ERR;
+    redisReply *reply = NULL;
+    const char **argv = NULL;
+    size_t *argvlen = NULL;
+    char **bufs = NULL;
+
+    if (!this || index < 0 || !keys || !values || count <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    argv = (const char **)malloc(sizeof(char *) * (2 * count + 1));
+    argvlen = (size_t *)malloc(sizeof(size_t) * (2 * count + 1));
+    bufs = (char **)malloc(sizeof(char *) * (2 * count + 1));
+    if (!argv || !argvlen || !bufs)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        goto on_free;
+    }
+
+    argv[0] = "MSET";
+    argvlen[0] = 4;
+    for (i = 0; i < count; ++i)
+    {
+        argv[2*i + 1] = keys[i];
+        argvlen[2*i + 1] = strlen(keys[i]);
+        argv[2*i + 2] = values[i];
+        argvlen[2*i + 2] = VALUE_LEN(values[i], lens ? lens[i] : -1);
+    }
+
+    _redis_compress_argv(this, 2 * count + 1, argv, argvlen, 2, 2, bufs);
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        rc = _redis_command_argv_p(this, index, 2 * count + 1, argv, argvlen);
+    }
+    else if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+    }
+    else if ((reply = _redis_command_argv(this, 2 * count + 1, argv, argvlen)))
+    {
+        freeReplyObject(reply);
+        rc = REDIS_OK;
+    }
+
+    REDIS_UNLOCK(this);
+
+    _redis_compress_release(2 * count + 1, bufs);
+
+on_free:
+    free(argv);
+    free(argvlen);
+    free(bufs);
+
+    return rc;
+}
+
+int redis_string_incrby(redis_client *this, int index, const char *key, long long increment, long long *o_value)
+{
+    int rc = REDIS_ERR;
+    redisReply *reply = NULL;
+    char incr_b[24] = {0};
+    const char *argv[3] = {"INCRBY", key, incr_b};
+
+    if (!this || index < 0 || !key || '\0' == key[0])
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    snprintf(incr_b, sizeof(incr_b), "%lld", increment);
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        rc = _redis_command_argv_p(this, index, 3, argv, NULL);
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(this, 3, argv, NULL);
+    if (reply)
+    {
+        if (REDIS_REPLY_INTEGER == reply->type)
+        {
+            if (o_value)
+            {
+                *o_value = reply->integer;
+            }
+
+            rc = REDIS_OK;
+        }
+
+        freeReplyObject(reply);
+    }
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+int redis_string_getrange(redis_client *this, int index, const char *key, int start, int end, char *buf, int size)
+{
+    int rc = -1;
+    redisReply *reply = NULL;
+    char start_b[12] = {0}, end_b[12] = {0};
+    const char *argv[4] = {"GETRANGE", key, start_b, end_b};
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !buf || size <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    if (this->compress_min > 0)
+    {
+        /* stored bytes may be compressed, a byte range of them means nothing */
+        EMI_LOG("%s: String.GETRANGE don't support compress_min > 0\n", __FUNCTION__);
+        return -1;
+    }
+
+    snprintf(start_b, sizeof(start_b), "%d", start);
+    snprintf(end_b, sizeof(end_b), "%d", end);
+
+    REDIS_LOCK(this);
+
+    if (this->pipeline >= 0)
+    {
+        EMI_LOG("%s: String.GETRANGE don't support pipeline mode\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    if (REDIS_OK != _redis_try_connect_nonblock(this, index))
+    {
+        EMI_LOG("%s: _redis_try_connect_nonblock failed\n", __FUNCTION__);
+        goto on_ret;
+    }
+
+    reply = _redis_command_argv(this, 4, argv, NULL);
+    if (reply)
+    {
+        if (REDIS_REPLY_STRING == reply->type)
+        {
+            rc = _redis_string_copy(reply, buf, size);
+        }
+
+        freeReplyObject(reply);
+    }
+
+on_ret:
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+int redis_string_setrange(redis_client *this, int index, const char *key, int offset, const char *value, int len)
+{
+    int rc = -1;
+    char offset_b[12] = {0};
+    const char *argv[4] = {"SETRANGE", key, offset_b, value};
+    size_t argvlen[4];
+
+    if (!this || index < 0 || !key || '\0' == key[0] || offset < 0 || !value)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    if (this->compress_min > 0)
+    {
+        /* stored bytes may be compressed, a byte range of them means nothing */
+        EMI_LOG("%s: String.SETRANGE don't support compress_min > 0\n", __FUNCTION__);
+        return -1;
+    }
+
+    snprintf(offset_b, sizeof(offset_b), "%d", offset);
+
+    argvlen[0] = 8;
+    argvlen[1] = strlen(key);
+    argvlen[2] = strlen(offset_b);
+    argvlen[3] = VALUE_LEN(value, len);
+
+    REDIS_LOCK(this);
+
+    rc = _redis_string_command_int(this, index, 4, argv, argvlen);
+
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
+
+int redis_string_append(redis_client *this, int index, const char *key, const char *value, int len)
+{
+    int rc = -1;
+    const char *argv[3] = {"APPEND", key, value};
+    size_t argvlen[3];
+
+    if (!this || index < 0 || !key || '\0' == key[0] || !value)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return -1;
+    }
+
+    if (this->compress_min > 0)
+    {
+        /* stored bytes may be compressed, a byte range of them means nothing */
+        EMI_LOG("%s: String.APPEND don't support compress_min > 0\n", __FUNCTION__);
+        return -1;
+    }
+
+    argvlen[0] = 6;
+    argvlen[1] = strlen(key);
+    argvlen[2] = VALUE_LEN(value, len);
+
+    REDIS_LOCK(this);
+
+    rc = _redis_string_command_int(this, index, 3, argv, argvlen);
+
+    REDIS_UNLOCK(this);
+
+    return rc;
+}
 
 
 int redis_string_init(redis_string *String)
 {
-	String->NOP = redis_string_nop;
+    String->GET      = redis_string_get;
+    String->SET      = redis_string_set;
+    String->MGET     = redis_string_mget;
+    String->MSET     = redis_string_mset;
+    String->INCRBY   = redis_string_incrby;
+    String->GETRANGE = redis_string_getrange;
+    String->SETRANGE = redis_string_setrange;
+    String->APPEND   = redis_string_append;
 
     return REDIS_OK;
 }
@@ -25,4 +511,3 @@ void redis_string_deinit(redis_string *String)
     ;
 }
 
-
@@ -1,4 +1,3 @@
-
 #ifndef __REDIS_STRING_H
 #define __REDIS_STRING_H
 
@@ -6,9 +5,70 @@
 #include "redis_types.h"
 
 
+/**
+ * Flags of String.SET, combine with `|'
+ */
+#define REDIS_STRING_EX     0x01        /* ttl is in seconds */
+#define REDIS_STRING_PX     0x02        /* ttl is in milliseconds */
+#define REDIS_STRING_NX     0x04        /* Only set if key does not exist */
+#define REDIS_STRING_XX     0x08        /* Only set if key already exists */
+
+
+/**
+ * Values are binary safe, `len' < 0 means value is a C string.
+ *
+ * GET, MGET and GETRANGE copy values straight from the reply into caller buffers,
+ * at most `size' bytes, and NUL-terminate them when there is room. They return the
+ * full length of the value, so a return value >= size means it was truncated.
+ *
+ * GETRANGE, SETRANGE and APPEND work on stored bytes, which SET and MSET may have
+ * compressed, so they fail on clients with compress_min > 0. Don't use them from
+ * any client on keys written by a client that compresses.
+ */
 typedef struct __redis_string
 {
-    int (*NOP)(redis_client *this, int index);
+    /**
+     * @return length of value, < 0 if key not exist or command failed
+     */
+    int (*GET)(redis_client *this, int index, const char *key, char *buf, int size);
+
+    /**
+     * @return
+     * -  > 0: value is set
+     * -  = 0: not set because of NX/XX, or queued in pipeline mode
+     * -  < 0: command failed
+     */
+    int (*SET)(redis_client *this, int index, const char *key, const char *value, int len, int ttl, int flags);
+
+    /**
+     * Get `count' keys in one round trip, value of keys[i] is copied into
+     * out + i * stride, at most stride bytes, and its length is stored in o_lens[i],
+     * -1 if key not exist.
+     *
+     * @return count of keys exist, < 0 if command failed
+     */
+    int (*MGET)(redis_client *this, int index, const char **keys, int count, void *out, int stride, int *o_lens);
+
+    /**
+     * Set `count' keys in one round trip, lens may be NULL if all values are C strings
+     */
+    int (*MSET)(redis_client *this, int index, const char **keys, const char **values, const int *lens, int count);
+
+    /**
+     * o_value: value after increment, may be NULL
+     */
+    int (*INCRBY)(redis_client *this, int index, const char *key, long long increment, long long *o_value);
+
+    /**
+     * @return length of substring, < 0 if command failed
+     */
+    int (*GETRANGE)(redis_client *this, int index, const char *key, int start, int end, char *buf, int size);
+
+    /**
+     * @return length of value after modified, < 0 if command failed, 0 in pipeline mode
+     */
+    int (*SETRANGE)(redis_client *this, int index, const char *key, int offset, const char *value, int len);
+    int (*APPEND)(redis_client *this, int index, const char *key, const char *value, int len);
 
 } redis_string;
 
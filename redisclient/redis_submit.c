@@ -0,0 +1,573 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+
+
+static void _redis_submit_wakeup(redis_submit *this)
+{
+    char c = 0;
+
+    if (1 != write(this->wakeup[1], &c, 1) && EAGAIN != errno)
+    {
+        EMI_LOG("%s: write wakeup pipe failed: %s\n", __FUNCTION__, strerror(errno));
+    }
+}
+
+/**
+ * Lock-free push, any thread. Only the push that finds the stack empty wakes
+ * the I/O thread up, the others ride on its wakeup.
+ */
+static void _redis_submit_push(redis_submit *this, redis_future *f)
+{
+    redis_future *head = NULL;
+
+    f->owner = this;
+
+    do
+    {
+        head = this->head;
+        f->next = head;
+    } while (!__sync_bool_compare_and_swap(&this->head, head, f));
+
+    /* an event loop finds it through events() */
+    if (!head && !this->loop)
+    {
+        _redis_submit_wakeup(this);
+    }
+}
+
+/**
+ * Take everything pushed so far, I/O thread or event loop only
+ *
+ * @return futures oldest first
+ */
+static redis_future *_redis_submit_take(redis_submit *this)
+{
+    redis_future *f = NULL, *next = NULL, *fifo = NULL;
+
+    do
+    {
+        f = this->head;
+    } while (f && !__sync_bool_compare_and_swap(&this->head, f, NULL));
+
+    while (f)
+    {
+        next = f->next;
+        f->next = fifo;
+        fifo = f;
+        f = next;
+    }
+
+    return fifo;
+}
+
+static void _redis_submit_fail(redis_future *f)
+{
+    redis_future *next = NULL;
+
+    while (f)
+    {
+        next = f->next;
+        _redis_future_complete(f, NULL);
+        f = next;
+    }
+}
+
+/**
+ * Connection broke, commands in flight fail
+ */
+static void _redis_submit_drop(redis_submit *this)
+{
+    redis_client *c = this->client;
+
+    redisFree(c->redis);
+    c->redis = NULL;
+    c->db_index = -1;
+    this->writing = 0;
+
+    _redis_submit_fail(this->inflight);
+    this->inflight = this->tail = NULL;
+}
+
+/**
+ * No reply within command_timeout, for callers polling in event loop mode
+ */
+void _redis_submit_timeout(redis_submit *this)
+{
+    EMI_LOG("%s: no reply for %d ms, dropping connection\n", __FUNCTION__, this->client->command_timeout);
+
+    _redis_submit_drop(this);
+}
+
+/**
+ * Connect if needed, then switch the socket to non-blocking, so it is only read
+ * and written when poll tells it may go without waiting
+ */
+static int _redis_submit_connect(redis_client *c, int index)
+{
+    if (REDIS_OK != _redis_try_connect_nonblock(c, index))
+    {
+        /* connected but SELECT failed, don't keep a blocking socket around */
+        if (c->redis)
+        {
+            redisFree(c->redis);
+            c->redis = NULL;
+            c->db_index = -1;
+        }
+
+        return REDIS_ERR;
+    }
+
+    fcntl(c->redis->fd, F_SETFL, fcntl(c->redis->fd, F_GETFL) | O_NONBLOCK);
+    c->redis->flags &= ~REDIS_BLOCK;
+
+    return REDIS_OK;
+}
+
+/**
+ * Append a batch to output buffer, a SELECT goes before any command of another
+ * database than the one before it
+ */
+static void _redis_submit_append(redis_submit *this, redis_future *batch)
+{
+    redis_client *c = this->client;
+    redis_future *f = NULL;
+
+    while (batch)
+    {
+        f = batch;
+        batch = batch->next;
+        f->next = NULL;
+
+        /* failover, move once what is in flight on the old primary is answered */
+        if (!c->redis || (c->switched && !this->inflight))
+        {
+            if (REDIS_OK != _redis_submit_connect(c, f->index))
+            {
+                _redis_future_complete(f, NULL);
+                continue;
+            }
+        }
+
+        if (c->db_index != f->index)
+        {
+            redisAppendCommand(c->redis, "SELECT %d", f->index);
+            c->db_index = f->index;
+            f->skip = 1;
+        }
+
+        redisAppendFormattedCommand(c->redis, f->cmd, f->len);
+
+        free(f->cmd);
+        f->cmd = NULL;
+
+        if (this->tail)
+        {
+            this->tail->next = f;
+        }
+        else
+        {
+            this->inflight = f;
+        }
+
+        this->tail = f;
+        this->writing = 1;
+    }
+}
+
+/**
+ * Read what came in and complete futures in order
+ */
+static int _redis_submit_read(redis_submit *this)
+{
+    redis_client *c = this->client;
+    redis_future *f = NULL;
+    redisReply *reply = NULL;
+
+    if (REDIS_OK != redisBufferRead(c->redis))
+    {
+        EMI_LOG("%s: redisBufferRead error: %s\n", __FUNCTION__,
+                 REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr);
+        return REDIS_ERR;
+    }
+
+    while (1)
+    {
+        reply = NULL;
+        if (REDIS_OK != redisGetReplyFromReader(c->redis, (void **)&reply))
+        {
+            EMI_LOG("%s: redisGetReplyFromReader error: %s\n", __FUNCTION__, c->redis->errstr);
+            return REDIS_ERR;
+        }
+
+        if (!reply)
+        {
+            return REDIS_OK;
+        }
+
+        f = this->inflight;
+        if (!f)
+        {
+            EMI_LOG("%s: UNEXPECT, reply type[%d] with no command in flight\n", __FUNCTION__, reply->type);
+            freeReplyObject(reply);
+            return REDIS_ERR;
+        }
+
+        if (f->skip > 0)
+        {
+            f->skip--;
+
+            if (REDIS_REPLY_ERROR == reply->type)
+            {
+                /* commands behind it would run against the wrong database */
+                EMI_LOG("%s: failed on SELECT %d: %s\n", __FUNCTION__, f->index, reply->str);
+                freeReplyObject(reply);
+                return REDIS_ERR;
+            }
+
+            freeReplyObject(reply);
+            continue;
+        }
+
+        this->inflight = f->next;
+        if (!this->inflight)
+        {
+            this->tail = NULL;
+        }
+
+        _redis_reply_inflate(c, reply);
+        _redis_future_complete(f, reply);
+    }
+}
+
+static int redis_submit_on_readable(redis_submit *this)
+{
+    if (!this->client->redis)
+    {
+        return REDIS_ERR;
+    }
+
+    if (REDIS_OK != _redis_submit_read(this))
+    {
+        _redis_submit_drop(this);
+        return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+static int redis_submit_on_writable(redis_submit *this)
+{
+    int done = 0;
+    redis_client *c = this->client;
+    redis_future *batch = NULL;
+
+    batch = _redis_submit_take(this);
+    if (batch)
+    {
+        _redis_submit_append(this, batch);
+    }
+
+    if (!c->redis || !this->writing)
+    {
+        return c->redis ? REDIS_OK : REDIS_ERR;
+    }
+
+    if (REDIS_OK != redisBufferWrite(c->redis, &done))
+    {
+        EMI_LOG("%s: redisBufferWrite error: %s\n", __FUNCTION__,
+                 REDIS_ERR_IO == c->redis->err ? strerror(errno) : c->redis->errstr);
+        _redis_submit_drop(this);
+        return REDIS_ERR;
+    }
+
+    this->writing = !done;
+
+    return REDIS_OK;
+}
+
+static int redis_submit_fd(redis_submit *this)
+{
+    redis_client *c = this->client;
+
+    if (!c->redis && REDIS_OK != _redis_submit_connect(c, 0))
+    {
+        _redis_submit_fail(_redis_submit_take(this));
+        return -1;
+    }
+
+    return c->redis->fd;
+}
+
+static int redis_submit_events(redis_submit *this)
+{
+    int events = 0;
+
+    if (this->client->redis)
+    {
+        /* a server closing an idle connection is seen too */
+        events |= REDIS_EVENT_READ;
+    }
+
+    if (this->head || this->writing)
+    {
+        events |= REDIS_EVENT_WRITE;
+    }
+
+    return events;
+}
+
+static void *_redis_submit_io_routine(void *arg)
+{
+    int n = 0, nfds = 0, timeout = 0;
+    char buf[64];
+    redis_submit *this = (redis_submit *)arg;
+    redis_client *c = this->client;
+    struct pollfd fds[2];
+
+    while (this->running)
+    {
+        fds[0].fd = this->wakeup[0];
+        fds[0].events = POLLIN;
+        nfds = 1;
+
+        if (c->redis)
+        {
+            fds[1].fd = c->redis->fd;
+            fds[1].events = POLLIN | (this->writing ? POLLOUT : 0);
+            fds[1].revents = 0;
+            nfds = 2;
+        }
+
+        timeout = this->inflight && c->command_timeout > 0 ? c->command_timeout : -1;
+
+        n = poll(fds, nfds, timeout);
+        if (n < 0)
+        {
+            if (EINTR != errno)
+            {
+                EMI_LOG("%s: poll failed: %s\n", __FUNCTION__, strerror(errno));
+            }
+            continue;
+        }
+
+        if (0 == n)
+        {
+            _redis_submit_timeout(this);
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            while (read(this->wakeup[0], buf, sizeof(buf)) > 0)
+            {
+            }
+        }
+
+        if ((fds[0].revents & POLLIN) || (2 == nfds && (fds[1].revents & POLLOUT)))
+        {
+            redis_submit_on_writable(this);
+        }
+
+        /* a socket swapped in by failover above reads nothing, as it isn't blocking */
+        if (c->redis && 2 == nfds && (fds[1].revents & (POLLIN | POLLERR | POLLHUP)))
+        {
+            redis_submit_on_readable(this);
+        }
+    }
+
+    return NULL;
+}
+
+static redis_future *redis_submit_command_argv(redis_submit *this, int index, int argc, const char **argv, const size_t *argvlen)
+{
+    int len = 0;
+    char *cmd = NULL;
+    redis_future *f = NULL;
+
+    if (!this || argc <= 0 || !argv)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    len = redisFormatCommandArgv(&cmd, argc, argv, argvlen);
+    if (len < 0 || !cmd)
+    {
+        EMI_LOG("%s: redisFormatCommandArgv failed, cmd[%s]\n", __FUNCTION__, argv[0]);
+        return NULL;
+    }
+
+    f = _redis_future_create(cmd, len, index);
+    if (!f)
+    {
+        free(cmd);
+        return NULL;
+    }
+
+    _redis_submit_push(this, f);
+
+    return f;
+}
+
+redis_future *_redis_submit_vcommand(redis_submit *this, int index, const char *format, va_list ap)
+{
+    int len = 0;
+    char *cmd = NULL;
+    redis_future *f = NULL;
+
+    if (!this || !format)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    len = redisvFormatCommand(&cmd, format, ap);
+    if (len < 0 || !cmd)
+    {
+        EMI_LOG("%s: redisvFormatCommand failed, format[%s]\n", __FUNCTION__, format);
+        return NULL;
+    }
+
+    f = _redis_future_create(cmd, len, index);
+    if (!f)
+    {
+        free(cmd);
+        return NULL;
+    }
+
+    _redis_submit_push(this, f);
+
+    return f;
+}
+
+static redis_future *redis_submit_command(redis_submit *this, int index, const char *format, ...)
+{
+    redis_future *f = NULL;
+    va_list ap;
+
+    va_start(ap, format);
+    f = _redis_submit_vcommand(this, index, format, ap);
+    va_end(ap);
+
+    return f;
+}
+
+
+static redis_submit *_redis_submit_create(redis_client *client, int loop)
+{
+    redis_submit *submit = NULL;
+
+    if (!client)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return NULL;
+    }
+
+    submit = (redis_submit *)malloc(sizeof(redis_submit));
+    if (!submit)
+    {
+        EMI_LOG("%s: out of memory, malloc redis_submit failed\n", __FUNCTION__);
+        return NULL;
+    }
+
+    memset(submit, 0, sizeof(redis_submit));
+    submit->wakeup[0] = submit->wakeup[1] = -1;
+    submit->loop = loop;
+
+    submit->command      = redis_submit_command;
+    submit->command_argv = redis_submit_command_argv;
+    submit->fd           = redis_submit_fd;
+    submit->events       = redis_submit_events;
+    submit->on_readable  = redis_submit_on_readable;
+    submit->on_writable  = redis_submit_on_writable;
+
+    submit->client = _redis_client_clone(client);
+    if (!submit->client)
+    {
+        redis_submit_destroy(submit);
+        return NULL;
+    }
+
+    return submit;
+}
+
+redis_submit *redis_submit_create(redis_client *client)
+{
+    redis_submit *submit = NULL;
+
+    submit = _redis_submit_create(client, REDIS_FALSE);
+    if (!submit)
+    {
+        return NULL;
+    }
+
+    if (0 != pipe(submit->wakeup))
+    {
+        EMI_LOG("%s: create wakeup pipe failed: %s\n", __FUNCTION__, strerror(errno));
+        submit->wakeup[0] = submit->wakeup[1] = -1;
+        redis_submit_destroy(submit);
+        return NULL;
+    }
+
+    fcntl(submit->wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(submit->wakeup[1], F_SETFL, O_NONBLOCK);
+
+    submit->running = REDIS_TRUE;
+    if (0 != pthread_create(&submit->io, NULL, _redis_submit_io_routine, submit))
+    {
+        EMI_LOG("%s: pthread_create failed: %s\n", __FUNCTION__, strerror(errno));
+        submit->running = REDIS_FALSE;
+        redis_submit_destroy(submit);
+        return NULL;
+    }
+
+    return submit;
+}
+
+redis_submit *redis_submit_create_loop(redis_client *client)
+{
+    return _redis_submit_create(client, REDIS_TRUE);
+}
+
+void redis_submit_destroy(redis_submit *this)
+{
+    if (!this)
+    {
+        return;
+    }
+
+    if (this->running)
+    {
+        this->running = REDIS_FALSE;
+        _redis_submit_wakeup(this);
+
+        pthread_join(this->io, NULL);
+    }
+
+    _redis_submit_fail(this->inflight);
+    _redis_submit_fail(_redis_submit_take(this));
+
+    if (this->wakeup[0] >= 0)
+    {
+        close(this->wakeup[0]);
+        close(this->wakeup[1]);
+    }
+
+    if (this->client)
+    {
+        redis_client_destroy(this->client);
+    }
+
+    free(this);
+}
+
@@ -0,0 +1,122 @@
+#ifndef __REDIS_SUBMIT_H
+#define __REDIS_SUBMIT_H
+
+
+#include <pthread.h>
+
+#include "redis_types.h"
+
+
+/**
+ * Readiness wanted by a submitter driven from an event loop, see redis_submit.events
+ */
+#define REDIS_EVENT_READ    0x01
+#define REDIS_EVENT_WRITE   0x02
+
+/**
+ * Commands from many threads multiplexed on one connection.
+ *
+ * A caller formats its command on its own thread and pushes it on a lock-free
+ * multi-producer stack, it gets a redis_future back at once. One I/O thread owns
+ * a dedicated connection: each time it wakes up it takes everything pushed so
+ * far, appends it in order to one output buffer, writes the batch and completes
+ * futures as replies come in. Callers never contend on a mutex, and the busier
+ * they are the larger the batches.
+ *
+ * Commands are sent in order of submission, per submitting thread. Commands in
+ * flight when the connection breaks, or when none could be made, complete with
+ * a NULL reply; the next batch connects again. With the client's command_timeout
+ * set, the connection is dropped when no reply comes for that many ms.
+ *
+ * A submitter made by redis_submit_create_loop has no I/O thread, the caller's
+ * own reactor (epoll, libevent, ...) drives it on one thread:
+ *
+ *     f = submit->command(submit, 0, "GET %s", key);
+ *     redis_future_then(f, on_get, ctx);
+ *     fd = submit->fd(submit);            watch it for submit->events(submit)
+ *     ...
+ *     readable: submit->on_readable(submit);   callbacks run here
+ *     writable: submit->on_writable(submit);
+ *
+ * After every step, and after submitting, look at fd and events again: the fd
+ * changes when the connection is made again, and is -1 when it can't be, in
+ * which case everything submitted has failed already. command_timeout isn't
+ * enforced in this mode, the reactor's timers may call on_readable and give up.
+ */
+struct __redis_submit
+{
+    redis_client       *client;                 /* Dedicated connection of I/O thread */
+
+    struct __redis_future *volatile head;       /* Submitted, not taken yet, newest first */
+    int                 wakeup[2];              /* Pipe, written when head turns non-empty */
+
+    struct __redis_future *inflight;            /* Written, waiting for reply, oldest first */
+    struct __redis_future *tail;
+    int                 writing;                /* Output buffer not fully written */
+
+    int                 loop;                   /* Driven by caller's event loop, no I/O thread */
+    volatile int        running;
+    pthread_t           io;
+
+    /**
+     * Submit a command formatted like redisCommand
+     *
+     * @return future of its reply, NULL if it can't be formatted
+     */
+    redis_future       *(*command)(redis_submit *this, int index, const char *format, ...);
+
+    /**
+     * Binary safe variant of command
+     *
+     * @param argvlen length of each argument, NULL if all arguments are C strings
+     */
+    redis_future       *(*command_argv)(redis_submit *this, int index, int argc, const char **argv, const size_t *argvlen);
+
+    /**
+     * Event loop mode only
+     */
+
+    /**
+     * Socket to watch, connected here if it isn't
+     *
+     * @return fd, -1 if not connected, commands submitted so far failed
+     */
+    int                 (*fd)(redis_submit *this);
+
+    /**
+     * @return REDIS_EVENT_READ and/or REDIS_EVENT_WRITE to watch fd for
+     */
+    int                 (*events)(redis_submit *this);
+
+    /**
+     * Read replies, complete their futures and run their callbacks
+     *
+     * @return REDIS_ERR if connection broke, commands in flight failed
+     */
+    int                 (*on_readable)(redis_submit *this);
+
+    /**
+     * Append commands submitted so far and write as much as the socket takes
+     *
+     * @return REDIS_ERR if connection broke, commands in flight failed
+     */
+    int                 (*on_writable)(redis_submit *this);
+};
+
+
+redis_submit *redis_submit_create(redis_client *client);
+
+/**
+ * Submitter without I/O thread, for the caller's event loop
+ */
+redis_submit *redis_submit_create_loop(redis_client *client);
+
+/**
+ * Stop I/O thread if any, futures not completed yet complete with a NULL reply.
+ * Nothing may be submitted once this is called.
+ */
+void redis_submit_destroy(redis_submit *submit);
+
+
+#endif
+
@@ -0,0 +1,1073 @@
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <hiredis.h>
+
+#include "redis_client.h"
+#include "_redis_client.h"
+#include "redis_subscribe.h"
+
+
+/**
+ * Milliseconds reader thread waits on socket before checking running flag
+ */
+#define REDIS_SUBSCRIBE_POLL_TIMEOUT    1000
+
+/**
+ * Initial buckets of subscription table, doubled once subscriptions outnumber them
+ */
+#define REDIS_SUBSCRIBE_BUCKETS         64
+
+
+/**
+ * Handler and arg, replaced as a whole by subscribing again, so dispatchers read
+ * them without lock. Replaced ones are freed with the subscription.
+ */
+typedef struct __redis_subscription_binding
+{
+    redis_message_handler                   handler;
+    void                                   *arg;
+    struct __redis_subscription_binding    *prev;
+
+} redis_subscription_binding;
+
+typedef struct __redis_subscription
+{
+    char                           *name;
+    int                             pattern;
+    unsigned int                    hash;
+    redis_subscription_binding     *volatile binding;
+    struct __redis_subscription    *next;       /* Bucket chain, sub->lock protects it */
+
+    /* atomic, dispatchers never take sub->lock */
+    volatile int                    refs;       /* Subscription table and queued messages */
+    volatile int                    removed;    /* Unsubscribed, queued messages are dropped */
+    volatile int                    running;    /* Handlers being called */
+
+} redis_subscription;
+
+typedef struct __redis_message
+{
+    struct __redis_message *next;
+    redis_subscription     *subscription;       /* Handler and arg are looked up at dispatch */
+    char                   *pattern;
+    char                   *channel;
+    char                   *message;
+    int                     length;
+    char                    data[];
+
+} redis_message;
+
+typedef struct __redis_subscribe_command
+{
+    char                               *cmd;
+    int                                 len;
+    struct __redis_subscribe_command   *next;
+
+} redis_subscribe_command;
+
+/**
+ * One dispatch thread and its message queue
+ */
+typedef struct __redis_dispatcher
+{
+    struct __redis_subscriber *sub;
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    redis_message      *head;
+    redis_message      *tail;
+    int                 stop;
+
+    /* messages parsed by reader thread but not handed over yet, reader only */
+    redis_message      *batch_head;
+    redis_message      *batch_tail;
+
+} redis_dispatcher;
+
+struct __redis_subscriber
+{
+    redis_client               *conn;           /* Dedicated connection, reader thread only */
+
+    pthread_mutex_t             lock;           /* Protect subscription table and commands */
+    pthread_cond_t              idle;           /* A handler of a removed subscription returned */
+    redis_subscription        **buckets;        /* Subscriptions by name and kind */
+    int                         nbuckets;
+    int                         nsubscriptions;
+    redis_subscribe_command    *commands;       /* (UN)SUBSCRIBE waiting for reader thread */
+
+    int                         wakeup[2];      /* Pipe to wake reader thread up */
+    pthread_t                   reader;
+    volatile int                running;
+
+    int                         nworkers;
+    redis_dispatcher           *workers;
+};
+
+
+/**
+ * Subscription whose handler runs on this dispatch thread, NULL off dispatch threads
+ */
+static __thread redis_subscription *_redis_subscribe_running = NULL;
+
+
+static unsigned int _redis_subscribe_hash(const char *str, int len)
+{
+    int i = 0;
+    unsigned int hash = 5381;
+
+    for (i = 0; i < len; ++i)
+    {
+        hash = ((hash << 5) + hash) + (unsigned char)str[i];
+    }
+
+    return hash;
+}
+
+static void _redis_subscribe_wakeup(struct __redis_subscriber *sub)
+{
+    char c = 0;
+
+    if (1 != write(sub->wakeup[1], &c, 1) && EAGAIN != errno)
+    {
+        EMI_LOG("%s: write wakeup pipe failed: %s\n", __FUNCTION__, strerror(errno));
+    }
+}
+
+/**
+ * Queue a command for reader thread, caller must hold sub->lock
+ */
+static int _redis_subscribe_queue(struct __redis_subscriber *sub, const char *command, const char *name)
+{
+    const char *argv[2];
+    redis_subscribe_command *c = NULL, **tail = NULL;
+
+    c = (redis_subscribe_command *)malloc(sizeof(redis_subscribe_command));
+    if (!c)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    argv[0] = command;
+    argv[1] = name;
+
+    /* one argument whatever name holds, spaces included */
+    c->next = NULL;
+    c->len = redisFormatCommandArgv(&c->cmd, 2, argv, NULL);
+    if (c->len < 0)
+    {
+        EMI_LOG("%s: FATAL, format command failed\n", __FUNCTION__);
+        free(c);
+        return REDIS_ERR;
+    }
+
+    for (tail = &sub->commands; *tail; tail = &(*tail)->next)
+    {
+        ;
+    }
+
+    *tail = c;
+
+    return REDIS_OK;
+}
+
+static void _redis_subscribe_free_commands(redis_subscribe_command *c)
+{
+    redis_subscribe_command *next = NULL;
+
+    for (; c; c = next)
+    {
+        next = c->next;
+        free(c->cmd);
+        free(c);
+    }
+}
+
+static void _redis_subscription_release(redis_subscription *s)
+{
+    redis_subscription_binding *b = NULL, *prev = NULL;
+
+    if (__sync_sub_and_fetch(&s->refs, 1) > 0)
+    {
+        return;
+    }
+
+    for (b = s->binding; b; b = prev)
+    {
+        prev = b->prev;
+        free(b);
+    }
+
+    free(s->name);
+    free(s);
+}
+
+/**
+ * Caller must hold sub->lock
+ */
+static redis_subscription *_redis_subscribe_find(struct __redis_subscriber *sub, const char *name, int len, 
+                                                 int pattern, unsigned int hash)
+{
+    redis_subscription *s = NULL;
+
+    if (!sub->buckets)
+    {
+        return NULL;
+    }
+
+    for (s = sub->buckets[hash & (sub->nbuckets - 1)]; s; s = s->next)
+    {
+        if (s->hash == hash && s->pattern == pattern && 0 == strncmp(s->name, name, len) && '\0' == s->name[len])
+        {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Add s to subscription table, growing it when full. Caller must hold sub->lock.
+ */
+static int _redis_subscribe_insert(struct __redis_subscriber *sub, redis_subscription *s)
+{
+    int i = 0, nbuckets = 0;
+    redis_subscription **buckets = NULL, *t = NULL, *next = NULL;
+
+    if (!sub->buckets || sub->nsubscriptions >= sub->nbuckets)
+    {
+        nbuckets = sub->buckets ? sub->nbuckets * 2 : REDIS_SUBSCRIBE_BUCKETS;
+
+        buckets = (redis_subscription **)calloc(nbuckets, sizeof(redis_subscription *));
+        if (!buckets && !sub->buckets)
+        {
+            EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+            return REDIS_ERR;
+        }
+
+        /* a full table still works, only chains get longer */
+        if (buckets)
+        {
+            for (i = 0; i < sub->nbuckets; ++i)
+            {
+                for (t = sub->buckets[i]; t; t = next)
+                {
+                    next = t->next;
+                    t->next = buckets[t->hash & (nbuckets - 1)];
+                    buckets[t->hash & (nbuckets - 1)] = t;
+                }
+            }
+
+            free(sub->buckets);
+            sub->buckets = buckets;
+            sub->nbuckets = nbuckets;
+        }
+    }
+
+    s->next = sub->buckets[s->hash & (sub->nbuckets - 1)];
+    sub->buckets[s->hash & (sub->nbuckets - 1)] = s;
+    sub->nsubscriptions++;
+
+    return REDIS_OK;
+}
+
+/**
+ * Take s out of subscription table, caller must hold sub->lock
+ */
+static void _redis_subscribe_unlink(struct __redis_subscriber *sub, redis_subscription *s)
+{
+    redis_subscription **link = NULL;
+
+    for (link = &sub->buckets[s->hash & (sub->nbuckets - 1)]; *link; link = &(*link)->next)
+    {
+        if (*link == s)
+        {
+            *link = s->next;
+            sub->nsubscriptions--;
+            break;
+        }
+    }
+}
+
+/**
+ * Parse one reply of subscribed connection, messages are batched per dispatcher
+ */
+static void _redis_subscribe_on_reply(struct __redis_subscriber *sub, redisReply *reply)
+{
+    int pattern = 0;
+    unsigned int hash = 0;
+    redisReply *kind = NULL, *from = NULL, *channel = NULL, *payload = NULL;
+    redis_subscription *s = NULL;
+    redis_message *m = NULL;
+    redis_dispatcher *d = NULL;
+
+    if (REDIS_REPLY_ARRAY != reply->type || reply->elements < 3 ||
+        REDIS_REPLY_STRING != reply->element[0]->type)
+    {
+        EMI_LOG("%s: unexpected reply type[%d] on subscribed connection\n", __FUNCTION__, reply->type);
+        return;
+    }
+
+    kind = reply->element[0];
+
+    if (0 == strcmp(kind->str, "message") && 3 == reply->elements)
+    {
+        from = reply->element[1];
+        channel = reply->element[1];
+        payload = reply->element[2];
+    }
+    else if (0 == strcmp(kind->str, "pmessage") && 4 == reply->elements)
+    {
+        pattern = 1;
+        from = reply->element[1];
+        channel = reply->element[2];
+        payload = reply->element[3];
+    }
+    else
+    {
+        /* (p)(un)subscribe confirmation, third element is count of subscriptions */
+        if (REDIS_REPLY_INTEGER == reply->element[2]->type)
+        {
+            if (reply->element[2]->integer > 0)
+            {
+                sub->conn->redis->flags |= REDIS_SUBSCRIBED;
+            }
+            else
+            {
+                sub->conn->redis->flags &= ~REDIS_SUBSCRIBED;
+            }
+        }
+
+        return;
+    }
+
+    m = (redis_message *)malloc(sizeof(redis_message) + from->len + channel->len + payload->len + 3);
+    if (!m)
+    {
+        EMI_LOG("%s: FATAL, out of memory, drop message\n", __FUNCTION__);
+        return;
+    }
+
+    hash = _redis_subscribe_hash(from->str, from->len);
+
+    /* only held for the lookup, against (UN)SUBSCRIBE changing the table */
+    pthread_mutex_lock(&sub->lock);
+
+    s = _redis_subscribe_find(sub, from->str, from->len, pattern, hash);
+    if (s)
+    {
+        __sync_add_and_fetch(&s->refs, 1);
+    }
+
+    pthread_mutex_unlock(&sub->lock);
+
+    if (!s)
+    {
+        /* unsubscribed while message was in flight */
+        free(m);
+        return;
+    }
+
+    m->next = NULL;
+    m->subscription = s;
+    m->length = payload->len;
+
+    m->channel = m->data;
+    memcpy(m->channel, channel->str, channel->len);
+    m->channel[channel->len] = '\0';
+
+    m->message = m->channel + channel->len + 1;
+    memcpy(m->message, payload->str, payload->len);
+    m->message[payload->len] = '\0';
+
+    m->pattern = NULL;
+    if (pattern)
+    {
+        m->pattern = m->message + payload->len + 1;
+        memcpy(m->pattern, from->str, from->len);
+        m->pattern[from->len] = '\0';
+    }
+
+    /* same channel, same dispatcher: keeps per channel order */
+    if (pattern)
+    {
+        hash = _redis_subscribe_hash(channel->str, channel->len);
+    }
+
+    d = &sub->workers[hash % sub->nworkers];
+    if (d->batch_tail)
+    {
+        d->batch_tail->next = m;
+    }
+    else
+    {
+        d->batch_head = m;
+    }
+    d->batch_tail = m;
+}
+
+/**
+ * Hand batched messages over to dispatchers, one lock and one signal per batch
+ */
+static void _redis_subscribe_dispatch(struct __redis_subscriber *sub)
+{
+    int i = 0;
+    redis_dispatcher *d = NULL;
+
+    for (i = 0; i < sub->nworkers; ++i)
+    {
+        d = &sub->workers[i];
+        if (!d->batch_head)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&d->lock);
+
+        if (d->tail)
+        {
+            d->tail->next = d->batch_head;
+        }
+        else
+        {
+            d->head = d->batch_head;
+        }
+        d->tail = d->batch_tail;
+
+        pthread_cond_signal(&d->cond);
+        pthread_mutex_unlock(&d->lock);
+
+        d->batch_head = NULL;
+        d->batch_tail = NULL;
+    }
+}
+
+static void _redis_subscribe_disconnect(struct __redis_subscriber *sub)
+{
+    EMI_LOG("%s: lost subscribed connection\n", __FUNCTION__);
+
+    redisFree(sub->conn->redis);
+    sub->conn->redis = NULL;
+    sub->conn->db_index = -1;
+}
+
+/**
+ * Connect and restore every subscription, pending commands are obsoleted by it
+ */
+static int _redis_subscribe_connect(struct __redis_subscriber *sub)
+{
+    int rc = REDIS_OK, i = 0;
+    redis_subscription *s = NULL;
+
+    rc = _redis_try_connect_nonblock(sub->conn, 0);
+    if (REDIS_OK != rc)
+    {
+        return rc;
+    }
+
+    pthread_mutex_lock(&sub->lock);
+
+    _redis_subscribe_free_commands(sub->commands);
+    sub->commands = NULL;
+
+    for (i = 0; sub->buckets && i < sub->nbuckets; ++i)
+    {
+        for (s = sub->buckets[i]; s; s = s->next)
+        {
+            _redis_subscribe_queue(sub, s->pattern ? "PSUBSCRIBE" : "SUBSCRIBE", s->name);
+        }
+    }
+
+    pthread_mutex_unlock(&sub->lock);
+
+    return REDIS_OK;
+}
+
+/**
+ * Write queued (UN)SUBSCRIBE to the socket
+ */
+static int _redis_subscribe_flush(struct __redis_subscriber *sub)
+{
+    int done = 0;
+    redisContext *redis = sub->conn->redis;
+    redis_subscribe_command *c = NULL, *commands = NULL;
+
+    pthread_mutex_lock(&sub->lock);
+    commands = sub->commands;
+    sub->commands = NULL;
+    pthread_mutex_unlock(&sub->lock);
+
+    for (c = commands; c; c = c->next)
+    {
+        redisAppendFormattedCommand(redis, c->cmd, c->len);
+    }
+
+    _redis_subscribe_free_commands(commands);
+
+    while (!done)
+    {
+        if (REDIS_OK != redisBufferWrite(redis, &done))
+        {
+            EMI_LOG("%s: redisBufferWrite error: %s\n", __FUNCTION__,
+                     REDIS_ERR_IO == redis->err ? strerror(errno) : redis->errstr);
+            return REDIS_ERR;
+        }
+    }
+
+    return REDIS_OK;
+}
+
+static int _redis_subscribe_read(struct __redis_subscriber *sub)
+{
+    int rc = REDIS_OK;
+    void *reply = NULL;
+    redisContext *redis = sub->conn->redis;
+
+    if (REDIS_OK != redisBufferRead(redis))
+    {
+        EMI_LOG("%s: redisBufferRead error: %s\n", __FUNCTION__,
+                 REDIS_ERR_IO == redis->err ? strerror(errno) : redis->errstr);
+        return REDIS_ERR;
+    }
+
+    while (1)
+    {
+        rc = redisGetReplyFromReader(redis, &reply);
+        if (REDIS_OK != rc || !reply)
+        {
+            break;
+        }
+
+        _redis_subscribe_on_reply(sub, (redisReply *)reply);
+        freeReplyObject(reply);
+    }
+
+    _redis_subscribe_dispatch(sub);
+
+    return rc;
+}
+
+static void *_redis_subscribe_reader_routine(void *arg)
+{
+    char buf[64];
+    struct pollfd fds[2];
+    struct __redis_subscriber *sub = (struct __redis_subscriber *)arg;
+
+    while (sub->running)
+    {
+        if (!sub->conn->redis && REDIS_OK != _redis_subscribe_connect(sub))
+        {
+            /* wait a while, but still wake up on stop */
+            fds[0].fd = sub->wakeup[0];
+            fds[0].events = POLLIN;
+            poll(fds, 1, REDIS_SUBSCRIBE_POLL_TIMEOUT);
+            while (read(sub->wakeup[0], buf, sizeof(buf)) > 0)
+            {
+                ;
+            }
+            continue;
+        }
+
+        if (REDIS_OK != _redis_subscribe_flush(sub))
+        {
+            _redis_subscribe_disconnect(sub);
+            continue;
+        }
+
+        fds[0].fd = sub->conn->redis->fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = sub->wakeup[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+
+        if (poll(fds, 2, REDIS_SUBSCRIBE_POLL_TIMEOUT) <= 0)
+        {
+            continue;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            while (read(sub->wakeup[0], buf, sizeof(buf)) > 0)
+            {
+                ;
+            }
+        }
+
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP))
+        {
+            if (REDIS_OK != _redis_subscribe_read(sub))
+            {
+                _redis_subscribe_disconnect(sub);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Call handler of m unless its subscription was removed meanwhile.
+ *
+ * Lock free: running is raised before removed is read, and the remover sets removed
+ * before it reads running, both with full barriers, so either the handler isn't
+ * called or the remover waits for it. sub->lock is only taken to wake the remover.
+ */
+static void _redis_subscribe_deliver(struct __redis_subscriber *sub, redis_message *m)
+{
+    redis_subscription_binding *b = NULL;
+    redis_subscription *s = m->subscription;
+
+    __sync_add_and_fetch(&s->running, 1);
+
+    if (!__sync_fetch_and_add(&s->removed, 0))
+    {
+        b = s->binding;
+
+        _redis_subscribe_running = s;
+        b->handler(m->pattern, m->channel, m->message, m->length, b->arg);
+        _redis_subscribe_running = NULL;
+    }
+
+    if (0 == __sync_sub_and_fetch(&s->running, 1) && __sync_fetch_and_add(&s->removed, 0))
+    {
+        pthread_mutex_lock(&sub->lock);
+        pthread_cond_broadcast(&sub->idle);
+        pthread_mutex_unlock(&sub->lock);
+    }
+
+    _redis_subscription_release(s);
+}
+
+static void *_redis_subscribe_dispatch_routine(void *arg)
+{
+    redis_message *m = NULL, *next = NULL;
+    redis_dispatcher *d = (redis_dispatcher *)arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&d->lock);
+
+        while (!d->head && !d->stop)
+        {
+            pthread_cond_wait(&d->cond, &d->lock);
+        }
+
+        m = d->head;
+        d->head = NULL;
+        d->tail = NULL;
+
+        pthread_mutex_unlock(&d->lock);
+
+        if (!m)
+        {
+            /* stopped and drained */
+            break;
+        }
+
+        for (; m; m = next)
+        {
+            next = m->next;
+            _redis_subscribe_deliver(d->sub, m);
+            free(m);
+        }
+    }
+
+    return NULL;
+}
+
+static void _redis_subscribe_stop(struct __redis_subscriber *sub)
+{
+    int i = 0;
+
+    if (sub->running)
+    {
+        sub->running = 0;
+        _redis_subscribe_wakeup(sub);
+        pthread_join(sub->reader, NULL);
+    }
+
+    for (i = 0; sub->workers && i < sub->nworkers; ++i)
+    {
+        pthread_mutex_lock(&sub->workers[i].lock);
+        sub->workers[i].stop = 1;
+        pthread_cond_signal(&sub->workers[i].cond);
+        pthread_mutex_unlock(&sub->workers[i].lock);
+
+        pthread_join(sub->workers[i].thread, NULL);
+
+        pthread_mutex_destroy(&sub->workers[i].lock);
+        pthread_cond_destroy(&sub->workers[i].cond);
+    }
+
+    free(sub->workers);
+    sub->workers = NULL;
+
+    if (sub->conn)
+    {
+        redis_client_destroy(sub->conn);
+        sub->conn = NULL;
+    }
+
+    if (sub->wakeup[0] >= 0)
+    {
+        close(sub->wakeup[0]);
+        close(sub->wakeup[1]);
+        sub->wakeup[0] = sub->wakeup[1] = -1;
+    }
+}
+
+/**
+ * Start reader thread and dispatchers on first subscription, caller must hold sub->lock
+ */
+static int _redis_subscribe_start(redis_client *this, struct __redis_subscriber *sub)
+{
+    int i = 0;
+    int nworkers = sub->nworkers;
+
+    if (sub->running)
+    {
+        return REDIS_OK;
+    }
+
+    sub->conn = _redis_client_clone(this);
+    if (!sub->conn)
+    {
+        EMI_LOG("%s: create subscribed connection failed\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    /* messages come whenever they are published */
+    sub->conn->command_timeout = 0;
+
+    if (0 != pipe(sub->wakeup))
+    {
+        EMI_LOG("%s: create wakeup pipe failed: %s\n", __FUNCTION__, strerror(errno));
+        sub->wakeup[0] = sub->wakeup[1] = -1;
+        goto on_err;
+    }
+
+    fcntl(sub->wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(sub->wakeup[1], F_SETFL, O_NONBLOCK);
+
+    sub->workers = (redis_dispatcher *)malloc(sizeof(redis_dispatcher) * sub->nworkers);
+    if (!sub->workers)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        goto on_err;
+    }
+
+    memset(sub->workers, 0, sizeof(redis_dispatcher) * sub->nworkers);
+
+    for (i = 0; i < sub->nworkers; ++i)
+    {
+        sub->workers[i].sub = sub;
+        pthread_mutex_init(&sub->workers[i].lock, NULL);
+        pthread_cond_init(&sub->workers[i].cond, NULL);
+
+        if (0 != pthread_create(&sub->workers[i].thread, NULL, _redis_subscribe_dispatch_routine, &sub->workers[i]))
+        {
+            EMI_LOG("%s: create dispatch thread failed: %s\n", __FUNCTION__, strerror(errno));
+            pthread_mutex_destroy(&sub->workers[i].lock);
+            pthread_cond_destroy(&sub->workers[i].cond);
+            sub->nworkers = i;
+            goto on_err;
+        }
+    }
+
+    sub->running = 1;
+
+    if (0 != pthread_create(&sub->reader, NULL, _redis_subscribe_reader_routine, sub))
+    {
+        EMI_LOG("%s: create reader thread failed: %s\n", __FUNCTION__, strerror(errno));
+        sub->running = 0;
+        goto on_err;
+    }
+
+    return REDIS_OK;
+
+on_err:
+    _redis_subscribe_stop(sub);
+    sub->nworkers = nworkers;
+
+    return REDIS_ERR;
+}
+
+static int _redis_subscribe_add(redis_client *this, const char *name, int pattern,
+                                redis_message_handler handler, void *arg)
+{
+    int rc = REDIS_OK;
+    unsigned int hash = 0;
+    redis_subscription *s = NULL;
+    redis_subscription_binding *b = NULL;
+    struct __redis_subscriber *sub = this->Subscribe.subscriber;
+
+    if (!sub)
+    {
+        EMI_LOG("%s: subscriber not initialized\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    b = (redis_subscription_binding *)malloc(sizeof(redis_subscription_binding));
+    if (!b)
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    b->handler = handler;
+    b->arg = arg;
+    b->prev = NULL;
+
+    hash = _redis_subscribe_hash(name, strlen(name));
+
+    pthread_mutex_lock(&sub->lock);
+
+    rc = _redis_subscribe_start(this, sub);
+    if (REDIS_OK != rc)
+    {
+        free(b);
+        goto on_ret;
+    }
+
+    s = _redis_subscribe_find(sub, name, strlen(name), pattern, hash);
+    if (s)
+    {
+        /* already subscribed, only replace handler, fields of b are visible before b */
+        b->prev = s->binding;
+        __sync_synchronize();
+        s->binding = b;
+        goto on_ret;
+    }
+
+    s = (redis_subscription *)malloc(sizeof(redis_subscription));
+    if (!s || !(s->name = strdup(name)))
+    {
+        EMI_LOG("%s: FATAL, out of memory\n", __FUNCTION__);
+        free(s);
+        free(b);
+        rc = REDIS_ERR;
+        goto on_ret;
+    }
+
+    s->pattern = pattern;
+    s->hash = hash;
+    s->binding = b;
+    s->refs = 1;
+    s->removed = 0;
+    s->running = 0;
+
+    if (REDIS_OK != _redis_subscribe_insert(sub, s))
+    {
+        free(s->name);
+        free(s);
+        free(b);
+        rc = REDIS_ERR;
+        goto on_ret;
+    }
+
+    rc = _redis_subscribe_queue(sub, pattern ? "PSUBSCRIBE" : "SUBSCRIBE", name);
+    _redis_subscribe_wakeup(sub);
+
+on_ret:
+    pthread_mutex_unlock(&sub->lock);
+
+    return rc;
+}
+
+static int _redis_subscribe_remove(redis_client *this, const char *name, int pattern)
+{
+    int rc = REDIS_ERR;
+    redis_subscription *s = NULL;
+    struct __redis_subscriber *sub = this->Subscribe.subscriber;
+
+    if (!sub)
+    {
+        EMI_LOG("%s: subscriber not initialized\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    pthread_mutex_lock(&sub->lock);
+
+    s = _redis_subscribe_find(sub, name, strlen(name), pattern, _redis_subscribe_hash(name, strlen(name)));
+    if (s)
+    {
+        _redis_subscribe_unlink(sub, s);
+        __sync_fetch_and_or(&s->removed, 1);
+
+        rc = _redis_subscribe_queue(sub, pattern ? "PUNSUBSCRIBE" : "UNSUBSCRIBE", name);
+        _redis_subscribe_wakeup(sub);
+
+        /**
+         * Queued messages are dropped, wait for handlers already called. Not from a
+         * handler: two handlers unsubscribing each other would wait for each other,
+         * the message of the last one running frees the subscription instead.
+         */
+        while (!_redis_subscribe_running && __sync_fetch_and_add(&s->running, 0) > 0)
+        {
+            pthread_cond_wait(&sub->idle, &sub->lock);
+        }
+
+        _redis_subscription_release(s);
+    }
+
+    pthread_mutex_unlock(&sub->lock);
+
+    if (REDIS_OK != rc)
+    {
+        EMI_LOG("%s: %s[%s] is not subscribed\n", __FUNCTION__, pattern ? "pattern" : "channel", name);
+    }
+
+    return rc;
+}
+
+
+int redis_subscribe_subscribe(redis_client *this, const char *channel, redis_message_handler handler, void *arg)
+{
+    if (!this || !channel || '\0' == channel[0] || !handler)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    return _redis_subscribe_add(this, channel, 0, handler, arg);
+}
+
+int redis_subscribe_psubscribe(redis_client *this, const char *pattern, redis_message_handler handler, void *arg)
+{
+    if (!this || !pattern || '\0' == pattern[0] || !handler)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    return _redis_subscribe_add(this, pattern, 1, handler, arg);
+}
+
+int redis_subscribe_unsubscribe(redis_client *this, const char *channel)
+{
+    if (!this || !channel || '\0' == channel[0])
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    return _redis_subscribe_remove(this, channel, 0);
+}
+
+int redis_subscribe_punsubscribe(redis_client *this, const char *pattern)
+{
+    if (!this || !pattern || '\0' == pattern[0])
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    return _redis_subscribe_remove(this, pattern, 1);
+}
+
+int redis_subscribe_set_workers(redis_client *this, int workers)
+{
+    int rc = REDIS_OK;
+    struct __redis_subscriber *sub = NULL;
+
+    if (!this || workers <= 0)
+    {
+        EMI_LOG("%s: invalid parameter\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    sub = this->Subscribe.subscriber;
+    if (!sub)
+    {
+        EMI_LOG("%s: subscriber not initialized\n", __FUNCTION__);
+        return REDIS_ERR;
+    }
+
+    pthread_mutex_lock(&sub->lock);
+
+    if (sub->running)
+    {
+        EMI_LOG("%s: subscriber allready started\n", __FUNCTION__);
+        rc = REDIS_ERR;
+    }
+    else
+    {
+        sub->nworkers = workers;
+    }
+
+    pthread_mutex_unlock(&sub->lock);
+
+    return rc;
+}
+
+
+int redis_subscribe_init(redis_subscribe *Subscribe)
+{
+    struct __redis_subscriber *sub = NULL;
+
+    Subscribe->SUBSCRIBE    = redis_subscribe_subscribe;
+    Subscribe->PSUBSCRIBE   = redis_subscribe_psubscribe;
+    Subscribe->UNSUBSCRIBE  = redis_subscribe_unsubscribe;
+    Subscribe->PUNSUBSCRIBE = redis_subscribe_punsubscribe;
+    Subscribe->set_workers  = redis_subscribe_set_workers;
+
+    sub = (struct __redis_subscriber *)malloc(sizeof(struct __redis_subscriber));
+    if (!sub)
+    {
+        EMI_LOG("%s: out of memory, malloc subscriber failed\n", __FUNCTION__);
+        Subscribe->subscriber = NULL;
+        return REDIS_ERR;
+    }
+
+    memset(sub, 0, sizeof(struct __redis_subscriber));
+    pthread_mutex_init(&sub->lock, NULL);
+    pthread_cond_init(&sub->idle, NULL);
+    sub->wakeup[0] = sub->wakeup[1] = -1;
+    sub->nworkers = REDIS_SUBSCRIBE_WORKERS;
+
+    Subscribe->subscriber = sub;
+
+    return REDIS_OK;
+}
+
+void redis_subscribe_deinit(redis_subscribe *Subscribe)
+{
+    int i = 0;
+    redis_subscription *s = NULL, *next = NULL;
+    struct __redis_subscriber *sub = Subscribe->subscriber;
+
+    if (!sub)
+    {
+        return;
+    }
+
+    _redis_subscribe_stop(sub);
+
+    /* dispatchers are drained, table holds the last reference */
+    for (i = 0; sub->buckets && i < sub->nbuckets; ++i)
+    {
+        for (s = sub->buckets[i]; s; s = next)
+        {
+            next = s->next;
+            _redis_subscription_release(s);
+        }
+    }
+
+    free(sub->buckets);
+
+    _redis_subscribe_free_commands(sub->commands);
+
+    pthread_cond_destroy(&sub->idle);
+    pthread_mutex_destroy(&sub->lock);
+    free(sub);
+
+    Subscribe->subscriber = NULL;
+}
+
@@ -0,0 +1,64 @@
+
+
+#ifndef __REDIS_SUBSCRIBE_H
+#define __REDIS_SUBSCRIBE_H
+
+
+#include "redis_types.h"
+
+
+/**
+ * Default count of dispatch threads
+ */
+#define REDIS_SUBSCRIBE_WORKERS     4
+
+
+/**
+ * Message handler, called on a dispatch thread.
+ * Messages of one channel are always dispatched to the same thread in order.
+ *
+ * @param
+ * pattern: matched pattern of PSUBSCRIBE, NULL for SUBSCRIBE
+ * message: payload, length bytes plus a trailing '\0'
+ */
+typedef void (*redis_message_handler)(const char *pattern, const char *channel, 
+                                      const char *message, int length, void *arg);
+
+struct __redis_subscriber;
+
+/**
+ * Subscriptions live on a dedicated connection owned by a reader thread, 
+ * so they never take redis_client lock nor block other commands.
+ * (UN)SUBSCRIBE return once the request is queued to the reader thread,
+ * after a reconnect every subscription is restored automatically.
+ *
+ * Once (P)UNSUBSCRIBE returns, the handler is never called again for that
+ * subscription: messages still queued are dropped and a handler already running
+ * on a dispatch thread is waited for, so its arg may be freed right away.
+ * Called from a handler, (P)UNSUBSCRIBE doesn't wait: handlers of that
+ * subscription already running on other dispatch threads may still be in
+ * progress, so an arg they share must outlive them.
+ */
+typedef struct __redis_subscribe
+{
+    int (*SUBSCRIBE)(redis_client *this, const char *channel, redis_message_handler handler, void *arg);
+    int (*PSUBSCRIBE)(redis_client *this, const char *pattern, redis_message_handler handler, void *arg);
+    int (*UNSUBSCRIBE)(redis_client *this, const char *channel);
+    int (*PUNSUBSCRIBE)(redis_client *this, const char *pattern);
+
+    /**
+     * Set count of dispatch threads, must be called before first subscription
+     */
+    int (*set_workers)(redis_client *this, int workers);
+
+    struct __redis_subscriber *subscriber;
+
+} redis_subscribe;
+
+
+int redis_subscribe_init(redis_subscribe *Subscribe);
+void redis_subscribe_deinit(redis_subscribe *Subscribe);
+
+
+#endif
+
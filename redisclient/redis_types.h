@@ -21,6 +21,26 @@ struct __redis_list;
 typedef struct __redis_list redis_list;
 struct __redis_hash;
 typedef struct __redis_hash redis_hash;
+struct __redis_stream;
+typedef struct __redis_stream redis_stream;
+struct __redis_publish;
+typedef struct __redis_publish redis_publish;
+struct __redis_subscribe;
+typedef struct __redis_subscribe redis_subscribe;
+struct __redis_queue;
+typedef struct __redis_queue redis_queue;
+struct __redis_script;
+typedef struct __redis_script redis_script;
+struct __redis_scan;
+typedef struct __redis_scan redis_scan;
+struct __redis_counter;
+typedef struct __redis_counter redis_counter;
+struct __redis_future;
+typedef struct __redis_future redis_future;
+struct __redis_submit;
+typedef struct __redis_submit redis_submit;
+struct __redis_sched;
+typedef struct __redis_sched redis_sched;
 
 #if 0
 #include "redis_key.h"